@@ -0,0 +1,481 @@
+/* Adaptive Huffman coding with the FGK algorithm, see adaptive.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "adaptive.h"
+#include "bitio.h"
+
+#define NYT_SYMBOL (-2)
+#define INTERNAL_SYMBOL (-1)
+#define CHUNKSIZE 4096
+
+// Longest code: a path through all internal nodes plus a literal
+#define MAXSYMBOLBITS (2 * ADAPTIVE_SYMBOLS + ADAPTIVE_LITERALBITS)
+
+static const unsigned char adaptiveMagic[4] = { 0x89, 'H', 'U', 'A' };
+
+/*
+ * Struct 'streamReader'
+ * Reads single bits from a file that is consumed as data arrives
+ *
+ *      output      - file that receives the decoded bytes
+ *      decoded     - decoded bytes not written yet
+ *      pending     - number of bytes in decoded
+ *      written     - number of bytes written to output
+ */
+typedef struct {
+    int fd;
+    unsigned char buffer[CHUNKSIZE];
+    size_t position;
+    size_t length;
+    unsigned int byte;
+    int bits;
+    FILE *output;
+    unsigned char decoded[CHUNKSIZE];
+    size_t pending;
+    int64_t written;
+} streamReader;
+
+static adaptiveLabel *newLabel(uint64_t weight, int symbol, int index);
+static void swapNodes(adaptiveModel *m, binaryTree_pos a, binaryTree_pos b);
+static void rebuild(adaptiveModel *m);
+static int compareWeights(const void *a, const void *b);
+static void putSymbol(adaptiveModel *m, bitWriter *writer, int symbol);
+static int getBit(streamReader *reader);
+static int writeDecoded(streamReader *reader, bool flush);
+static int getSymbol(adaptiveModel *m, streamReader *reader);
+
+adaptiveModel *adaptiveModel_create(uint32_t rebuildInterval){
+	adaptiveModel *m = calloc(1, sizeof(adaptiveModel));
+
+	// The empty tree is a single NYT leaf
+	m->tree = binaryTree_create();
+	binaryTree_setMemHandler(m->tree, free);
+	m->nyt = binaryTree_root(m->tree);
+	binaryTree_setLabel(m->tree, newLabel(0, NYT_SYMBOL, 0), m->nyt);
+	m->order[0] = m->nyt;
+	m->nodes = 1;
+	m->rebuildInterval = rebuildInterval;
+	return m;
+}
+
+/*
+ * adaptiveModel_update - counts one occurrence of symbol.
+ *
+ * A new symbol splits the NYT leaf into an internal node with a new NYT
+ * leaf to the left and the symbol's leaf to the right. Then, from the leaf
+ * up to the root, every node is first swapped with the leader of its block
+ * (the first node in the sibling list with the same weight) and then has
+ * its weight incremented. The leader is never an ancestor other than the
+ * parent, which has equal weight only when the node's sibling is NYT.
+ */
+void adaptiveModel_update(adaptiveModel *m, int symbol){
+	binaryTree_pos q = m->leaf[symbol];
+
+	if(q == NULL){
+		binaryTree_pos oldNyt = m->nyt;
+		adaptiveLabel *oldLabel = binaryTree_inspectLabel(m->tree, oldNyt);
+
+		q = binaryTree_insertRight(m->tree, oldNyt);
+		binaryTree_setLabel(m->tree, newLabel(0, symbol, m->nodes), q);
+		m->order[m->nodes++] = q;
+		m->nyt = binaryTree_insertLeft(m->tree, oldNyt);
+		binaryTree_setLabel(m->tree, newLabel(0, NYT_SYMBOL, m->nodes),
+		                    m->nyt);
+		m->order[m->nodes++] = m->nyt;
+		oldLabel->symbol = INTERNAL_SYMBOL;
+		m->leaf[symbol] = q;
+	}
+
+	while(q != NULL){
+		adaptiveLabel *label = binaryTree_inspectLabel(m->tree, q);
+		int leader = label->index;
+
+		while(leader > 0 &&
+		      ((adaptiveLabel *)m->order[leader - 1]->label)->weight ==
+		      label->weight){
+			leader--;
+		}
+		if(m->order[leader] != q && m->order[leader] != q->parent){
+			swapNodes(m, q, m->order[leader]);
+		}
+		label->weight++;
+		q = q->parent;
+	}
+
+	if(m->rebuildInterval > 0 && ++m->sinceRebuild >= m->rebuildInterval){
+		rebuild(m);
+	}
+}
+
+void adaptiveModel_free(adaptiveModel *m){
+	binaryTree_free(m->tree);
+	free(m);
+}
+
+bool adaptive_isStream(const unsigned char *data, size_t length){
+	return length >= ADAPTIVE_HEADERSIZE &&
+	       !memcmp(data, adaptiveMagic, sizeof(adaptiveMagic)) &&
+	       data[4] == ADAPTIVE_VERSION;
+}
+
+uint64_t adaptive_encodeStream(FILE *input, FILE *output,
+                               uint32_t rebuildInterval){
+	adaptiveModel *m = adaptiveModel_create(rebuildInterval);
+	unsigned char header[ADAPTIVE_HEADERSIZE];
+	unsigned char chunk[CHUNKSIZE];
+	unsigned char *coded = malloc(((size_t)CHUNKSIZE + 1) * MAXSYMBOLBITS / 8
+	                              + 8);
+	uint64_t written = 0;
+	bitWriter writer;
+	ssize_t readBytes;
+	int fd = fileno(input);
+
+	memcpy(header, adaptiveMagic, sizeof(adaptiveMagic));
+	header[4] = ADAPTIVE_VERSION;
+	storeLittleEndian(header + 5, rebuildInterval, 4);
+	if(fwrite(header, 1, sizeof(header), output) != sizeof(header)){
+		written = 0;
+		readBytes = -1;
+	} else {
+		written = sizeof(header);
+		readBytes = 1;
+	}
+
+	/*
+	 * Code whatever the last read returned and hand the whole bytes to
+	 * the output right away, only the bits of a partial byte wait
+	 */
+	bitWriter_init(&writer, coded);
+	while(readBytes > 0 && (readBytes = read(fd, chunk, CHUNKSIZE)) > 0){
+		for(ssize_t i = 0; i < readBytes; i++){
+			putSymbol(m, &writer, chunk[i]);
+		}
+		while(writer.bits >= 8){
+			writer.buffer[writer.position++] = (unsigned char)writer.container;
+			writer.container >>= 8;
+			writer.bits -= 8;
+		}
+		if(fwrite(coded, 1, writer.position, output) != writer.position ||
+		   fflush(output) != 0){
+			readBytes = -1;
+			break;
+		}
+		written += writer.position;
+		writer.position = 0;
+	}
+
+	if(readBytes == 0){
+		putSymbol(m, &writer, ADAPTIVE_EOS);
+		size_t tail = bitWriter_finish(&writer);
+		if(fwrite(coded, 1, tail, output) == tail && fflush(output) == 0){
+			written += tail;
+		} else {
+			written = 0;
+		}
+	} else {
+		written = 0;
+	}
+
+	free(coded);
+	adaptiveModel_free(m);
+	return written;
+}
+
+int64_t adaptive_decodeStream(FILE *input, FILE *output){
+	streamReader *reader = calloc(1, sizeof(streamReader));
+	unsigned char header[ADAPTIVE_HEADERSIZE];
+	int64_t total = -1;
+	adaptiveModel *m;
+	int symbol;
+
+	reader->fd = fileno(input);
+	reader->output = output;
+	for(size_t i = 0; i < sizeof(header); i++){
+		int byte = 0;
+		for(int bit = 0; bit < 8 && byte >= 0; bit++){
+			int value = getBit(reader);
+			byte = value < 0 ? -1 : byte | value << bit;
+		}
+		if(byte < 0){
+			free(reader);
+			return -1;
+		}
+		header[i] = (unsigned char)byte;
+	}
+	if(!adaptive_isStream(header, sizeof(header))){
+		free(reader);
+		return -1;
+	}
+	m = adaptiveModel_create((uint32_t)loadLittleEndian(header + 5, 4));
+
+	while((symbol = getSymbol(m, reader)) >= 0 && symbol != ADAPTIVE_EOS){
+		adaptiveModel_update(m, symbol);
+		reader->decoded[reader->pending++] = (unsigned char)symbol;
+		if(reader->pending == sizeof(reader->decoded) &&
+		   writeDecoded(reader, false) != 0){
+			symbol = -1;
+			break;
+		}
+	}
+	if(symbol == ADAPTIVE_EOS && writeDecoded(reader, true) == 0){
+		total = reader->written;
+	}
+
+	adaptiveModel_free(m);
+	free(reader);
+	return total;
+}
+
+static adaptiveLabel *newLabel(uint64_t weight, int symbol, int index){
+	adaptiveLabel *label = malloc(sizeof(adaptiveLabel));
+	label->weight = weight;
+	label->symbol = symbol;
+	label->index = index;
+	return label;
+}
+
+/*
+ * swapNodes - exchanges two subtrees that are not ancestors of each other,
+ *             both in the tree and in the sibling list
+ */
+static void swapNodes(adaptiveModel *m, binaryTree_pos a, binaryTree_pos b){
+	adaptiveLabel *labelA = binaryTree_inspectLabel(m->tree, a);
+	adaptiveLabel *labelB = binaryTree_inspectLabel(m->tree, b);
+	binaryTree_pos parentA = a->parent;
+	binaryTree_pos parentB = b->parent;
+	binaryTree_pos *slotA = parentA->leftChild == a ? &parentA->leftChild :
+	                        &parentA->rightChild;
+	binaryTree_pos *slotB = parentB->leftChild == b ? &parentB->leftChild :
+	                        &parentB->rightChild;
+	int index = labelA->index;
+
+	*slotA = b;
+	*slotB = a;
+	a->parent = parentB;
+	b->parent = parentA;
+
+	m->order[labelA->index] = b;
+	m->order[labelB->index] = a;
+	labelA->index = labelB->index;
+	labelB->index = index;
+}
+
+/*
+ * rebuild - halves all weights and rebuilds the tree with the static
+ *           Huffman algorithm.
+ *
+ * The leaves, sorted by weight, and the internal nodes, created in order of
+ * weight, form two queues; the two lightest fronts are merged until one node
+ * is left. Nodes leave the queues in non-decreasing weight with siblings
+ * one after the other, so the reverse removal order is a valid sibling
+ * list. The NYT leaf keeps weight 0 and ends up deepest.
+ */
+static void rebuild(adaptiveModel *m){
+	binaryTree_pos leaves[ADAPTIVE_SYMBOLS + 1];
+	binaryTree_pos internal[ADAPTIVE_SYMBOLS];
+	binaryTree_pos removed[2 * ADAPTIVE_SYMBOLS + 1];
+	int leafCount = 0;
+	int internalCount = 0;
+	int leafNext = 0;
+	int internalNext = 0;
+	int removedCount = 0;
+
+	m->sinceRebuild = 0;
+	if(m->nodes == 1){
+		return;
+	}
+
+	// Detach the leaves, free the old internal nodes
+	for(int i = 0; i < m->nodes; i++){
+		binaryTree_pos n = m->order[i];
+		adaptiveLabel *label = n->label;
+		if(label->symbol == INTERNAL_SYMBOL){
+			if(n != binaryTree_root(m->tree)){
+				free(label);
+				free(n);
+			}
+		} else {
+			label->weight = (label->weight + 1) / 2;
+			n->parent = NULL;
+			leaves[leafCount++] = n;
+		}
+	}
+	free(binaryTree_root(m->tree)->label);
+	qsort(leaves, leafCount, sizeof(binaryTree_pos), compareWeights);
+
+	while(leafCount - leafNext + internalCount - internalNext > 1){
+		binaryTree_pos pair[2];
+		for(int k = 0; k < 2; k++){
+			if(internalNext == internalCount ||
+			   (leafNext < leafCount &&
+			    ((adaptiveLabel *)leaves[leafNext]->label)->weight <=
+			    ((adaptiveLabel *)internal[internalNext]->label)->weight)){
+				pair[k] = leaves[leafNext++];
+			} else {
+				pair[k] = internal[internalNext++];
+			}
+			removed[removedCount++] = pair[k];
+		}
+
+		// The last merge reuses the root node of the tree
+		binaryTree_pos parent;
+		if(leafCount - leafNext + internalCount - internalNext == 0){
+			parent = binaryTree_root(m->tree);
+		} else {
+			parent = calloc(1, sizeof(node));
+		}
+		parent->leftChild = pair[0];
+		parent->rightChild = pair[1];
+		pair[0]->parent = parent;
+		pair[1]->parent = parent;
+		parent->label = newLabel(
+		        ((adaptiveLabel *)pair[0]->label)->weight +
+		        ((adaptiveLabel *)pair[1]->label)->weight,
+		        INTERNAL_SYMBOL, 0);
+		internal[internalCount++] = parent;
+	}
+	removed[removedCount++] = binaryTree_root(m->tree);
+	binaryTree_root(m->tree)->parent = NULL;
+
+	for(int i = 0; i < removedCount; i++){
+		m->order[i] = removed[removedCount - 1 - i];
+		((adaptiveLabel *)m->order[i]->label)->index = i;
+	}
+	m->nodes = removedCount;
+}
+
+/*
+ * compareWeights - orders leaves by weight, then by symbol, for qsort
+ */
+static int compareWeights(const void *a, const void *b){
+	const adaptiveLabel *labelA = (*(binaryTree_pos const *)a)->label;
+	const adaptiveLabel *labelB = (*(binaryTree_pos const *)b)->label;
+
+	if(labelA->weight != labelB->weight){
+		return labelA->weight < labelB->weight ? -1 : 1;
+	}
+	return labelA->symbol - labelB->symbol;
+}
+
+/*
+ * putSymbol - writes the code of a symbol (plus a literal for new symbols)
+ *             and updates the model
+ */
+static void putSymbol(adaptiveModel *m, bitWriter *writer, int symbol){
+	unsigned char path[2 * ADAPTIVE_SYMBOLS];
+	int length = 0;
+	binaryTree_pos n = m->leaf[symbol] != NULL ? m->leaf[symbol] : m->nyt;
+
+	// Collect the path from the leaf up, then write it from the root down
+	while(n->parent != NULL){
+		path[length++] = n->parent->rightChild == n;
+		n = n->parent;
+	}
+	while(length > 0){
+		int chunk = length < 24 ? length : 24;
+		uint32_t bits = 0;
+		for(int k = 0; k < chunk; k++){
+			bits |= (uint32_t)path[length - 1 - k] << k;
+		}
+		bitWriter_put(writer, bits, chunk);
+		length -= chunk;
+	}
+	if(m->leaf[symbol] == NULL){
+		bitWriter_put(writer, (uint32_t)symbol, ADAPTIVE_LITERALBITS);
+	}
+	adaptiveModel_update(m, symbol);
+}
+
+/*
+ * getBit - reads the next bit of the stream
+ *
+ * Returns:     the bit, -1 at end of file or if the decoded bytes couldn't
+ *              be written
+ *
+ * Comments:    The read may wait for the encoder, so everything decoded
+ *              until then is passed on first.
+ */
+static int getBit(streamReader *reader){
+	int bit;
+
+	if(reader->bits == 0){
+		if(reader->position == reader->length){
+			ssize_t readBytes;
+			if(writeDecoded(reader, true) != 0){
+				return -1;
+			}
+			readBytes = read(reader->fd, reader->buffer, CHUNKSIZE);
+			if(readBytes <= 0){
+				return -1;
+			}
+			reader->length = (size_t)readBytes;
+			reader->position = 0;
+		}
+		reader->byte = reader->buffer[reader->position++];
+		reader->bits = 8;
+	}
+	bit = reader->byte & 1;
+	reader->byte >>= 1;
+	reader->bits--;
+	return bit;
+}
+
+/*
+ * writeDecoded - writes the pending decoded bytes to the output
+ *
+ * Parameter:   reader  - the reader holding the bytes
+ *              flush   - also flush the output
+ *
+ * Returns:     0 on success, -1 on write errors
+ */
+static int writeDecoded(streamReader *reader, bool flush){
+	if(fwrite(reader->decoded, 1, reader->pending, reader->output) !=
+	   reader->pending || (flush && fflush(reader->output) != 0)){
+		return -1;
+	}
+	reader->written += (int64_t)reader->pending;
+	reader->pending = 0;
+	return 0;
+}
+
+/*
+ * getSymbol - follows the bits from the root to a leaf
+ *
+ * Returns:     the symbol, -1 if the stream ended or holds an invalid
+ *              literal
+ */
+static int getSymbol(adaptiveModel *m, streamReader *reader){
+	binaryTree_pos n = binaryTree_root(m->tree);
+	adaptiveLabel *label;
+
+	while(binaryTree_hasLeftChild(m->tree, n)){
+		int bit = getBit(reader);
+		if(bit < 0){
+			return -1;
+		}
+		n = bit ? binaryTree_rightChild(m->tree, n) :
+		          binaryTree_leftChild(m->tree, n);
+	}
+	label = binaryTree_inspectLabel(m->tree, n);
+	if(label->symbol == NYT_SYMBOL){
+		int symbol = 0;
+		for(int k = 0; k < ADAPTIVE_LITERALBITS; k++){
+			int bit = getBit(reader);
+			if(bit < 0){
+				return -1;
+			}
+			symbol |= bit << k;
+		}
+		if(symbol >= ADAPTIVE_SYMBOLS || m->leaf[symbol] != NULL){
+			return -1;
+		}
+		return symbol;
+	}
+	return label->symbol;
+}
@@ -0,0 +1,125 @@
+/* Adaptive (one pass) Huffman coding with the FGK algorithm (Faller 1973,
+ * Gallager 1978, Knuth 1985).
+ *
+ * Encoder and decoder start from the same empty tree and update it in the
+ * same way after every symbol, so no model has to be stored or trained.
+ * The tree is a 'tree_3cell' whose nodes are also kept in an array, the
+ * sibling list, ordered by non-increasing weight with siblings next to each
+ * other (the sibling property). Updating a symbol walks from its leaf to the
+ * root, swapping each node with the first node of equal weight in the list,
+ * so an update costs time proportional to the code length.
+ *
+ * Symbols that haven't been seen are coded as the code of the NYT ("not yet
+ * transmitted") leaf followed by the symbol as a 9-bit literal. Symbol
+ * ADAPTIVE_EOS ends the stream. Every rebuildInterval symbols all weights
+ * are halved and the tree is rebuilt with the static algorithm, which keeps
+ * the tree shallow and lets it follow drifting statistics.
+ *
+ * Stream format: magic 0x89 'H' 'U' 'A', version byte, the rebuild interval
+ * as 4 byte little endian integer, then the codes. The first bit is the
+ * least significant bit of a byte, as in the other formats.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __ADAPTIVE_H
+#define __ADAPTIVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "tree_3cell.h"
+
+#define ADAPTIVE_SYMBOLS 257
+#define ADAPTIVE_EOS 256
+#define ADAPTIVE_LITERALBITS 9
+#define ADAPTIVE_HEADERSIZE 9
+#define ADAPTIVE_VERSION 1
+
+// Default number of symbols between two rebuilds of the tree
+#define ADAPTIVE_REBUILD (1 << 16)
+
+/*
+ * Struct 'adaptiveLabel'
+ * Label of the nodes of the adaptive tree
+ */
+typedef struct {
+    uint64_t weight;
+    int symbol;
+    int index;
+} adaptiveLabel;
+
+/*
+ * Struct 'adaptiveModel'
+ *
+ *      tree            - the Huffman tree
+ *      order           - the sibling list, order[0] is the root
+ *      nodes           - number of nodes in the tree
+ *      leaf            - leaf of every symbol, NULL if not seen yet
+ *      nyt             - the leaf for symbols not seen yet
+ *      sinceRebuild    - symbols coded since the last rebuild
+ *      rebuildInterval - symbols between rebuilds, 0 to never rebuild
+ */
+typedef struct {
+    binary_tree *tree;
+    binaryTree_pos order[2 * ADAPTIVE_SYMBOLS + 1];
+    int nodes;
+    binaryTree_pos leaf[ADAPTIVE_SYMBOLS];
+    binaryTree_pos nyt;
+    uint64_t sinceRebuild;
+    uint32_t rebuildInterval;
+} adaptiveModel;
+
+/*
+ * adaptiveModel_create - creates a model where no symbol has been seen
+ *
+ * Parameter:   rebuildInterval - symbols between two rebuilds, 0 to never
+ *                                rebuild
+ */
+adaptiveModel *adaptiveModel_create(uint32_t rebuildInterval);
+
+/*
+ * adaptiveModel_update - counts one occurrence of symbol and restores the
+ *                        sibling property
+ */
+void adaptiveModel_update(adaptiveModel *m, int symbol);
+
+/*
+ * adaptiveModel_free - deallocates the model and its tree
+ */
+void adaptiveModel_free(adaptiveModel *m);
+
+/*
+ * adaptive_isStream - checks if a buffer starts with the stream magic
+ */
+bool adaptive_isStream(const unsigned char *data, size_t length);
+
+/*
+ * adaptive_encodeStream - encodes everything read from input
+ *
+ * Parameter:   input           - file to encode, read as data arrives
+ *              output          - file that receives the stream
+ *              rebuildInterval - symbols between two rebuilds
+ *
+ * Returns:     number of bytes written, 0 on I/O errors
+ *
+ * Comments:    Codes are written and flushed as soon as the data that was
+ *              available has been coded, so the encoder can sit in a pipe.
+ */
+uint64_t adaptive_encodeStream(FILE *input, FILE *output,
+                               uint32_t rebuildInterval);
+
+/*
+ * adaptive_decodeStream - decodes a stream written by adaptive_encodeStream
+ *
+ * Returns:     number of bytes decoded, -1 if the stream is corrupt or
+ *              truncated or output couldn't be written
+ *
+ * Comments:    The bytes decoded so far are written and flushed whenever
+ *              the decoder has to wait for more input, so that it can sit
+ *              at the end of a pipe too.
+ */
+int64_t adaptive_decodeStream(FILE *input, FILE *output);
+
+#endif
@@ -0,0 +1,404 @@
+/* Wide alphabets, see alphabet.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "alphabet.h"
+#include "bitio.h"
+#include "huffmantree.h"
+
+#define EMPTY_KEY UINT32_MAX
+#define INITIAL_CAPACITY 1024
+
+static size_t hashSlot(uint32_t symbol, size_t capacity);
+static void grow(sparseHistogram *h);
+static int compareSymbols(const void *a, const void *b);
+
+size_t alphabet_nextSymbol(int alphabet, const unsigned char *input,
+                           size_t length, uint32_t *symbol){
+	uint32_t codePoint;
+	uint32_t smallest;
+	size_t extra;
+
+	if(alphabet == ALPHABET_PAIR){
+		if(length >= 2){
+			*symbol = input[0] | (uint32_t)input[1] << 8;
+			return 2;
+		}
+		*symbol = ALPHABET_PAIR_RAW + input[0];
+		return 1;
+	}
+
+	if(input[0] < 0x80){
+		*symbol = input[0];
+		return 1;
+	}
+	if((input[0] & 0xe0) == 0xc0){
+		extra = 1;
+		codePoint = input[0] & 0x1f;
+		smallest = 0x80;
+	} else if((input[0] & 0xf0) == 0xe0){
+		extra = 2;
+		codePoint = input[0] & 0x0f;
+		smallest = 0x800;
+	} else if((input[0] & 0xf8) == 0xf0){
+		extra = 3;
+		codePoint = input[0] & 0x07;
+		smallest = 0x10000;
+	} else {
+		extra = 0;
+		codePoint = 0;
+		smallest = 1;
+	}
+	if(extra == 0 || length <= extra){
+		*symbol = ALPHABET_UTF8_RAW + input[0];
+		return 1;
+	}
+	for(size_t k = 1; k <= extra; k++){
+		if((input[k] & 0xc0) != 0x80){
+			*symbol = ALPHABET_UTF8_RAW + input[0];
+			return 1;
+		}
+		codePoint = codePoint << 6 | (input[k] & 0x3f);
+	}
+
+	// Only the shortest encoding of a valid code point maps back exactly
+	if(codePoint < smallest || codePoint > 0x10ffff ||
+	   (codePoint >= 0xd800 && codePoint <= 0xdfff)){
+		*symbol = ALPHABET_UTF8_RAW + input[0];
+		return 1;
+	}
+	*symbol = codePoint;
+	return extra + 1;
+}
+
+size_t alphabet_putSymbol(int alphabet, uint32_t symbol,
+                          unsigned char *output){
+	if(alphabet == ALPHABET_PAIR){
+		if(symbol >= ALPHABET_PAIR_RAW){
+			output[0] = (unsigned char)(symbol - ALPHABET_PAIR_RAW);
+			return 1;
+		}
+		output[0] = (unsigned char)symbol;
+		output[1] = (unsigned char)(symbol >> 8);
+		return 2;
+	}
+
+	if(symbol >= ALPHABET_UTF8_RAW){
+		output[0] = (unsigned char)(symbol - ALPHABET_UTF8_RAW);
+		return 1;
+	}
+	if(symbol < 0x80){
+		output[0] = (unsigned char)symbol;
+		return 1;
+	}
+	if(symbol < 0x800){
+		output[0] = (unsigned char)(0xc0 | symbol >> 6);
+		output[1] = (unsigned char)(0x80 | (symbol & 0x3f));
+		return 2;
+	}
+	if(symbol < 0x10000){
+		output[0] = (unsigned char)(0xe0 | symbol >> 12);
+		output[1] = (unsigned char)(0x80 | ((symbol >> 6) & 0x3f));
+		output[2] = (unsigned char)(0x80 | (symbol & 0x3f));
+		return 3;
+	}
+	output[0] = (unsigned char)(0xf0 | symbol >> 18);
+	output[1] = (unsigned char)(0x80 | ((symbol >> 12) & 0x3f));
+	output[2] = (unsigned char)(0x80 | ((symbol >> 6) & 0x3f));
+	output[3] = (unsigned char)(0x80 | (symbol & 0x3f));
+	return 4;
+}
+
+sparseHistogram *sparseHistogram_empty(void){
+	sparseHistogram *h = malloc(sizeof(sparseHistogram));
+	h->capacity = INITIAL_CAPACITY;
+	h->used = 0;
+	h->key = malloc(h->capacity * sizeof(uint32_t));
+	h->count = calloc(h->capacity, sizeof(uint64_t));
+	h->value = calloc(h->capacity, sizeof(uint32_t));
+	memset(h->key, 0xff, h->capacity * sizeof(uint32_t));
+	return h;
+}
+
+size_t sparseHistogram_slot(sparseHistogram *h, uint32_t symbol){
+	size_t slot;
+
+	if(2 * (h->used + 1) > h->capacity){
+		grow(h);
+	}
+	slot = hashSlot(symbol, h->capacity);
+	while(h->key[slot] != symbol){
+		if(h->key[slot] == EMPTY_KEY){
+			h->key[slot] = symbol;
+			h->count[slot] = 0;
+			h->value[slot] = 0;
+			h->used++;
+			break;
+		}
+		slot = (slot + 1) & (h->capacity - 1);
+	}
+	return slot;
+}
+
+size_t sparseHistogram_find(const sparseHistogram *h, uint32_t symbol){
+	size_t slot = hashSlot(symbol, h->capacity);
+
+	while(h->key[slot] != symbol){
+		if(h->key[slot] == EMPTY_KEY){
+			return (size_t)-1;
+		}
+		slot = (slot + 1) & (h->capacity - 1);
+	}
+	return slot;
+}
+
+void sparseHistogram_clear(sparseHistogram *h){
+	memset(h->key, 0xff, h->capacity * sizeof(uint32_t));
+	h->used = 0;
+}
+
+void sparseHistogram_free(sparseHistogram *h){
+	free(h->key);
+	free(h->count);
+	free(h->value);
+	free(h);
+}
+
+wideModel *wideModel_create(int alphabet){
+	wideModel *m = calloc(1, sizeof(wideModel));
+	m->alphabet = alphabet;
+	m->table = codeTable_create(0);
+	m->index = sparseHistogram_empty();
+	return m;
+}
+
+/*
+ * wideModel_fit - builds the code table for a block of data.
+ *
+ * The symbols that occur are numbered in increasing order, which is also
+ * the order their code lengths are stored in. The dense number of every
+ * symbol is kept in the histogram so the encoder can look it up.
+ */
+uint64_t wideModel_fit(wideModel *m, const unsigned char *input,
+                       size_t length){
+	sparseHistogram *h = m->index;
+	uint64_t *frequency;
+	unsigned char *lengths;
+	uint64_t bits = 0;
+	size_t position = 0;
+	int symbols = 0;
+
+	sparseHistogram_clear(h);
+	while(position < length){
+		uint32_t symbol;
+		size_t slot;
+		position += alphabet_nextSymbol(m->alphabet, input + position,
+		                                length - position, &symbol);
+		// Inserting may move the arrays, so look up the slot first
+		slot = sparseHistogram_slot(h, symbol);
+		h->count[slot]++;
+	}
+
+	free(m->symbol);
+	m->symbol = malloc((h->used + 1) * sizeof(uint32_t));
+	for(size_t slot = 0; slot < h->capacity; slot++){
+		if(h->key[slot] != EMPTY_KEY){
+			m->symbol[symbols++] = h->key[slot];
+		}
+	}
+	qsort(m->symbol, symbols, sizeof(uint32_t), compareSymbols);
+	m->symbols = symbols;
+
+	frequency = malloc((symbols + 1) * sizeof(uint64_t));
+	lengths = malloc(symbols + 1);
+	for(int i = 0; i < symbols; i++){
+		size_t slot = sparseHistogram_find(h, m->symbol[i]);
+		h->value[slot] = (uint32_t)i;
+		frequency[i] = h->count[slot];
+	}
+	getSparseCodeLengths(frequency, symbols, lengths, ALPHABET_MAXLENGTH);
+
+	codeTable_free(m->table);
+	m->table = codeTable_create(symbols);
+	codeTable_setLengths(m->table, lengths);
+	bits = codeTable_cost(m->table, frequency) +
+	       8 * wideModel_serializedSize(m);
+	free(frequency);
+	free(lengths);
+	return bits;
+}
+
+size_t wideModel_serializedSize(const wideModel *m){
+	unsigned char scratch[10];
+	size_t size = 1 + storeVarint(scratch, (uint64_t)m->symbols);
+	uint64_t previous = (uint64_t)-1;
+
+	for(int i = 0; i < m->symbols; i++){
+		size += storeVarint(scratch, (m->symbol[i] - previous) << 5 |
+		                             m->table->length[i]);
+		previous = m->symbol[i];
+	}
+	return size;
+}
+
+size_t wideModel_serialize(const wideModel *m, unsigned char *buffer){
+	size_t position = 1;
+	uint64_t previous = (uint64_t)-1;
+
+	buffer[0] = (unsigned char)m->alphabet;
+	position += storeVarint(buffer + position, (uint64_t)m->symbols);
+	for(int i = 0; i < m->symbols; i++){
+		position += storeVarint(buffer + position,
+		                        (m->symbol[i] - previous) << 5 |
+		                        m->table->length[i]);
+		previous = m->symbol[i];
+	}
+	return position;
+}
+
+long wideModel_deserialize(wideModel *m, const unsigned char *buffer,
+                           size_t length){
+	unsigned char *lengths;
+	uint64_t symbols;
+	uint64_t previous = (uint64_t)-1;
+	size_t position = 1;
+	long used;
+
+	if(length < 1 || (buffer[0] != ALPHABET_UTF8 &&
+	                  buffer[0] != ALPHABET_PAIR)){
+		return -1;
+	}
+	m->alphabet = buffer[0];
+	used = loadVarint(buffer + position, length - position, &symbols);
+	if(used < 0 || symbols > length){
+		return -1;
+	}
+	position += (size_t)used;
+
+	free(m->symbol);
+	m->symbol = malloc((symbols + 1) * sizeof(uint32_t));
+	lengths = malloc(symbols + 1);
+	for(uint64_t i = 0; i < symbols; i++){
+		uint64_t entry;
+		used = loadVarint(buffer + position, length - position, &entry);
+		if(used < 0 || (entry >> 5) == 0 || (entry & 0x1f) == 0 ||
+		   previous + (entry >> 5) >= EMPTY_KEY){
+			free(lengths);
+			m->symbols = 0;
+			return -1;
+		}
+		position += (size_t)used;
+		previous += entry >> 5;
+		m->symbol[i] = (uint32_t)previous;
+		lengths[i] = (unsigned char)(entry & 0x1f);
+	}
+	m->symbols = (int)symbols;
+
+	codeTable_free(m->table);
+	m->table = codeTable_create(m->symbols);
+	if(codeTable_setLengths(m->table, lengths) != 0){
+		free(lengths);
+		return -1;
+	}
+	free(lengths);
+	return (long)position;
+}
+
+size_t wideModel_encode(const wideModel *m, const unsigned char *input,
+                        size_t length, unsigned char *output){
+	bitWriter writer;
+	size_t position = 0;
+
+	bitWriter_init(&writer, output);
+	while(position < length){
+		uint32_t symbol;
+		uint32_t dense;
+		position += alphabet_nextSymbol(m->alphabet, input + position,
+		                                length - position, &symbol);
+		dense = m->index->value[sparseHistogram_find(m->index, symbol)];
+		bitWriter_put(&writer, m->table->code[dense],
+		              m->table->length[dense]);
+	}
+	return bitWriter_finish(&writer);
+}
+
+int wideModel_decode(const wideModel *m, const unsigned char *bits,
+                     size_t length, unsigned char *output,
+                     size_t outputLength){
+	decodeTable *lookup = decodeTable_create(m->table);
+	unsigned char symbolBytes[4];
+	bitReader reader;
+	size_t position = 0;
+	int result = 0;
+
+	bitReader_init(&reader, bits, length);
+	while(position < outputLength){
+		int32_t dense;
+		size_t size;
+
+		if(reader.bits < ALPHABET_MAXLENGTH){
+			bitReader_refill(&reader);
+		}
+		dense = decodeTable_decode(lookup, &reader);
+		if(dense < 0){
+			result = -1;
+			break;
+		}
+		size = alphabet_putSymbol(m->alphabet, m->symbol[dense], symbolBytes);
+		if(size > outputLength - position){
+			result = -1;
+			break;
+		}
+		memcpy(output + position, symbolBytes, size);
+		position += size;
+	}
+	if(bitReader_overrun(&reader)){
+		result = -1;
+	}
+	decodeTable_free(lookup);
+	return result;
+}
+
+void wideModel_free(wideModel *m){
+	free(m->symbol);
+	codeTable_free(m->table);
+	sparseHistogram_free(m->index);
+	free(m);
+}
+
+static size_t hashSlot(uint32_t symbol, size_t capacity){
+	return (size_t)((symbol * UINT32_C(0x9e3779b1)) >> 7) & (capacity - 1);
+}
+
+/*
+ * grow - doubles the capacity of the hash table, keeping all entries
+ */
+static void grow(sparseHistogram *h){
+	sparseHistogram old = *h;
+
+	h->capacity *= 2;
+	h->used = 0;
+	h->key = malloc(h->capacity * sizeof(uint32_t));
+	h->count = calloc(h->capacity, sizeof(uint64_t));
+	h->value = calloc(h->capacity, sizeof(uint32_t));
+	memset(h->key, 0xff, h->capacity * sizeof(uint32_t));
+	for(size_t slot = 0; slot < old.capacity; slot++){
+		if(old.key[slot] != EMPTY_KEY){
+			size_t newSlot = sparseHistogram_slot(h, old.key[slot]);
+			h->count[newSlot] = old.count[slot];
+			h->value[newSlot] = old.value[slot];
+		}
+	}
+	free(old.key);
+	free(old.count);
+	free(old.value);
+}
+
+static int compareSymbols(const void *a, const void *b){
+	uint32_t symbolA = *(const uint32_t *)a;
+	uint32_t symbolB = *(const uint32_t *)b;
+	return symbolA < symbolB ? -1 : symbolA > symbolB;
+}
@@ -0,0 +1,163 @@
+/* Wide alphabets - coding symbols made of several bytes.
+ *
+ * Besides single bytes, input can be split into UTF-8 code points or into
+ * 16-bit byte pairs. Non-ASCII text then spends one code per character
+ * instead of one per byte. Bytes that don't form a valid (shortest form)
+ * UTF-8 sequence, and the odd last byte in pair mode, become symbols of
+ * their own above the code points / pairs, so every input round trips.
+ *
+ * Such alphabets have up to about a million possible symbols of which a
+ * block uses a few thousand, so counts are kept in a 'sparseHistogram'
+ * (an open addressing hash table) and a 'wideModel' numbers the symbols
+ * that occur densely before building its code table.
+ *
+ * Serialized model: alphabet byte, number of symbols as varint, then for
+ * every symbol in increasing order the varint (gap << 5 | code length),
+ * where gap is the difference to the previous symbol (to -1 for the first).
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __ALPHABET_H
+#define __ALPHABET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "codetable.h"
+
+#define ALPHABET_BYTE 0
+#define ALPHABET_UTF8 1
+#define ALPHABET_PAIR 2
+
+// Longest code used for wide alphabets
+#define ALPHABET_MAXLENGTH 24
+
+// First symbol value used for bytes that are not part of a wide symbol
+#define ALPHABET_UTF8_RAW 0x110000
+#define ALPHABET_PAIR_RAW 0x10000
+
+typedef struct {
+    uint32_t *key;
+    uint64_t *count;
+    uint32_t *value;
+    size_t capacity;
+    size_t used;
+} sparseHistogram;
+
+typedef struct {
+    int alphabet;
+    int symbols;
+    uint32_t *symbol;
+    codeTable *table;
+    sparseHistogram *index;
+} wideModel;
+
+/*
+ * alphabet_nextSymbol - reads the symbol at the start of input
+ *
+ * Parameter:   alphabet    - ALPHABET_UTF8 or ALPHABET_PAIR
+ *              input       - data, at least one byte
+ *              length      - bytes available in input
+ *              symbol      - receives the symbol
+ *
+ * Returns:     number of bytes the symbol covers
+ */
+size_t alphabet_nextSymbol(int alphabet, const unsigned char *input,
+                           size_t length, uint32_t *symbol);
+
+/*
+ * alphabet_putSymbol - writes the bytes of a symbol
+ *
+ * Returns:     number of bytes written to output (at most 4)
+ */
+size_t alphabet_putSymbol(int alphabet, uint32_t symbol,
+                          unsigned char *output);
+
+/*
+ * sparseHistogram_empty - creates a histogram without symbols
+ */
+sparseHistogram *sparseHistogram_empty(void);
+
+/*
+ * sparseHistogram_slot - finds the slot of a symbol, inserting it with
+ *                        count 0 if it is new
+ *
+ * Returns:     index of the slot in key / count / value
+ */
+size_t sparseHistogram_slot(sparseHistogram *h, uint32_t symbol);
+
+/*
+ * sparseHistogram_find - finds the slot of a symbol
+ *
+ * Returns:     index of the slot, (size_t)-1 if the symbol isn't present
+ */
+size_t sparseHistogram_find(const sparseHistogram *h, uint32_t symbol);
+
+/*
+ * sparseHistogram_clear - removes all symbols
+ */
+void sparseHistogram_clear(sparseHistogram *h);
+
+/*
+ * sparseHistogram_free - deallocates the histogram
+ */
+void sparseHistogram_free(sparseHistogram *h);
+
+/*
+ * wideModel_create - creates a model without symbols
+ */
+wideModel *wideModel_create(int alphabet);
+
+/*
+ * wideModel_fit - builds the code table for a block of data
+ *
+ * Returns:     exact size in bits of the serialized model plus the data
+ *              coded with it
+ */
+uint64_t wideModel_fit(wideModel *m, const unsigned char *input,
+                       size_t length);
+
+/*
+ * wideModel_serializedSize - bytes needed by wideModel_serialize
+ */
+size_t wideModel_serializedSize(const wideModel *m);
+
+/*
+ * wideModel_serialize - stores the model
+ *
+ * Returns:     number of bytes written to buffer
+ */
+size_t wideModel_serialize(const wideModel *m, unsigned char *buffer);
+
+/*
+ * wideModel_deserialize - restores a model stored with wideModel_serialize
+ *
+ * Returns:     number of bytes consumed, -1 if the data is not a valid model
+ */
+long wideModel_deserialize(wideModel *m, const unsigned char *buffer,
+                           size_t length);
+
+/*
+ * wideModel_encode - codes data with the model
+ *
+ * Returns:     number of bytes written to output
+ */
+size_t wideModel_encode(const wideModel *m, const unsigned char *input,
+                        size_t length, unsigned char *output);
+
+/*
+ * wideModel_decode - decodes outputLength bytes coded with wideModel_encode
+ *
+ * Returns:     0 on success, -1 if the bits are not valid codes, run out
+ *              or don't decode to exactly outputLength bytes
+ */
+int wideModel_decode(const wideModel *m, const unsigned char *bits,
+                     size_t length, unsigned char *output,
+                     size_t outputLength);
+
+/*
+ * wideModel_free - deallocates the model
+ */
+void wideModel_free(wideModel *m);
+
+#endif
@@ -0,0 +1,318 @@
+/* Implementation of the datatype 'ansModel', see ans.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "ans.h"
+#include "bitio.h"
+
+#define BITMAPSIZE 32
+
+static int chooseTableLog(const uint64_t *frequency, size_t length);
+static void normalize(ansModel *m, const uint64_t *frequency,
+                      uint64_t total);
+static void buildTables(ansModel *m);
+
+/*
+ * highBit - position of the highest set bit of value (> 0)
+ */
+static inline int highBit(uint32_t value){
+	return 31 - __builtin_clz(value);
+}
+
+ansModel *ansModel_create(void){
+	return calloc(1, sizeof(ansModel));
+}
+
+/*
+ * The bytes are coded from the last to the first. The last byte picks the
+ * state the encoder starts in, so it costs no bits; every other byte
+ * writes the low bits of the state that moving on from it drops.
+ */
+uint64_t ansModel_fit(ansModel *m, const uint64_t *frequency,
+                      const unsigned char *input, size_t length){
+	uint32_t size;
+	uint32_t state;
+	uint64_t bits;
+	int symbol;
+	int out;
+
+	m->tableLog = chooseTableLog(frequency, length);
+	normalize(m, frequency, length);
+	buildTables(m);
+	size = 1u << m->tableLog;
+
+	if(length > m->capacity){
+		m->capacity = length;
+		free(m->moves);
+		m->moves = malloc(m->capacity * sizeof(*m->moves));
+	}
+	m->count = length;
+
+	symbol = input[length - 1];
+	out = (int)((m->deltaBits[symbol] + (1u << 15)) >> 16);
+	state = ((uint32_t)out << 16) - m->deltaBits[symbol];
+	state = m->encodeState[(int32_t)(state >> out) + m->deltaState[symbol]];
+	bits = (uint64_t)m->tableLog;
+	for(size_t i = length - 1; i-- > 0;){
+		symbol = input[i];
+		out = (int)((state + m->deltaBits[symbol]) >> 16);
+		m->moves[i] = (state & ((1u << out) - 1)) | (uint32_t)out << 16;
+		bits += (uint64_t)out;
+		state = m->encodeState[(int32_t)(state >> out) +
+		                       m->deltaState[symbol]];
+	}
+	m->firstState = state - size;
+	return bits + 8 * ansModel_serializedSize(m);
+}
+
+size_t ansModel_serializedSize(const ansModel *m){
+	size_t present = 0;
+
+	for(int i = 0; i < 256; i++){
+		present += m->normalized[i] > 0;
+	}
+	return 1 + BITMAPSIZE + (present * (size_t)m->tableLog + 7) / 8;
+}
+
+size_t ansModel_serialize(const ansModel *m, unsigned char *buffer){
+	unsigned char counts[(256 * ANS_MAXTABLELOG + 7) / 8 + 4];
+	bitWriter writer;
+	size_t size;
+
+	buffer[0] = (unsigned char)m->tableLog;
+	memset(buffer + 1, 0, BITMAPSIZE);
+	for(int i = 0; i < 256; i++){
+		if(m->normalized[i] > 0){
+			buffer[1 + i / 8] |= (unsigned char)(1 << (i % 8));
+		}
+	}
+
+	/*
+	 * The counts go through a bit writer, which may store up to 4 bytes
+	 * past the last whole byte; the result is copied into place
+	 */
+	bitWriter_init(&writer, counts);
+	for(int i = 0; i < 256; i++){
+		if(m->normalized[i] > 0){
+			bitWriter_put(&writer, m->normalized[i] - 1u, m->tableLog);
+		}
+	}
+	size = bitWriter_finish(&writer);
+	memcpy(buffer + 1 + BITMAPSIZE, counts, size);
+	return 1 + BITMAPSIZE + size;
+}
+
+long ansModel_deserialize(ansModel *m, const unsigned char *buffer,
+                          size_t length){
+	bitReader reader;
+	size_t present = 0;
+	size_t size;
+	uint32_t sum = 0;
+
+	if(length < 1 + BITMAPSIZE || buffer[0] < ANS_MINTABLELOG ||
+	   buffer[0] > ANS_MAXTABLELOG){
+		return -1;
+	}
+	m->tableLog = buffer[0];
+	for(int i = 0; i < 256; i++){
+		present += (buffer[1 + i / 8] >> (i % 8)) & 1;
+	}
+	size = 1 + BITMAPSIZE + (present * (size_t)m->tableLog + 7) / 8;
+	if(present == 0 || size > length){
+		return -1;
+	}
+
+	bitReader_init(&reader, buffer + 1 + BITMAPSIZE, size - 1 - BITMAPSIZE);
+	for(int i = 0; i < 256; i++){
+		m->normalized[i] = 0;
+		if((buffer[1 + i / 8] >> (i % 8)) & 1){
+			m->normalized[i] = (uint16_t)(bitReader_read(&reader,
+			                                             m->tableLog) + 1);
+			sum += m->normalized[i];
+		}
+	}
+	if(sum != 1u << m->tableLog){
+		return -1;
+	}
+	buildTables(m);
+	return (long)size;
+}
+
+size_t ansModel_encode(const ansModel *m, unsigned char *output){
+	bitWriter writer;
+
+	bitWriter_init(&writer, output);
+	bitWriter_put(&writer, m->firstState, m->tableLog);
+	for(size_t i = 0; i + 1 < m->count; i++){
+		bitWriter_put(&writer, m->moves[i] & 0xffff,
+		              (int)(m->moves[i] >> 16));
+	}
+	return bitWriter_finish(&writer);
+}
+
+/*
+ * Every state is a valid index into the decode table whatever bits are
+ * read, so only running out of bits needs checking, once at the end.
+ */
+int ansModel_decode(const ansModel *m, const unsigned char *bits,
+                    size_t length, unsigned char *output,
+                    size_t outputLength){
+	bitReader reader;
+	uint32_t state;
+	size_t i = 0;
+
+	if(outputLength == 0){
+		return 0;
+	}
+	bitReader_init(&reader, bits, length);
+	state = bitReader_read(&reader, m->tableLog);
+
+	// A refill holds four moves of up to ANS_MAXTABLELOG bits
+	while(outputLength - i > 4){
+		bitReader_refill(&reader);
+		for(int k = 0; k < 4; k++){
+			const ansDecodeEntry *e = &m->decode[state];
+			output[i++] = e->symbol;
+			state = e->newState + bitReader_peek(&reader, e->bits);
+			bitReader_consume(&reader, e->bits);
+		}
+	}
+	while(i + 1 < outputLength){
+		const ansDecodeEntry *e = &m->decode[state];
+		output[i++] = e->symbol;
+		state = e->newState + bitReader_read(&reader, e->bits);
+	}
+	output[i] = m->decode[state].symbol;
+	return bitReader_overrun(&reader) ? -1 : 0;
+}
+
+void ansModel_free(ansModel *m){
+	if(m == NULL){
+		return;
+	}
+	free(m->moves);
+	free(m);
+}
+
+/*
+ * chooseTableLog - picks the number of bits of a state for a block
+ *
+ * Small blocks get small tables, as more states than bytes only cost
+ * storage. Every byte that occurs needs a state, and two per byte leave
+ * room to follow the counts.
+ */
+static int chooseTableLog(const uint64_t *frequency, size_t length){
+	int tableLog = ANS_TABLELOG;
+	uint32_t present = 0;
+
+	for(int i = 0; i < 256; i++){
+		present += frequency[i] > 0;
+	}
+	while(tableLog > ANS_MINTABLELOG &&
+	      ((size_t)1 << (tableLog - 1)) >= length){
+		tableLog--;
+	}
+	while((1u << tableLog) < 2 * present){
+		tableLog++;
+	}
+	return tableLog;
+}
+
+/*
+ * normalize - scales the counts of a block to add up to 2^tableLog
+ *
+ * Every byte that occurs gets at least 1. What rounding leaves over or
+ * takes too much goes to the most frequent byte, whose probability it
+ * changes the least, unless that would take more than half of its count;
+ * then the largest counts give up one each in turn.
+ */
+static void normalize(ansModel *m, const uint64_t *frequency,
+                      uint64_t total){
+	uint32_t size = 1u << m->tableLog;
+	uint32_t sum = 0;
+	int largest = 0;
+
+	for(int i = 0; i < 256; i++){
+		uint64_t scaled = (frequency[i] * size + total / 2) / total;
+
+		m->normalized[i] = 0;
+		if(frequency[i] == 0){
+			continue;
+		}
+		m->normalized[i] = (uint16_t)(scaled > 0 ? scaled : 1);
+		sum += m->normalized[i];
+		if(frequency[i] > frequency[largest]){
+			largest = i;
+		}
+	}
+	if(sum <= size || sum - size <= m->normalized[largest] / 2u){
+		m->normalized[largest] = (uint16_t)(m->normalized[largest] + size -
+		                                    sum);
+		return;
+	}
+	while(sum > size){
+		int most = 0;
+		for(int i = 1; i < 256; i++){
+			if(m->normalized[i] > m->normalized[most]){
+				most = i;
+			}
+		}
+		m->normalized[most]--;
+		sum--;
+	}
+}
+
+/*
+ * buildTables - spreads the bytes over the states and builds the tables of
+ *               the encoder and the decoder from the normalized counts
+ *
+ * The states of a byte are spread with a fixed odd step, so that every
+ * byte has states all over the table. The encoder numbers the states of
+ * a byte from its normalized count n up to 2n - 1; a state x of the byte
+ * drops enough low bits to reach that range, and the decoder reads them
+ * back to get from x to the next state.
+ */
+static void buildTables(ansModel *m){
+	uint32_t size = 1u << m->tableLog;
+	uint32_t mask = size - 1;
+	uint32_t step = (size >> 1) + (size >> 3) + 3;
+	uint32_t position = 0;
+	uint32_t start = 0;
+	unsigned char spread[1 << ANS_MAXTABLELOG];
+	uint32_t cumulative[256];
+	uint32_t next[256];
+
+	for(int i = 0; i < 256; i++){
+		uint32_t n = m->normalized[i];
+
+		cumulative[i] = start;
+		next[i] = n;
+		for(uint32_t k = 0; k < n; k++){
+			spread[position] = (unsigned char)i;
+			position = (position + step) & mask;
+		}
+		if(n == 1){
+			m->deltaBits[i] = ((uint32_t)m->tableLog << 16) - size;
+			m->deltaState[i] = (int32_t)start - 1;
+		} else if(n > 1){
+			uint32_t out = (uint32_t)(m->tableLog - highBit(n - 1));
+			m->deltaBits[i] = (out << 16) - (n << out);
+			m->deltaState[i] = (int32_t)start - (int32_t)n;
+		}
+		start += n;
+	}
+
+	for(uint32_t u = 0; u < size; u++){
+		int symbol = spread[u];
+		uint32_t x = next[symbol]++;
+		int bits = m->tableLog - highBit(x);
+
+		m->encodeState[cumulative[symbol]++] = (uint16_t)(size + u);
+		m->decode[u].symbol = (unsigned char)symbol;
+		m->decode[u].bits = (unsigned char)bits;
+		m->decode[u].newState = (uint16_t)((x << bits) - size);
+	}
+}
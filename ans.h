@@ -0,0 +1,146 @@
+/* Datatype 'ansModel' - table based asymmetric numeral system coding.
+ *
+ * A Huffman code spends a whole number of bits on every symbol: a byte
+ * that makes up most of a block still costs a full bit, and every other
+ * byte is rounded to the length of its code. Table based ANS (tANS, as in
+ * FSE) codes a byte of probability p in close to -log2(p) bits:
+ *
+ *  - the counts of the block are normalized to add up to 2^tableLog,
+ *    every byte that occurs keeps a count of at least 1
+ *  - the bytes are spread over a table of 2^tableLog states, each byte
+ *    getting as many states as its normalized count
+ *  - coding a byte moves from one state to another and writes (or reads)
+ *    the few low bits of the state that the move drops
+ *
+ * Both directions are table lookups, shifts and adds. The data is coded
+ * from its last byte to its first, so that the decoder reads the bits
+ * front to back: the state of the first byte (tableLog bits), then the
+ * bits of every move in the order of the bytes.
+ *
+ * Serialized model: tableLog (1 byte), a 32 byte bitmap of the bytes that
+ * occur, then the normalized count minus 1 of each of them in tableLog
+ * bits, padded to a whole byte.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __ANS_H
+#define __ANS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Smallest, largest and usual number of bits of a state
+#define ANS_MINTABLELOG 5
+#define ANS_MAXTABLELOG 12
+#define ANS_TABLELOG 11
+
+// Largest serialized model: header, bitmap and 256 counts
+#define ANS_MAXSERIALIZED (1 + 32 + (256 * ANS_MAXTABLELOG + 7) / 8)
+
+/*
+ * Struct 'ansDecodeEntry'
+ * What the decoder does in a state
+ *
+ *      newState    - the next state before the bits read are added
+ *      symbol      - the byte of the state
+ *      bits        - number of bits read for the next state
+ */
+typedef struct {
+    uint16_t newState;
+    unsigned char symbol;
+    unsigned char bits;
+} ansDecodeEntry;
+
+/*
+ * Struct 'ansModel'
+ *
+ *      tableLog        - number of bits of a state
+ *      normalized      - normalized count of every byte
+ *      deltaBits       - gives the number of bits written when coding a
+ *                        byte from a state: (state + deltaBits) >> 16
+ *      deltaState      - offset of the states of a byte in encodeState
+ *      encodeState     - the next state of the encoder
+ *      decode          - what the decoder does in every state
+ *      moves           - bits written by every move of the last
+ *                        ansModel_fit, the value in the low 16 bits and
+ *                        the number of bits above them
+ *      count           - number of bytes of the last ansModel_fit
+ *      capacity        - size of moves
+ *      firstState      - state the decoder starts in
+ */
+typedef struct {
+    int tableLog;
+    uint16_t normalized[256];
+    uint32_t deltaBits[256];
+    int32_t deltaState[256];
+    uint16_t encodeState[1 << ANS_MAXTABLELOG];
+    ansDecodeEntry decode[1 << ANS_MAXTABLELOG];
+    uint32_t *moves;
+    size_t count;
+    size_t capacity;
+    uint32_t firstState;
+} ansModel;
+
+/*
+ * ansModel_create - creates a model without tables
+ */
+ansModel *ansModel_create(void);
+
+/*
+ * ansModel_fit - builds the tables for a block of data and codes it
+ *
+ * Parameter:   m           - the model
+ *              frequency   - count of every byte in input
+ *              input       - the block
+ *              length      - number of bytes in input (> 0)
+ *
+ * Returns:     exact size in bits of the serialized model plus the data
+ *              coded with it
+ */
+uint64_t ansModel_fit(ansModel *m, const uint64_t *frequency,
+                      const unsigned char *input, size_t length);
+
+/*
+ * ansModel_serializedSize - bytes needed by ansModel_serialize
+ */
+size_t ansModel_serializedSize(const ansModel *m);
+
+/*
+ * ansModel_serialize - stores the normalized counts
+ *
+ * Returns:     number of bytes written to buffer (at most
+ *              ANS_MAXSERIALIZED)
+ */
+size_t ansModel_serialize(const ansModel *m, unsigned char *buffer);
+
+/*
+ * ansModel_deserialize - restores a model stored with ansModel_serialize
+ *
+ * Returns:     number of bytes consumed, -1 if the data is not a valid model
+ */
+long ansModel_deserialize(ansModel *m, const unsigned char *buffer,
+                          size_t length);
+
+/*
+ * ansModel_encode - writes the bits of the data of the last ansModel_fit
+ *
+ * Returns:     number of bytes written to output
+ */
+size_t ansModel_encode(const ansModel *m, unsigned char *output);
+
+/*
+ * ansModel_decode - decodes outputLength bytes coded with ansModel_encode
+ *
+ * Returns:     0 on success, -1 if the bits run out
+ */
+int ansModel_decode(const ansModel *m, const unsigned char *bits,
+                    size_t length, unsigned char *output,
+                    size_t outputLength);
+
+/*
+ * ansModel_free - deallocates the model
+ */
+void ansModel_free(ansModel *m);
+
+#endif
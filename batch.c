@@ -0,0 +1,258 @@
+/* Implementation of batch coding, see batch.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "batch.h"
+#include "mapfile.h"
+#include "ioring.h"
+
+// Output buffer of every worker, kept for all the files it writes
+#define BATCH_BUFFERSIZE (1 << 20)
+
+/*
+ * Struct 'batchWorker'
+ * State of one worker thread
+ *
+ *      batch   - the shared work of all workers
+ *      buffer  - output buffer reused for every file
+ *      ring    - ring for asynchronous I/O, NULL for buffered I/O
+ *      stats   - totals of the files coded by this worker
+ */
+typedef struct batchShared batchShared;
+typedef struct {
+    batchShared *batch;
+    char *buffer;
+    ioring *ring;
+    batchStats stats;
+} batchWorker;
+
+struct batchShared {
+    char *const *inputs;
+    char *const *outputs;
+    size_t count;
+    size_t next;
+    const batchOptions *options;
+};
+
+static void *workerMain(void *argument);
+static bool codeFile(batchWorker *worker, const char *inPath,
+                     const char *outPath);
+
+int batch_defaultThreads(void){
+	long processors = sysconf(_SC_NPROCESSORS_ONLN);
+	return processors > 0 ? (int)processors : 1;
+}
+
+long batch_readList(const char *path, bool encode, char ***inputs,
+                    char ***outputs){
+	FILE *list = fopen(path, "r");
+	char *line = NULL;
+	size_t lineCapacity = 0;
+	ssize_t lineLength;
+	size_t count = 0;
+	size_t capacity = 64;
+
+	if(list == NULL){
+		return -1;
+	}
+	*inputs = malloc(capacity * sizeof(**inputs));
+	*outputs = malloc(capacity * sizeof(**outputs));
+	while((lineLength = getline(&line, &lineCapacity, list)) >= 0){
+		char *tab;
+		size_t length;
+
+		while(lineLength > 0 && (line[lineLength - 1] == '\n' ||
+		                         line[lineLength - 1] == '\r')){
+			line[--lineLength] = '\0';
+		}
+		if(lineLength == 0){
+			continue;
+		}
+		if(count == capacity){
+			capacity *= 2;
+			*inputs = realloc(*inputs, capacity * sizeof(**inputs));
+			*outputs = realloc(*outputs, capacity * sizeof(**outputs));
+		}
+
+		tab = strchr(line, '\t');
+		if(tab != NULL){
+			*tab = '\0';
+			(*outputs)[count] = strdup(tab + 1);
+		} else {
+			length = (size_t)lineLength;
+			(*outputs)[count] = malloc(length + 5);
+			if(!encode && length > 4 && !strcmp(line + length - 4, ".huf")){
+				memcpy((*outputs)[count], line, length - 4);
+				(*outputs)[count][length - 4] = '\0';
+			} else {
+				sprintf((*outputs)[count], "%s%s", line,
+				        encode ? ".huf" : ".out");
+			}
+		}
+		(*inputs)[count] = strdup(line);
+		count++;
+	}
+	free(line);
+	fclose(list);
+	return (long)count;
+}
+
+void batch_freeList(char **inputs, char **outputs, size_t count){
+	for(size_t i = 0; i < count; i++){
+		free(inputs[i]);
+		free(outputs[i]);
+	}
+	free(inputs);
+	free(outputs);
+}
+
+int batch_run(char *const *inputs, char *const *outputs, size_t count,
+              const batchOptions *options, batchStats *stats){
+	batchShared batch = { inputs, outputs, count, 0, options };
+	int threads = options->threads;
+	batchWorker *workers;
+	pthread_t *ids;
+	struct timespec start, end;
+
+	if((size_t)threads > count){
+		threads = count > 0 ? (int)count : 1;
+	}
+	workers = calloc((size_t)threads, sizeof(*workers));
+	ids = malloc((size_t)threads * sizeof(*ids));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// The calling thread is the first worker
+	for(int i = 0; i < threads; i++){
+		workers[i].batch = &batch;
+		workers[i].buffer = malloc(BATCH_BUFFERSIZE);
+	}
+	for(int i = 1; i < threads; i++){
+		if(pthread_create(&ids[i], NULL, workerMain, &workers[i]) != 0){
+			workers[i].batch = NULL;
+		}
+	}
+	workerMain(&workers[0]);
+
+	*stats = (batchStats){ 0, 0, 0, 0, 0, false };
+	for(int i = 0; i < threads; i++){
+		if(i > 0 && workers[i].batch != NULL){
+			pthread_join(ids[i], NULL);
+		}
+		stats->files += workers[i].stats.files;
+		stats->failed += workers[i].stats.failed;
+		stats->bytesIn += workers[i].stats.bytesIn;
+		stats->bytesOut += workers[i].stats.bytesOut;
+		stats->asyncIo |= workers[i].stats.asyncIo;
+		free(workers[i].buffer);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	stats->seconds = (double)(end.tv_sec - start.tv_sec) +
+	                 (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+	free(workers);
+	free(ids);
+	return stats->failed == 0 ? 0 : -1;
+}
+
+/*
+ * workerMain - codes files until the batch runs out of them
+ *
+ * Parameter:   argument    - the batchWorker of the thread
+ */
+static void *workerMain(void *argument){
+	batchWorker *worker = argument;
+	batchShared *batch = worker->batch;
+	int lateFailures;
+
+	// Rings are not shared, every worker sets up its own
+	if(batch->options->asyncIo){
+		worker->ring = ioring_create();
+		worker->stats.asyncIo = worker->ring != NULL;
+	}
+	for(;;){
+		size_t index = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+		if(index >= batch->count){
+			break;
+		}
+		if(codeFile(worker, batch->inputs[index], batch->outputs[index])){
+			worker->stats.files++;
+		} else {
+			worker->stats.failed++;
+		}
+	}
+
+	// Writes still in flight may fail after their file was counted
+	lateFailures = ioring_flush(worker->ring);
+	worker->stats.files -= (uint64_t)lateFailures;
+	worker->stats.failed += (uint64_t)lateFailures;
+	ioring_free(worker->ring);
+	return NULL;
+}
+
+/*
+ * codeFile - encodes or decodes one file of the batch
+ *
+ * Parameter:   worker  - the worker coding it
+ *              inPath  - name of the file to code
+ *              outPath - name of the file to write
+ *
+ * Returns:     true if the file was coded
+ */
+static bool codeFile(batchWorker *worker, const char *inPath,
+                     const char *outPath){
+	const batchOptions *options = worker->batch->options;
+	mapped_file *input = ioring_readFile(worker->ring, inPath);
+	frameOptions frame = options->frame;
+	FILE *output;
+	int64_t result;
+
+	if(input == NULL){
+		fprintf(stderr, "Couldn't open input file %s\n", inPath);
+		return false;
+	}
+	if(!options->encode && !frame_isFrame(input->data, input->length)){
+		fprintf(stderr, "%s is not in the frame format\n", inPath);
+		mapfile_close(input);
+		return false;
+	}
+	output = ioring_openWriter(worker->ring, outPath);
+	if(output == NULL){
+		fprintf(stderr, "Couldn't open output file %s\n", outPath);
+		mapfile_close(input);
+		return false;
+	}
+	if(worker->ring == NULL){
+		setvbuf(output, worker->buffer, _IOFBF, BATCH_BUFFERSIZE);
+	}
+
+	// Hold on to one version of the models for the whole file
+	frame.models = registry_acquire(options->models);
+	if(options->encode){
+		uint64_t written = frame_encode(input->data, input->length, &frame,
+		                                output);
+		result = written > 0 ? (int64_t)written : -1;
+	} else {
+		result = frame_decode(input->data, input->length, frame.models,
+		                      output);
+	}
+	registry_release(frame.models);
+	if(fclose(output) != 0 || result < 0){
+		fprintf(stderr, options->encode ? "Couldn't write output file %s\n" :
+		        "Couldn't decode %s, the file is corrupt or needs the "
+		        "frequency file it was encoded with\n",
+		        options->encode ? outPath : inPath);
+		mapfile_close(input);
+		return false;
+	}
+	worker->stats.bytesIn += input->length;
+	worker->stats.bytesOut += (uint64_t)result;
+	mapfile_close(input);
+	return true;
+}
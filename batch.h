@@ -0,0 +1,112 @@
+/* Batch coding - encodes or decodes many files in one process.
+ *
+ * Coding a file per run of the program reloads the frequency file and
+ * rebuilds the same tables every time, which for small files costs more
+ * than the coding itself. A batch loads the models once, shares them
+ * read only between a pool of worker threads (see sharedRegistry in
+ * registry.h, a new version may be published while the batch runs and
+ * applies from the next file on), and lets every worker reuse
+ * its output buffer from file to file. Workers take the next file from a
+ * shared counter, so a few large files don't hold up the rest.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __BATCH_H
+#define __BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "frame.h"
+#include "registry.h"
+
+/*
+ * Struct 'batchOptions'
+ *
+ *      encode          - true to encode, false to decode
+ *      frame           - frame encoder settings, frame.models is not
+ *                        used
+ *      models          - the models, every file is coded with the
+ *                        version current when it is started
+ *      threads         - number of workers (>= 1)
+ *      asyncIo         - read and write through an ioring per worker
+ *                        (see ioring.h)
+ */
+typedef struct {
+    bool encode;
+    frameOptions frame;
+    sharedRegistry *models;
+    int threads;
+    bool asyncIo;
+} batchOptions;
+
+/*
+ * Struct 'batchStats'
+ * Totals of a batch
+ *
+ *      files       - number of files coded
+ *      failed      - number of files that couldn't be coded
+ *      bytesIn     - bytes read from the files coded
+ *      bytesOut    - bytes written for them
+ *      seconds     - wall clock time of the batch
+ *      asyncIo     - io_uring was used
+ */
+typedef struct {
+    uint64_t files;
+    uint64_t failed;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    double seconds;
+    bool asyncIo;
+} batchStats;
+
+/*
+ * batch_defaultThreads - number of workers used when none is asked for: one
+ *                        per online processor
+ */
+int batch_defaultThreads(void);
+
+/*
+ * batch_readList - reads the files of a batch from a list file
+ *
+ * Parameter:   path    - the list file, one file per line as "INPUT" or
+ *                        "INPUT<tab>OUTPUT"
+ *              encode  - true if the files are to be encoded
+ *              inputs  - receives the names of the files to code
+ *              outputs - receives the names of the files to write
+ *
+ * Returns:     number of files, -1 if the list couldn't be read
+ *
+ * Comments:    Without an output name the output is INPUT.huf when
+ *              encoding, and INPUT without .huf (or INPUT.out) when
+ *              decoding. Empty lines are skipped. Deallocate the names
+ *              with batch_freeList.
+ */
+long batch_readList(const char *path, bool encode, char ***inputs,
+                    char ***outputs);
+
+/*
+ * batch_freeList - deallocates the names read by batch_readList
+ */
+void batch_freeList(char **inputs, char **outputs, size_t count);
+
+/*
+ * batch_run - codes count files
+ *
+ * Parameter:   inputs  - names of the files to code
+ *              outputs - names of the files to write, outputs[i] receives
+ *                        the coded inputs[i]
+ *              count   - number of files
+ *              options - settings of the batch
+ *              stats   - receives the totals
+ *
+ * Returns:     0 if every file was coded, -1 otherwise
+ *
+ * Comments:    Files that fail are reported on stderr and the batch goes
+ *              on with the others.
+ */
+int batch_run(char *const *inputs, char *const *outputs, size_t count,
+              const batchOptions *options, batchStats *stats);
+
+#endif
@@ -0,0 +1,212 @@
+/* Bit level reading and writing of memory buffers.
+ *
+ * Bits are stored in the same order as in the legacy format produced with
+ * 'bitset': the first bit of a stream is the least significant bit of its
+ * first byte. Codes are therefore stored with their first bit in the least
+ * significant position (see codetable.h).
+ *
+ * All functions are inline since they are called once per coded symbol.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __BITIO_H
+#define __BITIO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+    unsigned char *buffer;
+    size_t position;
+    uint64_t container;
+    int bits;
+} bitWriter;
+
+typedef struct {
+    const unsigned char *buffer;
+    size_t length;
+    size_t position;
+    uint64_t container;
+    int bits;
+} bitReader;
+
+/*
+ * storeLittleEndian - stores the lowest bytes bytes of value, least
+ *                     significant byte first
+ */
+static inline void storeLittleEndian(unsigned char *buffer, uint64_t value,
+                                     int bytes){
+	for(int i = 0; i < bytes; i++){
+		buffer[i] = (unsigned char)(value >> (8 * i));
+	}
+}
+
+/*
+ * loadLittleEndian - loads an integer of bytes bytes stored with
+ *                    storeLittleEndian
+ */
+static inline uint64_t loadLittleEndian(const unsigned char *buffer,
+                                        int bytes){
+	uint64_t value = 0;
+	for(int i = 0; i < bytes; i++){
+		value |= (uint64_t)buffer[i] << (8 * i);
+	}
+	return value;
+}
+
+/*
+ * storeVarint - stores value 7 bits per byte, lowest bits first, with the
+ *               high bit of a byte telling that more bytes follow
+ *
+ * Returns:     number of bytes used, at most 10
+ */
+static inline size_t storeVarint(unsigned char *buffer, uint64_t value){
+	size_t size = 0;
+	while(value >= 0x80){
+		buffer[size++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	buffer[size++] = (unsigned char)value;
+	return size;
+}
+
+/*
+ * loadVarint - loads an integer stored with storeVarint
+ *
+ * Returns:     number of bytes used, -1 if the varint doesn't end within
+ *              length (or 10) bytes
+ */
+static inline long loadVarint(const unsigned char *buffer, size_t length,
+                              uint64_t *value){
+	*value = 0;
+	for(size_t i = 0; i < length && i < 10; i++){
+		*value |= (uint64_t)(buffer[i] & 0x7f) << (7 * i);
+		if(!(buffer[i] & 0x80)){
+			return (long)(i + 1);
+		}
+	}
+	return -1;
+}
+
+/*
+ * bitWriter_init - starts writing bits at the beginning of buffer
+ *
+ * Comments:    The buffer must be large enough for all bits that will be
+ *              written rounded up to whole bytes, plus 4 bytes.
+ */
+static inline void bitWriter_init(bitWriter *w, unsigned char *buffer){
+	w->buffer = buffer;
+	w->position = 0;
+	w->container = 0;
+	w->bits = 0;
+}
+
+/*
+ * bitWriter_put - appends the length (<= 32) lowest bits of code
+ */
+static inline void bitWriter_put(bitWriter *w, uint32_t code, int length){
+	w->container |= (uint64_t)code << w->bits;
+	w->bits += length;
+	if(w->bits >= 32){
+		w->buffer[w->position] = (unsigned char)w->container;
+		w->buffer[w->position + 1] = (unsigned char)(w->container >> 8);
+		w->buffer[w->position + 2] = (unsigned char)(w->container >> 16);
+		w->buffer[w->position + 3] = (unsigned char)(w->container >> 24);
+		w->position += 4;
+		w->container >>= 32;
+		w->bits -= 32;
+	}
+}
+
+/*
+ * bitWriter_finish - writes the remaining bits, padding the last byte with
+ *                    zero bits
+ *
+ * Returns:     number of bytes used in the buffer
+ */
+static inline size_t bitWriter_finish(bitWriter *w){
+	while(w->bits > 0){
+		w->buffer[w->position++] = (unsigned char)w->container;
+		w->container >>= 8;
+		w->bits -= 8;
+	}
+	w->bits = 0;
+	return w->position;
+}
+
+/*
+ * bitReader_init - starts reading bits from a buffer of length bytes
+ */
+static inline void bitReader_init(bitReader *r, const unsigned char *buffer,
+                                  size_t length){
+	r->buffer = buffer;
+	r->length = length;
+	r->position = 0;
+	r->container = 0;
+	r->bits = 0;
+}
+
+/*
+ * bitReader_refill - makes at least 57 bits available to bitReader_peek
+ *
+ * Comments:    Reading past the end of the buffer yields zero bits, use
+ *              bitReader_overrun to detect it.
+ */
+static inline void bitReader_refill(bitReader *r){
+	// Away from the end, load 8 bytes at once and keep the whole bytes
+	if(r->position + 8 <= r->length){
+		r->container |= loadLittleEndian(r->buffer + r->position, 8) <<
+		                r->bits;
+		r->position += (size_t)(63 - r->bits) >> 3;
+		r->bits |= 56;
+		return;
+	}
+	while(r->bits <= 56){
+		if(r->position < r->length){
+			r->container |= (uint64_t)r->buffer[r->position] << r->bits;
+		}
+		r->position++;
+		r->bits += 8;
+	}
+}
+
+/*
+ * bitReader_peek - returns the next length (<= 32) bits without consuming
+ *                  them
+ */
+static inline uint32_t bitReader_peek(const bitReader *r, int length){
+	return (uint32_t)(r->container & ((UINT64_C(1) << length) - 1));
+}
+
+/*
+ * bitReader_consume - skips length bits that have been peeked
+ */
+static inline void bitReader_consume(bitReader *r, int length){
+	r->container >>= length;
+	r->bits -= length;
+}
+
+/*
+ * bitReader_read - reads length (<= 32) bits
+ */
+static inline uint32_t bitReader_read(bitReader *r, int length){
+	uint32_t value;
+
+	if(r->bits < length){
+		bitReader_refill(r);
+	}
+	value = bitReader_peek(r, length);
+	bitReader_consume(r, length);
+	return value;
+}
+
+/*
+ * bitReader_overrun - checks if more bits have been consumed than the
+ *                     buffer holds
+ */
+static inline int bitReader_overrun(const bitReader *r){
+	return r->position * 8 - (size_t)r->bits > r->length * 8;
+}
+
+#endif
@@ -32,15 +32,24 @@ void bitset_free(bitset *b){
 //bitNo should be >= 0
 //If bitNo >= bitset_size(b) the bitset will be extended up to that bit. Bits from bitset_size(b)
 //to bitNo will be set to zero/false.
-void bitset_setBitValue(bitset *b,int bitNo,bool value) {
+void bitset_setBitValue(bitset *b,size_t bitNo,bool value) {
     if(bitNo>=bitset_size(b)) {
         b->length=bitNo+1;
-        while(b->capacity<b->length) {
-            b->array=realloc(b->array,b->capacity/8+1);
-            b->capacity+=8;
+        if(b->capacity<b->length) {
+            //Grow geometrically, one byte per bit made long sets quadratic
+            size_t oldBytes=b->capacity/8;
+            size_t newBytes=oldBytes>0 ? oldBytes : 1;
+            while(newBytes*8<b->length) {
+                newBytes*=2;
+            }
+            b->array=realloc(b->array,newBytes);
+            for(size_t i=oldBytes; i<newBytes; i++) {
+                b->array[i]=0;
+            }
+            b->capacity=newBytes*8;
         }
     }
-    int byteNo=bitNo/8;
+    size_t byteNo=bitNo/8;
     int bit=bitNo%8;
     char theByte=b->array[byteNo];
     if(value) {
@@ -53,8 +62,8 @@ void bitset_setBitValue(bitset *b,int bitNo,bool value) {
 }
 
 //Get the value of bit bitNo in the bitset b. Undefined behaviour for bitNO >= bitset_size(b).
-bool bitset_memberOf(bitset *b,int bitNo) {
-    int byteNo=bitNo/8;
+bool bitset_memberOf(bitset *b,size_t bitNo) {
+    size_t byteNo=bitNo/8;
     int bit=bitNo%8;
     char theByte=b->array[byteNo];
     return ((theByte)&(1<<bit)) > 0;
@@ -66,7 +75,7 @@ bool bitset_memberOf(bitset *b,int bitNo) {
 //Memory is dynamicly allocated for the array. The user is responsible for deallocating the memory.
 char *toByteArray(bitset *b) {
     char *res=calloc(b->capacity/8, sizeof(char));
-    for (int i=0; i<b->capacity/8; i++) {
+    for (size_t i=0; i<b->capacity/8; i++) {
         res[i]=b->array[i];
     }
     return res;
@@ -74,6 +83,6 @@ char *toByteArray(bitset *b) {
 }
 
 //Returns the size of this bitset
-int bitset_size(bitset *b) {
+size_t bitset_size(bitset *b) {
     return b->length;
 }
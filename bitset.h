@@ -9,10 +9,11 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct {
-    int length;
-    int capacity;
+    size_t length;
+    size_t capacity;
     char *array;
 } bitset;
 
@@ -23,10 +24,10 @@ bitset *bitset_empty();
 //bitNo should be >= 0
 //If bitNo >= bitset_size(b) the bitset will be extended up to that bit. Bits from bitset_size(b)
 //to bitNo will be set to zero/false.
-void bitset_setBitValue(bitset *b,int bitNo,bool value);
+void bitset_setBitValue(bitset *b,size_t bitNo,bool value);
 
 //Get the value of bit bitNo in the bitset b. Undefined behaviour for bitNO >= bitset_size(b).
-bool bitset_memberOf(bitset *b,int bitNo);
+bool bitset_memberOf(bitset *b,size_t bitNo);
 
 //Convert this bitset to a byte array.
 //The resulting array will be large enough to contain all bits up to bitset_size(b). if bitset_size is not
@@ -35,7 +36,7 @@ bool bitset_memberOf(bitset *b,int bitNo);
 char *toByteArray(bitset *b);
 
 //Returns the size of this bitset
-int bitset_size(bitset *b);
+size_t bitset_size(bitset *b);
 
 //Deallocate all memory used by a bitset
 void bitset_free(bitset *b);
@@ -0,0 +1,30 @@
+/* The built in model, see builtin.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include "builtin.h"
+#include "builtin_model.h"
+
+/*
+ * The tables are never written through these pointers, they are only
+ * non-const because the structs are shared with tables built at run time.
+ */
+static const codeTable builtinTable = {
+	BUILTIN_SYMBOLS,
+	(unsigned char *)builtinLength,
+	(uint32_t *)builtinCode
+};
+
+static const decodeTable builtinLookup = {
+	BUILTIN_ROOTBITS,
+	(decodeEntry *)builtinEntries
+};
+
+const codeTable *builtin_table(void){
+	return &builtinTable;
+}
+
+const decodeTable *builtin_decodeTable(void){
+	return &builtinLookup;
+}
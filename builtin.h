@@ -0,0 +1,28 @@
+/* The built in model - a global escape table compiled into the program.
+ *
+ * The build runs builtingen over a fixed training file (the CMake variable
+ * HUFFMAN_BUILTIN_TRAINING, frekvens.txt by default) and compiles the
+ * resulting code and decode tables in as const data. The -builtin mode
+ * uses them in place of a frequency file, so nothing has to be read or
+ * computed to get the model, and the tables sit in read only pages that
+ * all processes running the program share.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __BUILTIN_H
+#define __BUILTIN_H
+
+#include "codetable.h"
+
+/*
+ * builtin_table - returns the built in escape table
+ */
+const codeTable *builtin_table(void);
+
+/*
+ * builtin_decodeTable - returns the decode table of the built in table
+ */
+const decodeTable *builtin_decodeTable(void);
+
+#endif
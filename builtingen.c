@@ -0,0 +1,107 @@
+/* Generator of the built in model, run by the build (see CMakeLists.txt).
+ *
+ * Builds the global escape table from a training file exactly like the
+ * -encode mode does for FILE0, together with its decode table, and writes
+ * both as const arrays to a C header that builtin.c compiles in.
+ *
+ * Parameter:   - [FILE1] training file, text or histogram file
+ *              - [FILE2] header to write
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "histogram.h"
+#include "huffmantree.h"
+#include "codetable.h"
+
+static size_t decodeTableSize(const decodeTable *d);
+
+int main(int argc, char **argv){
+	unsigned char lengths[CODETABLE_ESCAPE + 1];
+	histogram *trained;
+	codeTable *table;
+	decodeTable *lookup;
+	size_t entries;
+	FILE *training;
+	FILE *header;
+
+	if(argc != 3){
+		fprintf(stderr, "USAGE:\nbuiltingen TRAININGFILE HEADER\n");
+		return EXIT_FAILURE;
+	}
+	training = fopen(argv[1], "rb");
+	if(training == NULL){
+		fprintf(stderr, "Couldn't open training file %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	trained = histogram_empty();
+	if(histogram_load(trained, training) != 0){
+		fprintf(stderr, "Corrupt histogram file %s\n", argv[1]);
+		fclose(training);
+		return EXIT_FAILURE;
+	}
+	fclose(training);
+
+	getEscapeCodeLengths(trained->count, lengths, CODETABLE_MAXLENGTH);
+	table = codeTable_create(CODETABLE_ESCAPE + 1);
+	codeTable_setLengths(table, lengths);
+	lookup = decodeTable_create(table);
+	entries = decodeTableSize(lookup);
+
+	header = fopen(argv[2], "w");
+	if(header == NULL){
+		fprintf(stderr, "Couldn't open output file %s\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+	fprintf(header, "/* Built in model generated by builtingen from %s,\n"
+	        " * do not edit.\n */\n", argv[1]);
+	fprintf(header, "#define BUILTIN_SYMBOLS %d\n", table->symbols);
+	fprintf(header, "#define BUILTIN_ROOTBITS %d\n", lookup->rootBits);
+	fprintf(header, "#define BUILTIN_ENTRIES %zu\n\n", entries);
+
+	fprintf(header, "static const unsigned char builtinLength[] = {");
+	for(int i = 0; i < table->symbols; i++){
+		fprintf(header, "%s%u,", i % 16 ? " " : "\n\t", table->length[i]);
+	}
+	fprintf(header, "\n};\n\nstatic const uint32_t builtinCode[] = {");
+	for(int i = 0; i < table->symbols; i++){
+		fprintf(header, "%s0x%04x,", i % 8 ? " " : "\n\t",
+		        (unsigned)table->code[i]);
+	}
+	fprintf(header, "\n};\n\nstatic const decodeEntry builtinEntries[] = {");
+	for(size_t i = 0; i < entries; i++){
+		fprintf(header, "%s{%u, %u, %u},", i % 4 ? " " : "\n\t",
+		        (unsigned)lookup->entries[i].symbol,
+		        lookup->entries[i].length, lookup->entries[i].subBits);
+	}
+	fprintf(header, "\n};\n");
+
+	decodeTable_free(lookup);
+	codeTable_free(table);
+	histogram_free(trained);
+	if(fclose(header) != 0){
+		fprintf(stderr, "Couldn't write output file %s\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
+
+/*
+ * decodeTableSize - number of entries of a decode table, the root table
+ *                   plus all sub tables
+ */
+static size_t decodeTableSize(const decodeTable *d){
+	size_t rootSize = (size_t)1 << d->rootBits;
+	size_t size = rootSize;
+
+	for(size_t i = 0; i < rootSize; i++){
+		if(d->entries[i].subBits > 0){
+			size_t end = d->entries[i].symbol +
+			             ((size_t)1 << d->entries[i].subBits);
+			size = end > size ? end : size;
+		}
+	}
+	return size;
+}
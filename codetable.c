@@ -0,0 +1,302 @@
+/* Implementation of the datatypes 'codeTable' and 'decodeTable', see
+ * codetable.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "codetable.h"
+
+#define MAXCODEBITS 32
+
+static uint32_t reverseBits(uint32_t code, int length);
+
+codeTable *codeTable_create(int symbols){
+	codeTable *t = malloc(sizeof(codeTable));
+	t->symbols = symbols;
+	t->length = calloc(symbols, sizeof(unsigned char));
+	t->code = calloc(symbols, sizeof(uint32_t));
+	return t;
+}
+
+/*
+ * codeTable_setLengths - assigns canonical codes from code lengths.
+ *
+ * Codes are handed out in order of increasing length and, within one
+ * length, in order of increasing symbol value (as in RFC 1951). They are
+ * then bit reversed so that the first bit of each code is written first.
+ */
+int codeTable_setLengths(codeTable *t, const unsigned char *lengths){
+	uint64_t lengthCount[MAXCODEBITS + 1] = { 0 };
+	uint64_t nextCode[MAXCODEBITS + 1];
+	uint64_t code = 0;
+	uint64_t kraft = 0;
+
+	for(int i = 0; i < t->symbols; i++){
+		if(lengths[i] > MAXCODEBITS){
+			return -1;
+		}
+		lengthCount[lengths[i]]++;
+	}
+	lengthCount[0] = 0;
+
+	// Sum of 2^-length must not exceed 1, scaled by 2^MAXCODEBITS
+	for(int len = 1; len <= MAXCODEBITS; len++){
+		kraft += lengthCount[len] << (MAXCODEBITS - len);
+	}
+	if(kraft > (UINT64_C(1) << MAXCODEBITS)){
+		return -1;
+	}
+
+	for(int len = 1; len <= MAXCODEBITS; len++){
+		code = (code + lengthCount[len - 1]) << 1;
+		nextCode[len] = code;
+	}
+	for(int i = 0; i < t->symbols; i++){
+		t->length[i] = lengths[i];
+		if(lengths[i] == 0){
+			t->code[i] = 0;
+		} else {
+			t->code[i] = reverseBits((uint32_t)nextCode[lengths[i]]++,
+			                         lengths[i]);
+		}
+	}
+	return 0;
+}
+
+uint64_t codeTable_cost(const codeTable *t, const uint64_t *frequency){
+	uint64_t bits = 0;
+	for(int i = 0; i < t->symbols; i++){
+		if(frequency[i] == 0){
+			continue;
+		}
+		if(t->length[i] == 0){
+			return UINT64_MAX;
+		}
+		bits += frequency[i] * t->length[i];
+	}
+	return bits;
+}
+
+uint64_t codeTable_byteCost(const codeTable *t, const uint64_t *frequency){
+	uint64_t bits = 0;
+	int escape = t->symbols > CODETABLE_ESCAPE ?
+	             t->length[CODETABLE_ESCAPE] : 0;
+
+	for(int i = 0; i < CODETABLE_ESCAPE; i++){
+		if(frequency[i] == 0){
+			continue;
+		}
+		if(t->length[i] > 0){
+			bits += frequency[i] * t->length[i];
+		} else if(escape > 0){
+			bits += frequency[i] * (escape + CODETABLE_LITERALBITS);
+		} else {
+			return UINT64_MAX;
+		}
+	}
+	return bits;
+}
+
+void codeTable_scoreTables(const codeTable *const *tables, int count,
+                           const uint64_t *frequency, uint64_t *bits){
+	for(int k = 0; k < count; k++){
+		bits[k] = 0;
+	}
+	for(int i = 0; i < CODETABLE_ESCAPE; i++){
+		if(frequency[i] == 0){
+			continue;
+		}
+		for(int k = 0; k < count; k++){
+			const codeTable *t = tables[k];
+			int escape = t->symbols > CODETABLE_ESCAPE ?
+			             t->length[CODETABLE_ESCAPE] : 0;
+
+			if(bits[k] == UINT64_MAX){
+				continue;
+			}
+			if(t->length[i] > 0){
+				bits[k] += frequency[i] * t->length[i];
+			} else if(escape > 0){
+				bits[k] += frequency[i] * (escape + CODETABLE_LITERALBITS);
+			} else {
+				bits[k] = UINT64_MAX;
+			}
+		}
+	}
+}
+
+size_t codeTable_serializedSize(const codeTable *t){
+	size_t present = 0;
+	for(int i = 0; i < t->symbols; i++){
+		if(t->length[i] > 0){
+			present++;
+		}
+	}
+	return (size_t)(t->symbols + 7) / 8 + (present + 1) / 2;
+}
+
+size_t codeTable_serialize(const codeTable *t, unsigned char *buffer){
+	size_t bitmapBytes = (size_t)(t->symbols + 7) / 8;
+	size_t nibble = 0;
+
+	memset(buffer, 0, codeTable_serializedSize(t));
+	for(int i = 0; i < t->symbols; i++){
+		if(t->length[i] > 0){
+			buffer[i / 8] |= 1 << (i % 8);
+			buffer[bitmapBytes + nibble / 2] |=
+			        (t->length[i] & 0x0f) << (4 * (nibble % 2));
+			nibble++;
+		}
+	}
+	return bitmapBytes + (nibble + 1) / 2;
+}
+
+uint32_t codeTable_fingerprint(const codeTable *t){
+	uint32_t hash = UINT32_C(2166136261);
+
+	for(int shift = 0; shift < 32; shift += 8){
+		hash = (hash ^ (((uint32_t)t->symbols >> shift) & 0xff)) *
+		       UINT32_C(16777619);
+	}
+	for(int i = 0; i < t->symbols; i++){
+		hash = (hash ^ t->length[i]) * UINT32_C(16777619);
+	}
+	return hash;
+}
+
+long codeTable_deserialize(codeTable *t, const unsigned char *buffer,
+                           size_t length){
+	size_t bitmapBytes = (size_t)(t->symbols + 7) / 8;
+	size_t nibble = 0;
+	unsigned char *lengths;
+
+	if(length < bitmapBytes){
+		return -1;
+	}
+	lengths = calloc(t->symbols, sizeof(unsigned char));
+	for(int i = 0; i < t->symbols; i++){
+		if(buffer[i / 8] & (1 << (i % 8))){
+			if(bitmapBytes + nibble / 2 >= length){
+				free(lengths);
+				return -1;
+			}
+			lengths[i] = (buffer[bitmapBytes + nibble / 2] >>
+			              (4 * (nibble % 2))) & 0x0f;
+			nibble++;
+			if(lengths[i] == 0){
+				free(lengths);
+				return -1;
+			}
+		}
+	}
+	if(codeTable_setLengths(t, lengths) != 0){
+		free(lengths);
+		return -1;
+	}
+	free(lengths);
+	return (long)(bitmapBytes + (nibble + 1) / 2);
+}
+
+void codeTable_free(codeTable *t){
+	free(t->length);
+	free(t->code);
+	free(t);
+}
+
+/*
+ * decodeTable_create - builds the two level lookup table.
+ *
+ * Codes not longer than the root width fill every root entry whose low bits
+ * equal the code. Longer codes are grouped by their first rootBits bits;
+ * each group gets a sub table wide enough for its longest code, linked
+ * from the root entry of the group.
+ */
+decodeTable *decodeTable_create(const codeTable *t){
+	decodeTable *d = malloc(sizeof(decodeTable));
+	unsigned char *subMax;
+	size_t rootSize;
+	size_t size;
+	int maxLength = 0;
+
+	for(int i = 0; i < t->symbols; i++){
+		if(t->length[i] > maxLength){
+			maxLength = t->length[i];
+		}
+	}
+	d->rootBits = maxLength < DECODETABLE_ROOTBITS ? maxLength :
+	              DECODETABLE_ROOTBITS;
+	if(d->rootBits == 0){
+		d->rootBits = 1;
+	}
+	rootSize = (size_t)1 << d->rootBits;
+
+	// Find the longest code behind every root prefix
+	subMax = calloc(rootSize, sizeof(unsigned char));
+	for(int i = 0; i < t->symbols; i++){
+		if(t->length[i] > d->rootBits){
+			uint32_t prefix = t->code[i] & (uint32_t)(rootSize - 1);
+			if(t->length[i] > subMax[prefix]){
+				subMax[prefix] = t->length[i];
+			}
+		}
+	}
+	size = rootSize;
+	for(size_t prefix = 0; prefix < rootSize; prefix++){
+		if(subMax[prefix] > 0){
+			size += (size_t)1 << (subMax[prefix] - d->rootBits);
+		}
+	}
+	d->entries = calloc(size, sizeof(decodeEntry));
+
+	// Link the sub tables
+	size = rootSize;
+	for(size_t prefix = 0; prefix < rootSize; prefix++){
+		if(subMax[prefix] > 0){
+			d->entries[prefix].symbol = (uint32_t)size;
+			d->entries[prefix].subBits = subMax[prefix] - d->rootBits;
+			size += (size_t)1 << (subMax[prefix] - d->rootBits);
+		}
+	}
+	free(subMax);
+
+	// Fill in the symbols
+	for(int i = 0; i < t->symbols; i++){
+		int length = t->length[i];
+		if(length == 0){
+			continue;
+		}
+		if(length <= d->rootBits){
+			for(size_t j = t->code[i]; j < rootSize; j += (size_t)1 << length){
+				d->entries[j].symbol = (uint32_t)i;
+				d->entries[j].length = (unsigned char)length;
+			}
+		} else {
+			decodeEntry *link = &d->entries[t->code[i] & (rootSize - 1)];
+			size_t subSize = (size_t)1 << link->subBits;
+			for(size_t j = t->code[i] >> d->rootBits; j < subSize;
+			    j += (size_t)1 << (length - d->rootBits)){
+				d->entries[link->symbol + j].symbol = (uint32_t)i;
+				d->entries[link->symbol + j].length = (unsigned char)length;
+			}
+		}
+	}
+	return d;
+}
+
+void decodeTable_free(decodeTable *d){
+	free(d->entries);
+	free(d);
+}
+
+/*
+ * reverseBits - reverses the order of the lowest length bits of code
+ */
+static uint32_t reverseBits(uint32_t code, int length){
+	uint32_t reversed = 0;
+	for(int i = 0; i < length; i++){
+		reversed = (reversed << 1) | ((code >> i) & 1);
+	}
+	return reversed;
+}
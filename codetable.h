@@ -0,0 +1,196 @@
+/* Datatypes 'codeTable' and 'decodeTable' - table driven Huffman coding.
+ *
+ * A codeTable holds the code length and the code bits of every symbol of an
+ * alphabet. Codes are canonical: they are fully determined by the code
+ * lengths, so a table is stored or transmitted as its lengths only. The
+ * code bits are kept in stream order, i.e. the first bit of a code is its
+ * least significant bit (see bitio.h).
+ *
+ * A decodeTable is a two level lookup table built from a codeTable: the
+ * first rootBits bits of the stream index the root table, which either
+ * gives the symbol directly or links to a sub table for longer codes.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __CODETABLE_H
+#define __CODETABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "bitio.h"
+
+// Longest code that can be stored in a serialized table
+#define CODETABLE_MAXLENGTH 15
+
+/*
+ * Escape tables have a code for symbol CODETABLE_ESCAPE after the 256
+ * bytes. Bytes without a code of their own are coded as the escape code
+ * followed by the byte as a CODETABLE_LITERALBITS bit literal.
+ */
+#define CODETABLE_ESCAPE 256
+#define CODETABLE_LITERALBITS 8
+
+// Number of bits resolved by the root level of a decode table
+#define DECODETABLE_ROOTBITS 11
+
+typedef struct {
+    int symbols;
+    unsigned char *length;
+    uint32_t *code;
+} codeTable;
+
+typedef struct {
+    uint32_t symbol;
+    unsigned char length;
+    unsigned char subBits;
+} decodeEntry;
+
+typedef struct {
+    int rootBits;
+    decodeEntry *entries;
+} decodeTable;
+
+/*
+ * codeTable_create - creates a table for an alphabet where no symbol has
+ *                    a code yet
+ *
+ * Parameter:   symbols - size of the alphabet
+ */
+codeTable *codeTable_create(int symbols);
+
+/*
+ * codeTable_setLengths - assigns canonical codes from code lengths
+ *
+ * Parameter:   t       - the table
+ *              lengths - code length of every symbol, 0 for no code
+ *
+ * Returns:     0 on success, -1 if the lengths do not form a prefix code
+ *              or exceed 32 bits.
+ */
+int codeTable_setLengths(codeTable *t, const unsigned char *lengths);
+
+/*
+ * codeTable_cost - computes the exact number of bits needed to code data
+ *                  with the table
+ *
+ * Parameter:   t           - the table
+ *              frequency   - count of every symbol in the data
+ *
+ * Returns:     the sum of count * code length over all symbols, UINT64_MAX
+ *              if a symbol with a count above zero has no code
+ */
+uint64_t codeTable_cost(const codeTable *t, const uint64_t *frequency);
+
+/*
+ * codeTable_byteCost - computes the exact number of bits needed to code
+ *                      bytes with a byte table or an escape table
+ *
+ * Parameter:   t           - table with 256 symbols, or 257 for an escape
+ *                            table
+ *              frequency   - count of every byte in the data
+ *
+ * Returns:     the sum of count * code length over all bytes, where bytes
+ *              without a code count as escape code plus literal. UINT64_MAX
+ *              if a byte has no code and the table no escape code.
+ */
+uint64_t codeTable_byteCost(const codeTable *t, const uint64_t *frequency);
+
+/*
+ * codeTable_scoreTables - computes codeTable_byteCost of several tables
+ *                         in one pass over a histogram
+ *
+ * Parameter:   tables      - the tables, byte or escape tables
+ *              count       - number of tables
+ *              frequency   - count of every byte in the data
+ *              bits        - array of count that receives the cost of
+ *                            every table, UINT64_MAX for tables that can't
+ *                            code the data
+ *
+ * Comments:    Meant for choosing a model: scoring a candidate costs a
+ *              look at its code lengths instead of coding the data.
+ */
+void codeTable_scoreTables(const codeTable *const *tables, int count,
+                           const uint64_t *frequency, uint64_t *bits);
+
+/*
+ * codeTable_serializedSize - number of bytes codeTable_serialize will use
+ */
+size_t codeTable_serializedSize(const codeTable *t);
+
+/*
+ * codeTable_serialize - stores the code lengths of the table
+ *
+ * The format is a bitmap with one bit per symbol telling which symbols
+ * have a code, followed by the 4-bit code lengths of those symbols. Only
+ * tables with codes of at most CODETABLE_MAXLENGTH bits can be stored.
+ *
+ * Returns:     number of bytes written to buffer
+ */
+size_t codeTable_serialize(const codeTable *t, unsigned char *buffer);
+
+/*
+ * codeTable_fingerprint - a 32 bit hash (FNV-1a) of the alphabet size and
+ *                         the code lengths of the table
+ *
+ * Comments:    Tables with the same fingerprint code the same way, with
+ *              overwhelming probability, so a decoder can check that it
+ *              was given the table the encoder used.
+ */
+uint32_t codeTable_fingerprint(const codeTable *t);
+
+/*
+ * codeTable_deserialize - restores a table stored with codeTable_serialize
+ *
+ * Parameter:   t       - table of the same alphabet size as the stored one
+ *              buffer  - the stored table
+ *              length  - number of bytes available in buffer
+ *
+ * Returns:     number of bytes consumed, -1 if the data is not a valid table
+ */
+long codeTable_deserialize(codeTable *t, const unsigned char *buffer,
+                           size_t length);
+
+/*
+ * codeTable_free - deallocates the table
+ */
+void codeTable_free(codeTable *t);
+
+/*
+ * decodeTable_create - builds the lookup table for decoding codes of t
+ *
+ * Comments:    Works for any prefix code of at most 32 bits, canonical or
+ *              not.
+ */
+decodeTable *decodeTable_create(const codeTable *t);
+
+/*
+ * decodeTable_free - deallocates the lookup table
+ */
+void decodeTable_free(decodeTable *d);
+
+/*
+ * decodeTable_decode - decodes one symbol
+ *
+ * Parameter:   d   - the lookup table
+ *              r   - the bit reader, refilled with at least as many bits as
+ *                    the longest code
+ *
+ * Returns:     the symbol, -1 if the bits are not a valid code
+ */
+static inline int32_t decodeTable_decode(const decodeTable *d, bitReader *r){
+	const decodeEntry *e = &d->entries[bitReader_peek(r, d->rootBits)];
+
+	if(e->subBits){
+		e = &d->entries[e->symbol +
+		                (bitReader_peek(r, d->rootBits + e->subBits) >>
+		                 d->rootBits)];
+	}
+	if(e->length == 0){
+		return -1;
+	}
+	bitReader_consume(r, e->length);
+	return (int32_t)e->symbol;
+}
+
+#endif
@@ -0,0 +1,847 @@
+/* Implementation of the compression daemon, see daemon.h.
+ *
+ * The event loop owns every connection except while its request is being
+ * coded. Connections are registered with EPOLLONESHOT, so a connection
+ * that has been handed to a worker gets no events until the loop takes it
+ * back and arms it again; workers hand finished connections back through
+ * a list and wake the loop with an eventfd. A connection reads exactly
+ * one request at a time, further requests wait in the socket until the
+ * response of the current one is written.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "daemon.h"
+#include "bitio.h"
+
+#ifdef HUFFMAN_DAEMON
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#endif
+
+// Most events handled per wait of the event loop
+#define DAEMON_EVENTS 64
+
+// Most connections waiting to be accepted
+#define DAEMON_BACKLOG 128
+
+/*
+ * Struct 'benchClient'
+ * State of one connection of daemon_benchmark
+ *
+ *      path        - name of the socket
+ *      op          - operation of every request
+ *      input       - payload of every request
+ *      length      - size of the payload
+ *      requests    - number of requests sent in all
+ *      next        - number of the next request, shared by all clients
+ *      latency     - receives the latency of every request, shared
+ *      failed      - requests of this client that failed
+ *      bytesOut    - payload bytes this client received
+ */
+typedef struct {
+    const char *path;
+    int op;
+    const unsigned char *input;
+    size_t length;
+    uint64_t requests;
+    uint64_t *next;
+    double *latency;
+    uint64_t failed;
+    uint64_t bytesOut;
+} benchClient;
+
+static bool sendMessage(int socket, const unsigned char *header,
+                        const unsigned char *payload, size_t length);
+static bool receiveAll(int socket, unsigned char *buffer, size_t length);
+static void *benchMain(void *argument);
+static int compareLatency(const void *a, const void *b);
+
+int daemon_connect(const char *path){
+	struct sockaddr_un address;
+	int fd;
+
+	if(strlen(path) >= sizeof(address.sun_path)){
+		return -1;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd < 0){
+		return -1;
+	}
+	if(connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void daemon_disconnect(int socket){
+	close(socket);
+}
+
+int daemon_call(int socket, int op, const unsigned char *input,
+                size_t length, daemonReply *reply){
+	unsigned char header[DAEMON_HEADERSIZE];
+	size_t replyLength;
+
+	if(length > DAEMON_MAXPAYLOAD){
+		return -1;
+	}
+	header[0] = (unsigned char)op;
+	storeLittleEndian(header + 1, length, 4);
+	if(!sendMessage(socket, header, input, length) ||
+	   !receiveAll(socket, header, DAEMON_HEADERSIZE)){
+		return -1;
+	}
+	replyLength = (size_t)loadLittleEndian(header + 1, 4);
+	if((header[0] != DAEMON_OK && header[0] != DAEMON_FAILED) ||
+	   replyLength > DAEMON_MAXPAYLOAD){
+		return -1;
+	}
+	if(replyLength > reply->capacity){
+		unsigned char *grown = realloc(reply->data, replyLength);
+		if(grown == NULL){
+			return -1;
+		}
+		reply->data = grown;
+		reply->capacity = replyLength;
+	}
+	if(!receiveAll(socket, reply->data, replyLength)){
+		return -1;
+	}
+	reply->length = replyLength;
+	return header[0];
+}
+
+int daemon_benchmark(const char *path, int op, const unsigned char *input,
+                     size_t length, int clients, uint64_t requests,
+                     daemonBenchStats *stats){
+	benchClient *client = calloc((size_t)clients, sizeof(*client));
+	pthread_t *ids = malloc((size_t)clients * sizeof(*ids));
+	double *latency = malloc((requests > 0 ? requests : 1) *
+	                         sizeof(*latency));
+	uint64_t next = 0;
+	uint64_t answered = 0;
+	struct timespec start, end;
+
+	*stats = (daemonBenchStats){ 0, 0, 0, 0, 0, 0, 0, 0 };
+	for(uint64_t i = 0; i < requests; i++){
+		latency[i] = -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i < clients; i++){
+		client[i] = (benchClient){ path, op, input, length, requests, &next,
+		                           latency, 0, 0 };
+		if(i > 0 && pthread_create(&ids[i], NULL, benchMain,
+		                           &client[i]) != 0){
+			client[i].path = NULL;
+		}
+	}
+
+	// The calling thread is the first client
+	benchMain(&client[0]);
+	for(int i = 0; i < clients; i++){
+		if(i > 0 && client[i].path != NULL){
+			pthread_join(ids[i], NULL);
+		}
+		stats->failed += client[i].failed;
+		stats->bytesOut += client[i].bytesOut;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	stats->seconds = (double)(end.tv_sec - start.tv_sec) +
+	                 (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+	// Requests never sent (no connection) keep a negative latency
+	for(uint64_t i = 0; i < requests; i++){
+		if(latency[i] >= 0){
+			latency[answered++] = latency[i];
+		}
+	}
+	stats->requests = answered;
+	stats->bytesIn = answered * (uint64_t)length;
+	if(answered > 0){
+		qsort(latency, answered, sizeof(*latency), compareLatency);
+		stats->median = latency[answered / 2];
+		stats->p99 = latency[answered * 99 / 100 < answered ?
+		                     answered * 99 / 100 : answered - 1];
+		stats->slowest = latency[answered - 1];
+	}
+	free(latency);
+	free(ids);
+	free(client);
+	return answered == requests && stats->failed == 0 ? 0 : -1;
+}
+
+/*
+ * benchMain - sends requests of a benchmark until all have been sent
+ *
+ * Parameter:   argument    - the benchClient of the thread
+ */
+static void *benchMain(void *argument){
+	benchClient *client = argument;
+	daemonReply reply = { NULL, 0, 0 };
+	int fd = daemon_connect(client->path);
+
+	while(fd >= 0){
+		struct timespec start, end;
+		uint64_t index = __atomic_fetch_add(client->next, 1,
+		                                    __ATOMIC_RELAXED);
+		int status;
+
+		if(index >= client->requests){
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		status = daemon_call(fd, client->op, client->input, client->length,
+		                     &reply);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if(status < 0){
+			client->failed++;
+			break;
+		}
+		if(status != DAEMON_OK){
+			client->failed++;
+		}
+		client->bytesOut += reply.length;
+		client->latency[index] = (double)(end.tv_sec - start.tv_sec) * 1e6 +
+		                         (double)(end.tv_nsec - start.tv_nsec) / 1e3;
+	}
+	if(fd >= 0){
+		close(fd);
+	}
+	free(reply.data);
+	return NULL;
+}
+
+/*
+ * compareLatency - orders latencies from lowest to highest for qsort
+ */
+static int compareLatency(const void *a, const void *b){
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * sendMessage - sends a header and its payload with as few system calls
+ *               as the socket allows
+ *
+ * Returns:     true if everything was sent
+ */
+static bool sendMessage(int socket, const unsigned char *header,
+                        const unsigned char *payload, size_t length){
+	struct iovec part[2] = {
+		{ (void *)header, DAEMON_HEADERSIZE },
+		{ (void *)payload, length }
+	};
+	struct msghdr message;
+	size_t left = DAEMON_HEADERSIZE + length;
+
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = part;
+	message.msg_iovlen = 2;
+	while(left > 0){
+		ssize_t sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+		if(sent < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			return false;
+		}
+		left -= (size_t)sent;
+
+		// Skip what was sent
+		while(sent > 0){
+			struct iovec *first = message.msg_iov;
+			if((size_t)sent >= first->iov_len){
+				sent -= (ssize_t)first->iov_len;
+				message.msg_iov++;
+				message.msg_iovlen--;
+			} else {
+				first->iov_base = (char *)first->iov_base + sent;
+				first->iov_len -= (size_t)sent;
+				sent = 0;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * receiveAll - reads length bytes from a blocking socket
+ *
+ * Returns:     true if all of them arrived
+ */
+static bool receiveAll(int socket, unsigned char *buffer, size_t length){
+	while(length > 0){
+		ssize_t got = recv(socket, buffer, length, 0);
+		if(got < 0 && errno == EINTR){
+			continue;
+		}
+		if(got <= 0){
+			return false;
+		}
+		buffer += got;
+		length -= (size_t)got;
+	}
+	return true;
+}
+
+#ifdef HUFFMAN_DAEMON
+
+/*
+ * Struct 'daemonConnection'
+ * A client of the daemon
+ *
+ *      fd              - the socket
+ *      header          - header of the request being read
+ *      received        - bytes of the request (header and payload) read
+ *      request         - payload of the request, NULL until its header
+ *                        has been read
+ *      requestLength   - size of the payload
+ *      response        - header and payload of the response, NULL until
+ *                        the request has been coded
+ *      responseLength  - size of the response
+ *      sent            - bytes of the response written
+ *      next            - next connection in the job or done list
+ *      previousOpen    - neighbours in the list of open connections
+ *      nextOpen
+ */
+typedef struct daemonConnection daemonConnection;
+struct daemonConnection {
+    int fd;
+    unsigned char header[DAEMON_HEADERSIZE];
+    size_t received;
+    unsigned char *request;
+    size_t requestLength;
+    unsigned char *response;
+    size_t responseLength;
+    size_t sent;
+    daemonConnection *next;
+    daemonConnection *previousOpen;
+    daemonConnection *nextOpen;
+};
+
+/*
+ * Struct 'daemonServer'
+ * State shared by the event loop and the workers
+ *
+ *      options     - settings of the daemon
+ *      models      - the models, published anew on SIGHUP
+ *      poll        - the epoll instance
+ *      listener    - the listening socket
+ *      wakeup      - eventfd the workers signal finished jobs on
+ *      signals     - signalfd of SIGHUP, SIGINT and SIGTERM
+ *      open        - every connection
+ *      lock        - protects jobs, lastJob, done and stopping
+ *      ready       - signalled when a job is queued or the daemon stops
+ *      jobs        - requests waiting for a worker, oldest first
+ *      lastJob     - end of jobs
+ *      done        - coded requests waiting for the event loop
+ *      stopping    - the workers are to quit once jobs is empty
+ */
+typedef struct {
+    const daemonOptions *options;
+    sharedRegistry *models;
+    int poll;
+    int listener;
+    int wakeup;
+    int signals;
+    daemonConnection *open;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    daemonConnection *jobs;
+    daemonConnection *lastJob;
+    daemonConnection *done;
+    bool stopping;
+} daemonServer;
+
+static int openListener(const char *path);
+static bool watch(daemonServer *server, int fd, void *source,
+                  uint32_t events, bool add);
+static void acceptClients(daemonServer *server);
+static void closeConnection(daemonServer *server, daemonConnection *c);
+static bool readRequest(daemonServer *server, daemonConnection *c);
+static bool writeResponse(daemonServer *server, daemonConnection *c);
+static void finishJobs(daemonServer *server);
+static bool handleSignal(daemonServer *server);
+static void *workerMain(void *argument);
+static void codeRequest(daemonServer *server, daemonConnection *c);
+
+int daemon_run(const char *path, modelRegistry *models,
+               const daemonOptions *options){
+	daemonServer server;
+	struct epoll_event event[DAEMON_EVENTS];
+	sigset_t handled, previous;
+	pthread_t *ids;
+	int workers = 0;
+	bool running = true;
+
+	memset(&server, 0, sizeof(server));
+	server.options = options;
+	server.listener = openListener(path);
+	if(server.listener < 0){
+		registry_free(models);
+		return -1;
+	}
+
+	// Workers inherit the blocked signals, only the loop receives them
+	sigemptyset(&handled);
+	sigaddset(&handled, SIGHUP);
+	sigaddset(&handled, SIGINT);
+	sigaddset(&handled, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &handled, &previous);
+	server.signals = signalfd(-1, &handled, SFD_NONBLOCK | SFD_CLOEXEC);
+	server.wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	server.poll = epoll_create1(EPOLL_CLOEXEC);
+	if(server.signals < 0 || server.wakeup < 0 || server.poll < 0 ||
+	   !watch(&server, server.listener, &server.listener, EPOLLIN, true) ||
+	   !watch(&server, server.wakeup, &server.wakeup, EPOLLIN, true) ||
+	   !watch(&server, server.signals, &server.signals, EPOLLIN, true)){
+		running = false;
+	}
+
+	server.models = registry_share(models);
+	pthread_mutex_init(&server.lock, NULL);
+	pthread_cond_init(&server.ready, NULL);
+	ids = malloc((size_t)options->threads * sizeof(*ids));
+	while(running && workers < options->threads &&
+	      pthread_create(&ids[workers], NULL, workerMain, &server) == 0){
+		workers++;
+	}
+	running = running && workers > 0;
+
+	while(running){
+		int events = epoll_wait(server.poll, event, DAEMON_EVENTS, -1);
+		if(events < 0 && errno != EINTR){
+			break;
+		}
+		for(int i = 0; i < events; i++){
+			void *source = event[i].data.ptr;
+			if(source == &server.listener){
+				acceptClients(&server);
+			} else if(source == &server.wakeup){
+				finishJobs(&server);
+			} else if(source == &server.signals){
+				running = handleSignal(&server);
+			} else {
+				daemonConnection *c = source;
+				bool alive = c->response != NULL ?
+				             writeResponse(&server, c) :
+				             readRequest(&server, c);
+				if(!alive){
+					closeConnection(&server, c);
+				}
+			}
+		}
+	}
+
+	// Let the workers finish the requests they have, then shut down
+	pthread_mutex_lock(&server.lock);
+	server.stopping = true;
+	pthread_cond_broadcast(&server.ready);
+	pthread_mutex_unlock(&server.lock);
+	for(int i = 0; i < workers; i++){
+		pthread_join(ids[i], NULL);
+	}
+	finishJobs(&server);
+	while(server.open != NULL){
+		closeConnection(&server, server.open);
+	}
+	free(ids);
+	pthread_cond_destroy(&server.ready);
+	pthread_mutex_destroy(&server.lock);
+	registry_unshare(server.models);
+	close(server.listener);
+	unlink(path);
+	if(server.poll >= 0){
+		close(server.poll);
+	}
+	if(server.wakeup >= 0){
+		close(server.wakeup);
+	}
+	if(server.signals >= 0){
+		close(server.signals);
+	}
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+	return workers > 0 ? 0 : -1;
+}
+
+/*
+ * openListener - creates the listening socket
+ *
+ * Parameter:   path    - name of the socket
+ *
+ * Returns:     the socket, -1 if it couldn't be created, path names
+ *              something that is not a socket or another daemon is
+ *              listening on it
+ */
+static int openListener(const char *path){
+	struct sockaddr_un address;
+	struct stat info;
+	int fd = -1;
+
+	if(strlen(path) >= sizeof(address.sun_path)){
+		return -1;
+	}
+	if(lstat(path, &info) == 0){
+		// Only sockets left behind by a daemon that is gone are replaced
+		if(!S_ISSOCK(info.st_mode) || (fd = daemon_connect(path)) >= 0){
+			if(fd >= 0){
+				close(fd);
+			}
+			return -1;
+		}
+		unlink(path);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(fd < 0){
+		return -1;
+	}
+	if(bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+	   listen(fd, DAEMON_BACKLOG) != 0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * watch - registers a file descriptor with the event loop, or changes the
+ *         events it waits for
+ *
+ * Parameter:   server  - the daemon
+ *              fd      - the file descriptor
+ *              source  - what the events are handed to the loop as
+ *              events  - EPOLLIN or EPOLLOUT
+ *              add     - true to register fd, false to change it
+ *
+ * Returns:     true on success
+ */
+static bool watch(daemonServer *server, int fd, void *source,
+                  uint32_t events, bool add){
+	struct epoll_event event;
+
+	// Connections are armed for one event at a time, see the top
+	if(source != &server->listener && source != &server->wakeup &&
+	   source != &server->signals){
+		events |= EPOLLONESHOT;
+	}
+	event.events = events;
+	event.data.ptr = source;
+	return epoll_ctl(server->poll, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd,
+	                 &event) == 0;
+}
+
+/*
+ * acceptClients - accepts every connection that is waiting
+ */
+static void acceptClients(daemonServer *server){
+	for(;;){
+		daemonConnection *c;
+		int fd = accept4(server->listener, NULL, NULL,
+		                 SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(fd < 0){
+			return;
+		}
+		c = calloc(1, sizeof(daemonConnection));
+		c->fd = fd;
+		if(!watch(server, fd, c, EPOLLIN, true)){
+			close(fd);
+			free(c);
+			continue;
+		}
+		c->nextOpen = server->open;
+		if(server->open != NULL){
+			server->open->previousOpen = c;
+		}
+		server->open = c;
+	}
+}
+
+/*
+ * closeConnection - closes a connection that no worker is coding for
+ */
+static void closeConnection(daemonServer *server, daemonConnection *c){
+	if(c->previousOpen != NULL){
+		c->previousOpen->nextOpen = c->nextOpen;
+	} else {
+		server->open = c->nextOpen;
+	}
+	if(c->nextOpen != NULL){
+		c->nextOpen->previousOpen = c->previousOpen;
+	}
+	close(c->fd);
+	free(c->request);
+	free(c->response);
+	free(c);
+}
+
+/*
+ * readRequest - reads what has arrived of a request and queues it for the
+ *               workers once it is complete
+ *
+ * Returns:     false if the connection is to be closed: the client hung
+ *              up or sent a malformed header
+ */
+static bool readRequest(daemonServer *server, daemonConnection *c){
+	for(;;){
+		unsigned char *target;
+		size_t wanted;
+		ssize_t got;
+
+		if(c->received < DAEMON_HEADERSIZE){
+			target = c->header + c->received;
+			wanted = DAEMON_HEADERSIZE - c->received;
+		} else {
+			target = c->request + (c->received - DAEMON_HEADERSIZE);
+			wanted = DAEMON_HEADERSIZE + c->requestLength - c->received;
+		}
+		if(wanted > 0){
+			got = recv(c->fd, target, wanted, 0);
+			if(got < 0 && errno == EINTR){
+				continue;
+			}
+			if(got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+				return watch(server, c->fd, c, EPOLLIN, false);
+			}
+			if(got <= 0){
+				return false;
+			}
+			c->received += (size_t)got;
+		}
+
+		if(c->received == DAEMON_HEADERSIZE && c->request == NULL){
+			c->requestLength = (size_t)loadLittleEndian(c->header + 1, 4);
+			if((c->header[0] != DAEMON_ENCODE &&
+			    c->header[0] != DAEMON_DECODE) ||
+			   c->requestLength > DAEMON_MAXPAYLOAD){
+				return false;
+			}
+			c->request = malloc(c->requestLength > 0 ? c->requestLength : 1);
+			if(c->request == NULL){
+				return false;
+			}
+		}
+		if(c->request != NULL &&
+		   c->received == DAEMON_HEADERSIZE + c->requestLength){
+			break;
+		}
+	}
+
+	// Not armed again until the response is written
+	c->next = NULL;
+	pthread_mutex_lock(&server->lock);
+	if(server->lastJob != NULL){
+		server->lastJob->next = c;
+	} else {
+		server->jobs = c;
+	}
+	server->lastJob = c;
+	pthread_cond_signal(&server->ready);
+	pthread_mutex_unlock(&server->lock);
+	return true;
+}
+
+/*
+ * writeResponse - writes what the socket takes of a response, and starts
+ *                 on the next request once all of it is written
+ *
+ * Returns:     false if the connection is to be closed
+ */
+static bool writeResponse(daemonServer *server, daemonConnection *c){
+	while(c->sent < c->responseLength){
+		ssize_t sent = send(c->fd, c->response + c->sent,
+		                    c->responseLength - c->sent, MSG_NOSIGNAL);
+		if(sent < 0 && errno == EINTR){
+			continue;
+		}
+		if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+			return watch(server, c->fd, c, EPOLLOUT, false);
+		}
+		if(sent < 0){
+			return false;
+		}
+		c->sent += (size_t)sent;
+	}
+	free(c->response);
+	c->response = NULL;
+	c->received = 0;
+
+	// A client that doesn't wait for the response has its next one queued
+	return readRequest(server, c);
+}
+
+/*
+ * finishJobs - writes the responses of the requests the workers have
+ *              coded
+ */
+static void finishJobs(daemonServer *server){
+	daemonConnection *done;
+	eventfd_t count;
+
+	eventfd_read(server->wakeup, &count);
+	pthread_mutex_lock(&server->lock);
+	done = server->done;
+	server->done = NULL;
+	pthread_mutex_unlock(&server->lock);
+	while(done != NULL){
+		daemonConnection *c = done;
+		done = c->next;
+		c->sent = 0;
+		if(server->stopping || c->response == NULL ||
+		   !writeResponse(server, c)){
+			closeConnection(server, c);
+		}
+	}
+}
+
+/*
+ * handleSignal - reloads the models on SIGHUP
+ *
+ * Returns:     false if the daemon is to stop
+ */
+static bool handleSignal(daemonServer *server){
+	struct signalfd_siginfo info;
+	const daemonOptions *options = server->options;
+
+	while(read(server->signals, &info, sizeof(info)) == sizeof(info)){
+		if(info.ssi_signo != SIGHUP){
+			return false;
+		}
+		modelRegistry *models = options->reload != NULL ?
+		                        options->reload(options->context) : NULL;
+		if(models == NULL){
+			fprintf(stderr, "Couldn't load the models again, keeping the "
+			        "old ones\n");
+			continue;
+		}
+		registry_publish(server->models, models);
+		fprintf(stderr, "Models loaded again\n");
+	}
+	return true;
+}
+
+/*
+ * workerMain - codes queued requests until the daemon stops
+ *
+ * Parameter:   argument    - the daemonServer
+ */
+static void *workerMain(void *argument){
+	daemonServer *server = argument;
+
+	for(;;){
+		daemonConnection *c;
+
+		pthread_mutex_lock(&server->lock);
+		while(server->jobs == NULL && !server->stopping){
+			pthread_cond_wait(&server->ready, &server->lock);
+		}
+		c = server->jobs;
+		if(c == NULL){
+			pthread_mutex_unlock(&server->lock);
+			break;
+		}
+		server->jobs = c->next;
+		if(server->jobs == NULL){
+			server->lastJob = NULL;
+		}
+		pthread_mutex_unlock(&server->lock);
+
+		codeRequest(server, c);
+
+		pthread_mutex_lock(&server->lock);
+		c->next = server->done;
+		server->done = c;
+		pthread_mutex_unlock(&server->lock);
+		eventfd_write(server->wakeup, 1);
+	}
+	return NULL;
+}
+
+/*
+ * codeRequest - codes the request of a connection and stores the response
+ *               in it
+ *
+ * The response is left NULL if there isn't even memory for a failure
+ * header, finishJobs then closes the connection.
+ */
+static void codeRequest(daemonServer *server, daemonConnection *c){
+	frameOptions frame = server->options->frame;
+	int64_t result = -1;
+	uint64_t capacity = 0;
+
+	// Hold on to one version of the models for the whole request
+	frame.models = registry_acquire(server->models);
+	if(c->header[0] == DAEMON_ENCODE){
+		capacity = frame_maxEncodedSize(c->requestLength, frame.blockSize);
+	} else {
+		int64_t size = frame_decodedSize(c->request, c->requestLength);
+		capacity = size >= 0 ? (uint64_t)size : DAEMON_MAXPAYLOAD + 1;
+	}
+	c->response = capacity <= DAEMON_MAXPAYLOAD ?
+	              malloc(DAEMON_HEADERSIZE + capacity) : NULL;
+	if(c->response != NULL && c->header[0] == DAEMON_ENCODE){
+		uint64_t written = frame_encodeInto(c->request, c->requestLength,
+		                                    &frame,
+		                                    c->response + DAEMON_HEADERSIZE,
+		                                    (size_t)capacity);
+		result = written > 0 ? (int64_t)written : -1;
+	} else if(c->response != NULL){
+		result = frame_decodeInto(c->request, c->requestLength, frame.models,
+		                          c->response + DAEMON_HEADERSIZE, 1);
+	}
+	registry_release(frame.models);
+
+	if(c->response == NULL){
+		c->response = malloc(DAEMON_HEADERSIZE);
+	}
+	free(c->request);
+	c->request = NULL;
+
+	// Without memory for even a failure the connection is closed
+	if(c->response == NULL){
+		c->responseLength = 0;
+		return;
+	}
+	c->response[0] = result >= 0 ? DAEMON_OK : DAEMON_FAILED;
+	storeLittleEndian(c->response + 1, result >= 0 ? (uint64_t)result : 0,
+	                  4);
+	c->responseLength = DAEMON_HEADERSIZE + (result >= 0 ? (size_t)result :
+	                                                      0);
+}
+
+#else
+
+int daemon_run(const char *path, modelRegistry *models,
+               const daemonOptions *options){
+	(void)path;
+	(void)options;
+	fprintf(stderr, "This build has no daemon, it needs epoll\n");
+	registry_free(models);
+	return -1;
+}
+
+#endif
@@ -0,0 +1,165 @@
+/* Compression daemon - serves encode and decode requests on a socket.
+ *
+ * Running the program for every payload pays for process creation and for
+ * loading the models again each time, which for small payloads costs far
+ * more than the coding itself. A daemon loads the models once and serves
+ * requests on a Unix domain socket, so services on the same machine get
+ * compression as a local call:
+ *
+ *  - One thread runs an epoll loop that accepts connections, reads
+ *    requests and writes responses, all without blocking.
+ *  - Complete requests are handed to a pool of worker threads that code
+ *    them with the current models (see sharedRegistry in registry.h).
+ *  - SIGHUP loads the models again and publishes them, requests already
+ *    being coded finish with the old ones. SIGINT and SIGTERM stop the
+ *    daemon.
+ *
+ * Every message is a DAEMON_HEADERSIZE byte header followed by its
+ * payload. The header of a request is an operation byte (DAEMON_ENCODE or
+ * DAEMON_DECODE) and the payload size as 4 bytes little endian; a
+ * response has a status byte (DAEMON_OK or DAEMON_FAILED) in place of the
+ * operation. Encoding returns a frame (see frame.h), decoding takes one.
+ * A connection may send any number of requests, and may send the next
+ * before the response of the last one has arrived; they are answered in
+ * order.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __DAEMON_H
+#define __DAEMON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frame.h"
+#include "registry.h"
+
+// Size of the header of every request and response
+#define DAEMON_HEADERSIZE 5
+
+// Largest payload of a request or response
+#define DAEMON_MAXPAYLOAD (1u << 28)
+
+// Operations of a request
+#define DAEMON_ENCODE 'e'
+#define DAEMON_DECODE 'd'
+
+// Status of a response
+#define DAEMON_OK 0
+#define DAEMON_FAILED 1
+
+/*
+ * Struct 'daemonOptions'
+ *
+ *      frame       - frame encoder settings, frame.models is not used
+ *      threads     - number of workers (>= 1)
+ *      reload      - loads the models again on SIGHUP, returns NULL if
+ *                    they couldn't be loaded
+ *      context     - passed to reload
+ */
+typedef struct {
+    frameOptions frame;
+    int threads;
+    modelRegistry *(*reload)(void *context);
+    void *context;
+} daemonOptions;
+
+/*
+ * Struct 'daemonReply'
+ * Response of the daemon, the buffer is reused from call to call
+ *
+ *      data        - the payload
+ *      length      - size of the payload
+ *      capacity    - size of data
+ */
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+} daemonReply;
+
+/*
+ * Struct 'daemonBenchStats'
+ * Results of daemon_benchmark
+ *
+ *      requests    - number of requests answered
+ *      failed      - number of requests that failed
+ *      bytesIn     - payload bytes sent
+ *      bytesOut    - payload bytes received
+ *      seconds     - wall clock time of the run
+ *      median      - median latency in microseconds
+ *      p99         - 99th percentile latency in microseconds
+ *      slowest     - highest latency in microseconds
+ */
+typedef struct {
+    uint64_t requests;
+    uint64_t failed;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    double seconds;
+    double median;
+    double p99;
+    double slowest;
+} daemonBenchStats;
+
+/*
+ * daemon_run - serves requests until SIGINT or SIGTERM
+ *
+ * Parameter:   path    - name of the socket, a socket file of that name
+ *                        that no daemon listens on any more is replaced
+ *              models  - the models, owned by the daemon from now on
+ *              options - settings of the daemon
+ *
+ * Returns:     0 after a signal to stop, -1 if the socket couldn't be set
+ *              up or another daemon is listening on it
+ */
+int daemon_run(const char *path, modelRegistry *models,
+               const daemonOptions *options);
+
+/*
+ * daemon_connect - connects to a daemon
+ *
+ * Returns:     the socket, -1 if there is no daemon at path
+ */
+int daemon_connect(const char *path);
+
+/*
+ * daemon_disconnect - closes a connection made with daemon_connect
+ */
+void daemon_disconnect(int socket);
+
+/*
+ * daemon_call - sends a request and waits for its response
+ *
+ * Parameter:   socket  - connection made with daemon_connect
+ *              op      - DAEMON_ENCODE or DAEMON_DECODE
+ *              input   - payload of the request
+ *              length  - size of the payload (<= DAEMON_MAXPAYLOAD)
+ *              reply   - receives the response, zero it before the first
+ *                        call and free reply->data after the last one
+ *
+ * Returns:     DAEMON_OK or DAEMON_FAILED, -1 if the connection failed
+ */
+int daemon_call(int socket, int op, const unsigned char *input,
+                size_t length, daemonReply *reply);
+
+/*
+ * daemon_benchmark - measures the throughput and latency of a daemon
+ *
+ * Parameter:   path        - name of the socket
+ *              op          - operation of every request
+ *              input       - payload of every request
+ *              length      - size of the payload
+ *              clients     - number of connections sending requests at
+ *                            the same time, each from a thread of its own
+ *              requests    - number of requests sent in all
+ *              stats       - receives the results
+ *
+ * Returns:     0 if every request was answered with DAEMON_OK, -1
+ *              otherwise
+ */
+int daemon_benchmark(const char *path, int op, const unsigned char *input,
+                     size_t length, int clients, uint64_t requests,
+                     daemonBenchStats *stats);
+
+#endif
@@ -0,0 +1,1372 @@
+/* Encoding and decoding of the frame format, see frame.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "frame.h"
+#include "bitio.h"
+#include "codetable.h"
+#include "huffmantree.h"
+#include "order1.h"
+#include "alphabet.h"
+#include "lz77.h"
+#include "ans.h"
+#include "kernels.h"
+
+static const unsigned char frameMagic[4] = { 0x89, 'H', 'U', 'F' };
+static const unsigned char indexMagic[4] = { 0x89, 'H', 'U', 'I' };
+
+// decodeParallel result for frames whose blocks depend on each other
+#define FRAME_SEQUENTIAL (-2)
+
+// blockModel result for blocks that aren't coded with a registry model
+#define FRAME_NOMODEL (-2)
+
+/*
+ * Struct 'frameBlock'
+ * A block of a frame that can be decoded on its own
+ *
+ *      type        - block type, FRAME_BLOCK_STORED or a byte table type
+ *      streams     - number of substreams
+ *      sizes       - sizes of the substreams, NULL for a single stream
+ *      payload     - coded bits (or stored data)
+ *      payloadSize - number of bytes of payload
+ *      rawSize     - number of bytes of original data
+ *      offset      - position of the original data in the output
+ *      lookup      - decode table of the block
+ */
+typedef struct {
+    int type;
+    int streams;
+    const unsigned char *sizes;
+    const unsigned char *payload;
+    size_t payloadSize;
+    size_t rawSize;
+    uint64_t offset;
+    const decodeTable *lookup;
+} frameBlock;
+
+/*
+ * Struct 'frameSpan'
+ * A frame of a file of frames
+ *
+ *      offset      - position of the frame header in the file
+ *      length      - bytes from there to the next frame or the index
+ */
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} frameSpan;
+
+/*
+ * Struct 'frameJobs'
+ * Blocks shared by the workers of decodeParallel
+ */
+typedef struct {
+    const frameBlock *blocks;
+    size_t count;
+    size_t next;
+    unsigned char *output;
+    int failed;
+} frameJobs;
+
+static uint64_t encodeFrameTo(const unsigned char *input, size_t length,
+                              const frameOptions *options, FILE *file,
+                              unsigned char *memory, size_t capacity);
+static bool emit(FILE *file, unsigned char *memory, size_t capacity,
+                 uint64_t at, const unsigned char *data, size_t size);
+static int64_t decodeFrameTo(const unsigned char *input, size_t length,
+                             const modelRegistry *models, FILE *file,
+                             unsigned char *memory);
+static int64_t decodeParallel(const unsigned char *input, size_t length,
+                              const modelRegistry *models,
+                              unsigned char *output, int threads);
+static void *decodeWorker(void *argument);
+
+static size_t encodeStreams(const unsigned char *input, size_t length,
+                            const codeTable *table, int streams,
+                            unsigned char *sizes, unsigned char *output);
+static int decodeStreams(const unsigned char *bits, size_t length,
+                         const unsigned char *sizes, int streams,
+                         const decodeTable *table, unsigned char *output,
+                         size_t outputLength);
+static void streamSegment(size_t length, int streams, int stream,
+                          size_t *start, size_t *end);
+static int streamCode(int streams);
+static int frameStreams(int typeByte);
+static bool isByteTableType(int type);
+static int blockModel(int type, const unsigned char **payload,
+                      uint32_t *payloadSize, const modelRegistry *models);
+static bool blocksHold(const unsigned char *input, size_t length,
+                       uint64_t size);
+static int64_t frameDecodedSize(const unsigned char *input, size_t length);
+static size_t frameLength(const unsigned char *input, size_t length);
+static size_t listFrames(const unsigned char *input, size_t length,
+                         frameSpan **spans);
+static bool readIndex(const unsigned char *input, size_t length,
+                      frameSpan **spans, size_t *count);
+static void writeBlockHeader(unsigned char *header, int type,
+                             uint32_t rawSize, uint32_t payloadSize);
+
+bool frame_isFrame(const unsigned char *data, size_t length){
+	return length >= FRAME_HEADERSIZE &&
+	       !memcmp(data, frameMagic, sizeof(frameMagic)) &&
+	       data[4] == FRAME_VERSION;
+}
+
+void frame_defaultOptions(frameOptions *options){
+	options->blockSize = FRAME_BLOCKSIZE;
+	options->models = NULL;
+	options->order1 = false;
+	options->alphabet = ALPHABET_BYTE;
+	options->streams = 1;
+	options->lzLevel = 0;
+	options->lzWindow = 0;
+	options->ans = false;
+}
+
+uint64_t frame_maxEncodedSize(uint64_t length, size_t blockSize){
+	uint64_t blocks = (length + blockSize - 1) / blockSize;
+
+	/*
+	 * Blocks that don't shrink are stored, the rest can only exceed their
+	 * cost by the padding of their substreams
+	 */
+	return FRAME_HEADERSIZE + length +
+	       blocks * (FRAME_BLOCKHEADERSIZE + FRAME_MAXSTREAMS) +
+	       FRAME_BLOCKHEADERSIZE;
+}
+
+uint64_t frame_encode(const unsigned char *input, size_t length,
+                      const frameOptions *options, FILE *output){
+	return encodeFrameTo(input, length, options, output, NULL, 0);
+}
+
+uint64_t frame_encodeInto(const unsigned char *input, size_t length,
+                          const frameOptions *options, unsigned char *output,
+                          size_t capacity){
+	return encodeFrameTo(input, length, options, NULL, output, capacity);
+}
+
+int64_t frame_appendOffset(const unsigned char *file, size_t length){
+	frameSpan *spans;
+	size_t count;
+	uint64_t end;
+
+	if(length == 0){
+		return 0;
+	}
+	count = listFrames(file, length, &spans);
+	if(count == 0){
+		return -1;
+	}
+	end = spans[count - 1].offset + spans[count - 1].length;
+
+	// The last frame must be whole, and only an index may follow the frames
+	if(frameLength(file + spans[count - 1].offset,
+	               (size_t)spans[count - 1].length) == 0 ||
+	   (end < length && !readIndex(file, length, NULL, NULL))){
+		free(spans);
+		return -1;
+	}
+	free(spans);
+	return (int64_t)end;
+}
+
+/*
+ * The index lists the frames already in the file with their sizes, taken
+ * from their headers, followed by the new frame.
+ */
+uint64_t frame_append(const unsigned char *file, size_t fileLength,
+                      const unsigned char *input, size_t length,
+                      const frameOptions *options, FILE *output){
+	int64_t offset = frame_appendOffset(file, fileLength);
+	frameSpan *spans = NULL;
+	size_t count = 0;
+	unsigned char *index;
+	size_t indexSize;
+	uint64_t written;
+
+	if(offset < 0){
+		return 0;
+	}
+	if(offset > 0){
+		count = listFrames(file, fileLength, &spans);
+	}
+	written = frame_encode(input, length, options, output);
+	if(written == 0){
+		free(spans);
+		return 0;
+	}
+
+	indexSize = FRAME_INDEXOVERHEAD + (count + 1) * FRAME_INDEXENTRYSIZE;
+	index = malloc(indexSize);
+	memcpy(index, indexMagic, sizeof(indexMagic));
+	for(size_t i = 0; i < count; i++){
+		unsigned char *entry = index + 4 + i * FRAME_INDEXENTRYSIZE;
+		storeLittleEndian(entry, spans[i].offset, 8);
+		memcpy(entry + 8, file + spans[i].offset + 6, 8);
+	}
+	storeLittleEndian(index + 4 + count * FRAME_INDEXENTRYSIZE,
+	                  (uint64_t)offset, 8);
+	storeLittleEndian(index + 12 + count * FRAME_INDEXENTRYSIZE, length, 8);
+	storeLittleEndian(index + indexSize - 8, count + 1, 4);
+	memcpy(index + indexSize - 4, indexMagic, sizeof(indexMagic));
+
+	if(fwrite(index, 1, indexSize, output) != indexSize){
+		written = 0;
+	} else {
+		written += indexSize;
+	}
+	free(index);
+	free(spans);
+	return written;
+}
+
+int64_t frame_decodedSize(const unsigned char *input, size_t length){
+	frameSpan *spans;
+	size_t count = listFrames(input, length, &spans);
+	int64_t total = 0;
+
+	if(count == 0){
+		return -1;
+	}
+	for(size_t i = 0; i < count && total >= 0; i++){
+		int64_t size = frameDecodedSize(input + spans[i].offset,
+		                                (size_t)spans[i].length);
+		total = size < 0 || size > INT64_MAX - total ? -1 : total + size;
+	}
+	free(spans);
+	return total;
+}
+
+int64_t frame_decode(const unsigned char *input, size_t length,
+                     const modelRegistry *models, FILE *output){
+	frameSpan *spans;
+	size_t count = listFrames(input, length, &spans);
+	int64_t total = 0;
+
+	if(count == 0){
+		return -1;
+	}
+	for(size_t i = 0; i < count && total >= 0; i++){
+		int64_t size = decodeFrameTo(input + spans[i].offset,
+		                             (size_t)spans[i].length, models, output,
+		                             NULL);
+		total = size < 0 ? -1 : total + size;
+	}
+	free(spans);
+	return total;
+}
+
+/*
+ * Frames are decoded one after the other, each of them by all threads.
+ */
+int64_t frame_decodeInto(const unsigned char *input, size_t length,
+                         const modelRegistry *models, unsigned char *output,
+                         int threads){
+	frameSpan *spans;
+	size_t count = listFrames(input, length, &spans);
+	int64_t total = 0;
+
+	if(count == 0){
+		return -1;
+	}
+	for(size_t i = 0; i < count && total >= 0; i++){
+		const unsigned char *frame = input + spans[i].offset;
+		size_t frameSize = (size_t)spans[i].length;
+		int64_t size = FRAME_SEQUENTIAL;
+
+		if(threads > 1){
+			size = decodeParallel(frame, frameSize, models, output + total,
+			                      threads);
+		}
+		if(size == FRAME_SEQUENTIAL){
+			size = decodeFrameTo(frame, frameSize, models, NULL,
+			                     output + total);
+		}
+		total = size < 0 ? -1 : total + size;
+	}
+	free(spans);
+	return total;
+}
+
+/*
+ * encodeFrameTo - encodes a buffer as a frame, see frame_encode
+ *
+ * Parameter:   file        - file that receives the frame, or
+ *              memory      - buffer that receives it
+ *              capacity    - size of memory
+ */
+static uint64_t encodeFrameTo(const unsigned char *input, size_t length,
+                              const frameOptions *options, FILE *file,
+                              unsigned char *memory, size_t capacity){
+	unsigned char header[FRAME_HEADERSIZE];
+	unsigned char *payload;
+	unsigned char lengths[256];
+	codeTable *fresh = codeTable_create(256);
+	codeTable *stored = codeTable_create(256);
+	const codeTable *current = NULL;
+	order1Model *contextModel = NULL;
+	uint64_t (*contextFrequency)[ORDER1_CONTEXTS] = NULL;
+	wideModel *wide = NULL;
+	lzModel *lz = NULL;
+	ansModel *ans = NULL;
+	const modelRegistry *models = options->models;
+	uint64_t *modelBits = NULL;
+	size_t blockSize = options->blockSize;
+	size_t payloadCapacity;
+	uint64_t written = 0;
+
+	memcpy(header, frameMagic, sizeof(frameMagic));
+	header[4] = FRAME_VERSION;
+	header[5] = 0;
+	storeLittleEndian(header + 6, length, 8);
+	if(!emit(file, memory, capacity, written, header, sizeof(header))){
+		codeTable_free(fresh);
+		codeTable_free(stored);
+		return 0;
+	}
+	written += sizeof(header);
+
+	if(options->order1){
+		contextModel = order1Model_create();
+		contextFrequency = malloc(ORDER1_CONTEXTS * sizeof(*contextFrequency));
+	}
+	if(options->alphabet != ALPHABET_BYTE){
+		wide = wideModel_create(options->alphabet);
+	}
+	if(options->lzLevel > 0){
+		size_t window = options->lzWindow;
+		if(window == 0 || window > options->blockSize){
+			window = options->blockSize;
+		}
+		lz = lzModel_create(options->lzLevel, window);
+	}
+	if(options->ans){
+		ans = ansModel_create();
+	}
+	if(models != NULL && models->count > 0){
+		modelBits = malloc(models->count * sizeof(uint64_t));
+	}
+
+	/*
+	 * Room for a block header, the largest byte model and the longest
+	 * codes. Wide alphabet, LZ77 and tANS blocks grow the buffer when they
+	 * need more.
+	 */
+	payloadCapacity = FRAME_BLOCKHEADERSIZE + ORDER1_MAXSERIALIZED +
+	                  blockSize / 8 * CODETABLE_MAXLENGTH + CODETABLE_MAXLENGTH;
+	payload = malloc(payloadCapacity);
+
+	for(size_t offset = 0; offset < length; offset += blockSize){
+		size_t blockLength = length - offset < blockSize ?
+		                     length - offset : blockSize;
+		unsigned char *bits;
+		uint64_t frequency[256] = { 0 };
+		uint64_t costRepeat = UINT64_MAX;
+		uint64_t costGlobal = UINT64_MAX;
+		uint64_t costFresh;
+		uint64_t costOrder1 = UINT64_MAX;
+		uint64_t costWide = UINT64_MAX;
+		uint64_t costLz = UINT64_MAX;
+		uint64_t costAns = UINT64_MAX;
+		uint64_t costBest;
+		int previous = offset > 0 ? input[offset - 1] : 0;
+		int model = 0;
+		int type;
+		int streams = 1;
+		unsigned char *sizes = NULL;
+		size_t payloadSize;
+
+		// First pass over the block: its histogram and a fresh table
+		for(size_t i = 0; i < blockLength; i++){
+			frequency[input[offset + i]]++;
+		}
+		getCodeLengths(frequency, lengths, CODETABLE_MAXLENGTH);
+		codeTable_setLengths(fresh, lengths);
+
+		/*
+		 * Compare the exact sizes of the block coded with the table in use,
+		 * with the cheapest model of the registry (plus its fingerprint
+		 * and number) and with the fresh table plus its storage
+		 */
+		if(current != NULL){
+			costRepeat = codeTable_byteCost(current, frequency);
+		}
+		if(modelBits != NULL){
+			codeTable_scoreTables(models->table, models->count, frequency,
+			                      modelBits);
+			for(int k = 0; k < models->count; k++){
+				uint64_t cost = modelBits[k];
+				if(cost != UINT64_MAX){
+					cost += 8 * FRAME_FINGERPRINTSIZE + (k > 0 ? 8 : 0);
+				}
+				if(cost < costGlobal){
+					costGlobal = cost;
+					model = k;
+				}
+			}
+		}
+		costFresh = codeTable_cost(fresh, frequency) +
+		            8 * codeTable_serializedSize(fresh);
+
+		// The order-1 model is only worth it if it beats all of them
+		if(contextModel != NULL){
+			memset(contextFrequency, 0,
+			       ORDER1_CONTEXTS * sizeof(*contextFrequency));
+			for(size_t i = 0; i < blockLength; i++){
+				contextFrequency[previous][input[offset + i]]++;
+				previous = input[offset + i];
+			}
+			previous = offset > 0 ? input[offset - 1] : 0;
+			costOrder1 = order1Model_fit(contextModel, contextFrequency);
+		}
+		if(wide != NULL){
+			costWide = wideModel_fit(wide, input + offset, blockLength);
+		}
+		if(lz != NULL){
+			costLz = lzModel_fit(lz, input + offset, blockLength);
+		}
+		if(ans != NULL){
+			costAns = ansModel_fit(ans, frequency, input + offset, blockLength);
+			if(costAns / 8 * FRAME_ANS_MAXRATIO < blockLength){
+				costAns = UINT64_MAX;
+			}
+		}
+
+		/*
+		 * A fresh table is stored once and repeated by the blocks after
+		 * it, a tANS model is stored with every block. Unless this is the
+		 * last block, tANS has to beat the table as if it were free.
+		 */
+		if(costAns != UINT64_MAX && offset + blockLength < length &&
+		   costAns >= costFresh - 8 * codeTable_serializedSize(fresh)){
+			costAns = UINT64_MAX;
+		}
+
+		// Substreams cost their sizes in the block header
+		if(options->streams > 1 && blockLength >= FRAME_STREAMS_MINSIZE){
+			uint64_t sizeBits = 32 * (uint64_t)(options->streams - 1);
+			streams = options->streams;
+			costRepeat += costRepeat < UINT64_MAX - sizeBits ? sizeBits : 0;
+			costGlobal += costGlobal < UINT64_MAX - sizeBits ? sizeBits : 0;
+			costFresh += sizeBits;
+		}
+
+		/*
+		 * Byte tables win ties as they decode fastest; a block that no
+		 * model makes smaller is stored as it is
+		 */
+		costBest = costRepeat < costGlobal ? costRepeat : costGlobal;
+		costBest = costFresh < costBest ? costFresh : costBest;
+		costBest = costOrder1 < costBest ? costOrder1 : costBest;
+		costBest = costWide < costBest ? costWide : costBest;
+		costBest = costLz < costBest ? costLz : costBest;
+		costBest = costAns < costBest ? costAns : costBest;
+		if(costBest >= 8 * (uint64_t)blockLength){
+			type = FRAME_BLOCK_STORED;
+		} else if(costBest < costRepeat && costBest < costGlobal &&
+		          costBest < costFresh){
+			if(costOrder1 == costBest){
+				type = FRAME_BLOCK_ORDER1;
+			} else {
+				size_t needed = FRAME_BLOCKHEADERSIZE +
+				                (size_t)(costBest / 8) + CODETABLE_MAXLENGTH;
+				if(needed > payloadCapacity){
+					payloadCapacity = needed;
+					payload = realloc(payload, payloadCapacity);
+				}
+				type = costWide == costBest ? FRAME_BLOCK_WIDE :
+				       costLz == costBest ? FRAME_BLOCK_LZ77 :
+				                            FRAME_BLOCK_ANS;
+			}
+		} else if(costRepeat <= costGlobal && costRepeat <= costFresh){
+			type = FRAME_BLOCK_REPEAT;
+		} else if(costGlobal <= costFresh){
+			type = model == 0 ? FRAME_BLOCK_GLOBAL : FRAME_BLOCK_MODEL;
+			current = models->table[model];
+		} else {
+			codeTable *swap = stored;
+			stored = fresh;
+			fresh = swap;
+			type = FRAME_BLOCK_TABLE;
+			current = stored;
+		}
+
+		// Second pass: code the block
+		bits = payload + FRAME_BLOCKHEADERSIZE;
+		if(!isByteTableType(type)){
+			streams = 1;
+		}
+		if(type == FRAME_BLOCK_MODEL){
+			*bits++ = (unsigned char)model;
+		}
+		if(type == FRAME_BLOCK_GLOBAL || type == FRAME_BLOCK_MODEL){
+			storeLittleEndian(bits, codeTable_fingerprint(current),
+			                  FRAME_FINGERPRINTSIZE);
+			bits += FRAME_FINGERPRINTSIZE;
+		}
+		if(streams > 1){
+			sizes = bits;
+			bits += 4 * (streams - 1);
+		}
+		if(type == FRAME_BLOCK_TABLE){
+			bits += codeTable_serialize(stored, bits);
+		}
+		if(type == FRAME_BLOCK_STORED){
+			memcpy(bits, input + offset, blockLength);
+			payloadSize = blockLength;
+		} else if(type == FRAME_BLOCK_WIDE){
+			bits += wideModel_serialize(wide, bits);
+			payloadSize = (size_t)(bits - payload) - FRAME_BLOCKHEADERSIZE +
+			              wideModel_encode(wide, input + offset, blockLength,
+			                               bits);
+		} else if(type == FRAME_BLOCK_LZ77){
+			bits += lzModel_serialize(lz, bits);
+			payloadSize = (size_t)(bits - payload) - FRAME_BLOCKHEADERSIZE +
+			              lzModel_encode(lz, bits);
+		} else if(type == FRAME_BLOCK_ANS){
+			bits += ansModel_serialize(ans, bits);
+			payloadSize = (size_t)(bits - payload) - FRAME_BLOCKHEADERSIZE +
+			              ansModel_encode(ans, bits);
+		} else if(type == FRAME_BLOCK_ORDER1){
+			bits += order1Model_serialize(contextModel, bits);
+			payloadSize = (size_t)(bits - payload) - FRAME_BLOCKHEADERSIZE +
+			              order1Model_encode(contextModel, input + offset,
+			                                 blockLength, previous, bits);
+		} else {
+			payloadSize = (size_t)(bits - payload) - FRAME_BLOCKHEADERSIZE +
+			              encodeStreams(input + offset, blockLength, current,
+			                            streams, sizes, bits);
+		}
+		writeBlockHeader(payload, type | streamCode(streams),
+		                 (uint32_t)blockLength, (uint32_t)payloadSize);
+		if(!emit(file, memory, capacity, written, payload,
+		         FRAME_BLOCKHEADERSIZE + payloadSize)){
+			written = 0;
+			break;
+		}
+		written += FRAME_BLOCKHEADERSIZE + payloadSize;
+	}
+
+	writeBlockHeader(payload, FRAME_BLOCK_END, 0, 0);
+	if(written == 0 || !emit(file, memory, capacity, written, payload,
+	                         FRAME_BLOCKHEADERSIZE)){
+		written = 0;
+	} else {
+		written += FRAME_BLOCKHEADERSIZE;
+	}
+	free(payload);
+	free(modelBits);
+	codeTable_free(fresh);
+	codeTable_free(stored);
+	if(contextModel != NULL){
+		order1Model_free(contextModel);
+		free(contextFrequency);
+	}
+	if(wide != NULL){
+		wideModel_free(wide);
+	}
+	if(lz != NULL){
+		lzModel_free(lz);
+	}
+	if(ans != NULL){
+		ansModel_free(ans);
+	}
+	return written;
+}
+
+/*
+ * emit - appends size bytes at offset at of the frame being written
+ *
+ * Parameter:   file        - file the frame is written to, or
+ *              memory      - buffer it is written to
+ *              capacity    - size of memory
+ *
+ * Returns:     true on success, false on write errors or if memory is full
+ */
+static bool emit(FILE *file, unsigned char *memory, size_t capacity,
+                 uint64_t at, const unsigned char *data, size_t size){
+	if(memory == NULL){
+		return fwrite(data, 1, size, file) == size;
+	}
+	if(at > capacity || size > capacity - at){
+		return false;
+	}
+	memcpy(memory + at, data, size);
+	return true;
+}
+
+/*
+ * decodeFrameTo - decodes a frame block by block, see frame_decode
+ *
+ * Parameter:   file    - file that receives the decoded data, or
+ *              memory  - buffer of frame_decodedSize bytes that receives
+ *                        it; blocks are decoded straight into place
+ */
+static int64_t decodeFrameTo(const unsigned char *input, size_t length,
+                             const modelRegistry *models, FILE *file,
+                             unsigned char *memory){
+	codeTable *table = codeTable_create(256);
+	decodeTable *lookup = NULL;
+	const decodeTable *current = NULL;
+	order1Model *contextModel = NULL;
+	wideModel *wide = NULL;
+	lzModel *lz = NULL;
+	ansModel *ans = NULL;
+	int previous = 0;
+	unsigned char *decoded = NULL;
+	unsigned char *out;
+	size_t decodedCapacity = 0;
+	uint64_t expected;
+	uint64_t total = 0;
+	size_t position = FRAME_HEADERSIZE;
+	int64_t result = -1;
+
+	if(!frame_isFrame(input, length)){
+		codeTable_free(table);
+		return -1;
+	}
+	expected = loadLittleEndian(input + 6, 8);
+
+	while(position + FRAME_BLOCKHEADERSIZE <= length){
+		int type = input[position] & FRAME_TYPEMASK;
+		int streams = frameStreams(input[position]);
+		const unsigned char *sizes = NULL;
+		uint32_t rawSize = (uint32_t)loadLittleEndian(input + position + 1, 4);
+		uint32_t payloadSize = (uint32_t)loadLittleEndian(input + position + 5,
+		                                                  4);
+		const unsigned char *payload = input + position +
+		                               FRAME_BLOCKHEADERSIZE;
+		int model;
+
+		position += FRAME_BLOCKHEADERSIZE;
+		if(payloadSize > length - position){
+			break;
+		}
+		position += payloadSize;
+
+		if(type == FRAME_BLOCK_END){
+			if(total == expected){
+				result = (int64_t)total;
+			}
+			break;
+		}
+		model = blockModel(type, &payload, &payloadSize, models);
+		if(model == -1){
+			break;
+		}
+
+		// Only blocks coded with a byte table are split into substreams
+		if(streams > 1){
+			if(!isByteTableType(type) ||
+			   payloadSize < 4 * (uint32_t)(streams - 1)){
+				break;
+			}
+			sizes = payload;
+			payload += 4 * (streams - 1);
+			payloadSize -= 4 * (uint32_t)(streams - 1);
+		} else if(streams < 1){
+			break;
+		}
+		if(type == FRAME_BLOCK_TABLE){
+			long tableSize = codeTable_deserialize(table, payload,
+			                                       payloadSize);
+			if(tableSize < 0){
+				break;
+			}
+			if(lookup != NULL){
+				decodeTable_free(lookup);
+			}
+			lookup = decodeTable_create(table);
+			current = lookup;
+			payload += tableSize;
+			payloadSize -= (uint32_t)tableSize;
+		} else if(model >= 0){
+			current = models->lookup[model];
+		} else if(type == FRAME_BLOCK_ORDER1){
+			long modelSize;
+			if(contextModel == NULL){
+				contextModel = order1Model_create();
+			}
+			modelSize = order1Model_deserialize(contextModel, payload,
+			                                    payloadSize);
+			if(modelSize < 0){
+				break;
+			}
+			payload += modelSize;
+			payloadSize -= (uint32_t)modelSize;
+		} else if(type == FRAME_BLOCK_WIDE){
+			long modelSize;
+			if(wide == NULL){
+				wide = wideModel_create(ALPHABET_UTF8);
+			}
+			modelSize = wideModel_deserialize(wide, payload, payloadSize);
+			if(modelSize < 0){
+				break;
+			}
+			payload += modelSize;
+			payloadSize -= (uint32_t)modelSize;
+		} else if(type == FRAME_BLOCK_LZ77){
+			long modelSize;
+			if(lz == NULL){
+				lz = lzModel_create(1, LZ77_WINDOW);
+			}
+			modelSize = lzModel_deserialize(lz, payload, payloadSize);
+			if(modelSize < 0){
+				break;
+			}
+			payload += modelSize;
+			payloadSize -= (uint32_t)modelSize;
+		} else if(type == FRAME_BLOCK_ANS){
+			long modelSize;
+			if(ans == NULL){
+				ans = ansModel_create();
+			}
+			modelSize = ansModel_deserialize(ans, payload, payloadSize);
+			if(modelSize < 0){
+				break;
+			}
+			payload += modelSize;
+			payloadSize -= (uint32_t)modelSize;
+		} else if(type == FRAME_BLOCK_STORED){
+			if(payloadSize != rawSize){
+				break;
+			}
+		} else if(type != FRAME_BLOCK_REPEAT || current == NULL){
+			break;
+		}
+
+		if(rawSize > expected - total){
+			break;
+		}
+		if(memory == NULL && rawSize > decodedCapacity){
+			decodedCapacity = rawSize;
+			decoded = realloc(decoded, decodedCapacity);
+		}
+		out = memory != NULL ? memory + total : decoded;
+		if(type == FRAME_BLOCK_STORED){
+			memcpy(out, payload, rawSize);
+		} else if(type == FRAME_BLOCK_WIDE){
+			if(wideModel_decode(wide, payload, payloadSize, out,
+			                    rawSize) != 0){
+				break;
+			}
+		} else if(type == FRAME_BLOCK_LZ77){
+			if(lzModel_decode(lz, payload, payloadSize, out, rawSize) != 0){
+				break;
+			}
+		} else if(type == FRAME_BLOCK_ANS){
+			if(ansModel_decode(ans, payload, payloadSize, out, rawSize) != 0){
+				break;
+			}
+		} else if(type == FRAME_BLOCK_ORDER1){
+			if(order1Model_decode(contextModel, payload, payloadSize,
+			                      previous, out, rawSize) != 0){
+				break;
+			}
+		} else if(decodeStreams(payload, payloadSize, sizes, streams, current,
+		                        out, rawSize) != 0){
+			break;
+		}
+		if(memory == NULL && fwrite(out, 1, rawSize, file) != rawSize){
+			break;
+		}
+		if(rawSize > 0){
+			previous = out[rawSize - 1];
+		}
+		total += rawSize;
+	}
+
+	free(decoded);
+	if(lookup != NULL){
+		decodeTable_free(lookup);
+	}
+	if(contextModel != NULL){
+		order1Model_free(contextModel);
+	}
+	if(wide != NULL){
+		wideModel_free(wide);
+	}
+	if(lz != NULL){
+		lzModel_free(lz);
+	}
+	if(ans != NULL){
+		ansModel_free(ans);
+	}
+	codeTable_free(table);
+	return result;
+}
+
+/*
+ * decodeParallel - decodes a frame into memory with blocks shared among
+ *                  threads workers
+ *
+ * Returns:     see frame_decode, FRAME_SEQUENTIAL if the frame has order-1
+ *              or wide alphabet blocks, which need the blocks before them
+ *
+ * Comments:    A first pass reads the block headers and tables; as every
+ *              block header gives its size, the place of every block in
+ *              the output is known and the workers decode the blocks in
+ *              any order straight into place.
+ */
+static int64_t decodeParallel(const unsigned char *input, size_t length,
+                              const modelRegistry *models,
+                              unsigned char *output, int threads){
+	codeTable *table = codeTable_create(256);
+	decodeTable **lookups = NULL;
+	size_t lookupCount = 0;
+	size_t lookupCapacity = 0;
+	const decodeTable *current = NULL;
+	frameBlock *blocks = NULL;
+	size_t count = 0;
+	size_t capacity = 0;
+	uint64_t expected = loadLittleEndian(input + 6, 8);
+	uint64_t total = 0;
+	size_t position = FRAME_HEADERSIZE;
+	int64_t result = -1;
+	bool ended = false;
+
+	while(position + FRAME_BLOCKHEADERSIZE <= length){
+		frameBlock block;
+		uint32_t payloadSize = (uint32_t)loadLittleEndian(input + position + 5,
+		                                                  4);
+		int model;
+
+		block.type = input[position] & FRAME_TYPEMASK;
+		block.streams = frameStreams(input[position]);
+		block.sizes = NULL;
+		block.rawSize = (uint32_t)loadLittleEndian(input + position + 1, 4);
+		block.payload = input + position + FRAME_BLOCKHEADERSIZE;
+		position += FRAME_BLOCKHEADERSIZE;
+		if(payloadSize > length - position){
+			break;
+		}
+		position += payloadSize;
+
+		if(block.type == FRAME_BLOCK_END){
+			ended = true;
+			break;
+		}
+		if(block.type == FRAME_BLOCK_ORDER1 || block.type == FRAME_BLOCK_WIDE){
+			result = FRAME_SEQUENTIAL;
+			break;
+		}
+		model = blockModel(block.type, &block.payload, &payloadSize, models);
+		if(model == -1){
+			break;
+		}
+		if(block.streams > 1){
+			if(!isByteTableType(block.type) ||
+			   payloadSize < 4 * (uint32_t)(block.streams - 1)){
+				break;
+			}
+			block.sizes = block.payload;
+			block.payload += 4 * (block.streams - 1);
+			payloadSize -= 4 * (uint32_t)(block.streams - 1);
+		} else if(block.streams < 1){
+			break;
+		}
+		if(block.type == FRAME_BLOCK_TABLE){
+			long tableSize = codeTable_deserialize(table, block.payload,
+			                                       payloadSize);
+			if(tableSize < 0){
+				break;
+			}
+			if(lookupCount == lookupCapacity){
+				lookupCapacity = lookupCapacity == 0 ? 16 : lookupCapacity * 2;
+				lookups = realloc(lookups, lookupCapacity * sizeof(*lookups));
+			}
+			lookups[lookupCount] = decodeTable_create(table);
+			current = lookups[lookupCount++];
+			block.payload += tableSize;
+			payloadSize -= (uint32_t)tableSize;
+		} else if(model >= 0){
+			current = models->lookup[model];
+		} else if(block.type == FRAME_BLOCK_STORED){
+			if(payloadSize != block.rawSize){
+				break;
+			}
+		} else if(block.type != FRAME_BLOCK_REPEAT &&
+		          block.type != FRAME_BLOCK_LZ77 &&
+		          block.type != FRAME_BLOCK_ANS){
+			break;
+		} else if(block.type == FRAME_BLOCK_REPEAT && current == NULL){
+			break;
+		}
+		if(block.rawSize > expected - total){
+			break;
+		}
+
+		if(count == capacity){
+			capacity = capacity == 0 ? 64 : capacity * 2;
+			blocks = realloc(blocks, capacity * sizeof(*blocks));
+		}
+		block.payloadSize = payloadSize;
+		block.offset = total;
+		block.lookup = current;
+		blocks[count++] = block;
+		total += block.rawSize;
+	}
+
+	if(ended && total == expected){
+		frameJobs jobs = { blocks, count, 0, output, 0 };
+		pthread_t ids[FRAME_MAXTHREADS];
+		bool started[FRAME_MAXTHREADS] = { false };
+		int workers = threads < FRAME_MAXTHREADS ? threads : FRAME_MAXTHREADS;
+
+		if((size_t)workers > count){
+			workers = count > 0 ? (int)count : 1;
+		}
+		for(int i = 1; i < workers; i++){
+			started[i] = pthread_create(&ids[i], NULL, decodeWorker,
+			                            &jobs) == 0;
+		}
+		decodeWorker(&jobs);
+		for(int i = 1; i < workers; i++){
+			if(started[i]){
+				pthread_join(ids[i], NULL);
+			}
+		}
+		result = jobs.failed ? -1 : (int64_t)total;
+	}
+
+	for(size_t i = 0; i < lookupCount; i++){
+		decodeTable_free(lookups[i]);
+	}
+	free(lookups);
+	free(blocks);
+	codeTable_free(table);
+	return result;
+}
+
+/*
+ * decodeWorker - decodes blocks of a frameJobs until none are left
+ *
+ * LZ77 and tANS blocks carry their tables in the payload, every worker
+ * reads them into models of its own.
+ */
+static void *decodeWorker(void *argument){
+	frameJobs *jobs = argument;
+	lzModel *lz = NULL;
+	ansModel *ans = NULL;
+
+	for(;;){
+		size_t index = __atomic_fetch_add(&jobs->next, 1, __ATOMIC_RELAXED);
+		const frameBlock *block;
+		unsigned char *out;
+
+		if(index >= jobs->count){
+			break;
+		}
+		block = &jobs->blocks[index];
+		out = jobs->output + block->offset;
+		if(block->type == FRAME_BLOCK_STORED){
+			memcpy(out, block->payload, block->rawSize);
+		} else if(block->type == FRAME_BLOCK_LZ77){
+			long modelSize;
+			if(lz == NULL){
+				lz = lzModel_create(1, LZ77_WINDOW);
+			}
+			modelSize = lzModel_deserialize(lz, block->payload,
+			                                block->payloadSize);
+			if(modelSize < 0 ||
+			   lzModel_decode(lz, block->payload + modelSize,
+			                  block->payloadSize - (size_t)modelSize, out,
+			                  block->rawSize) != 0){
+				__atomic_store_n(&jobs->failed, 1, __ATOMIC_RELAXED);
+			}
+		} else if(block->type == FRAME_BLOCK_ANS){
+			long modelSize;
+			if(ans == NULL){
+				ans = ansModel_create();
+			}
+			modelSize = ansModel_deserialize(ans, block->payload,
+			                                 block->payloadSize);
+			if(modelSize < 0 ||
+			   ansModel_decode(ans, block->payload + modelSize,
+			                   block->payloadSize - (size_t)modelSize, out,
+			                   block->rawSize) != 0){
+				__atomic_store_n(&jobs->failed, 1, __ATOMIC_RELAXED);
+			}
+		} else if(decodeStreams(block->payload, block->payloadSize,
+		                        block->sizes, block->streams, block->lookup,
+		                        out, block->rawSize) != 0){
+			__atomic_store_n(&jobs->failed, 1, __ATOMIC_RELAXED);
+		}
+	}
+	if(lz != NULL){
+		lzModel_free(lz);
+	}
+	if(ans != NULL){
+		ansModel_free(ans);
+	}
+	return NULL;
+}
+
+/*
+ * encodeStreams - codes a block as streams substreams, one after the other
+ *
+ * Parameter:   sizes   - receives the sizes of all substreams but the last
+ *                        as 4 byte integers, unused for a single stream
+ *
+ * Returns:     number of bytes of coded bits of all substreams
+ */
+static size_t encodeStreams(const unsigned char *input, size_t length,
+                            const codeTable *table, int streams,
+                            unsigned char *sizes, unsigned char *output){
+	const codingKernels *kernels = kernels_get();
+	uint32_t packed[256];
+	size_t written = 0;
+
+	kernels_packTable(table, packed);
+	for(int s = 0; s < streams; s++){
+		size_t start;
+		size_t end;
+		size_t size;
+
+		streamSegment(length, streams, s, &start, &end);
+		size = kernels->encode(packed, input + start, end - start,
+		                       output + written);
+		if(s < streams - 1){
+			storeLittleEndian(sizes + 4 * s, size, 4);
+		}
+		written += size;
+	}
+	return written;
+}
+
+/*
+ * decodeStreams - decodes a block coded by encodeStreams
+ *
+ * Every substream has a bit reader of its own. The kernels decode one
+ * symbol of each substream per round; these decodes don't depend on each
+ * other, so the processor can overlap them instead of waiting for the
+ * length of one code before it can look up the next.
+ *
+ * Returns:     0 on success, -1 if the sizes don't add up, the bits are not
+ *              valid codes or run out
+ */
+static int decodeStreams(const unsigned char *bits, size_t length,
+                         const unsigned char *sizes, int streams,
+                         const decodeTable *table, unsigned char *output,
+                         size_t outputLength){
+	bitReader reader[FRAME_MAXSTREAMS];
+	unsigned char *out[FRAME_MAXSTREAMS];
+	size_t count[FRAME_MAXSTREAMS];
+	size_t offset = 0;
+
+	for(int s = 0; s < streams; s++){
+		size_t size = s < streams - 1 ?
+		              (size_t)loadLittleEndian(sizes + 4 * s, 4) :
+		              length - offset;
+		size_t start;
+		size_t end;
+
+		if(size > length - offset){
+			return -1;
+		}
+		bitReader_init(&reader[s], bits + offset, size);
+		offset += size;
+		streamSegment(outputLength, streams, s, &start, &end);
+		out[s] = output + start;
+		count[s] = end - start;
+	}
+
+	if(kernels_get()->decode(table, reader, streams, out, count) != 0){
+		return -1;
+	}
+	for(int s = 0; s < streams; s++){
+		if(bitReader_overrun(&reader[s])){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * streamSegment - finds the part of a block that substream stream codes.
+ *                 All but the last substream get length / streams bytes
+ *                 rounded up.
+ */
+static void streamSegment(size_t length, int streams, int stream,
+                          size_t *start, size_t *end){
+	size_t segment = (length + (size_t)streams - 1) / (size_t)streams;
+
+	*start = segment * (size_t)stream < length ? segment * (size_t)stream :
+	                                               length;
+	*end = length - *start > segment ? *start + segment : length;
+}
+
+/*
+ * streamCode - the bits of the block type byte that give the number of
+ *              substreams
+ */
+static int streamCode(int streams){
+	return streams == 8 ? 2 << FRAME_STREAMSHIFT :
+	       streams == 4 ? 1 << FRAME_STREAMSHIFT : 0;
+}
+
+/*
+ * frameStreams - the number of substreams of a block type byte, 0 if the
+ *                bits are invalid
+ */
+static int frameStreams(int typeByte){
+	static const int streams[4] = { 1, 4, 8, 0 };
+	return streams[typeByte >> FRAME_STREAMSHIFT];
+}
+
+/*
+ * isByteTableType - checks if blocks of a type are coded with a byte table,
+ *                   the blocks that may be split into substreams
+ */
+static bool isByteTableType(int type){
+	return type == FRAME_BLOCK_TABLE || type == FRAME_BLOCK_REPEAT ||
+	       type == FRAME_BLOCK_GLOBAL || type == FRAME_BLOCK_MODEL;
+}
+
+/*
+ * blockModel - finds the registry model of a block
+ *
+ * Parameter:   type        - the block type
+ *              payload     - the payload of the block, moved past the
+ *                            number and the fingerprint of the model
+ *              payloadSize - size of payload, reduced likewise
+ *              models      - the registry given to the decoder
+ *
+ * Returns:     the number of the model, FRAME_NOMODEL for blocks of other
+ *              types, -1 if the block needs a model that wasn't given or
+ *              that was coded with another table than the given one
+ */
+static int blockModel(int type, const unsigned char **payload,
+                      uint32_t *payloadSize, const modelRegistry *models){
+	int count = models != NULL ? models->count : 0;
+	int model;
+
+	if(type == FRAME_BLOCK_GLOBAL){
+		model = 0;
+	} else if(type == FRAME_BLOCK_MODEL){
+		if(*payloadSize < 1){
+			return -1;
+		}
+		model = (*payload)[0];
+		*payload += 1;
+		*payloadSize -= 1;
+	} else {
+		return FRAME_NOMODEL;
+	}
+
+	// The fingerprint tells if the model of that number is the right one
+	if(model >= count || *payloadSize < FRAME_FINGERPRINTSIZE ||
+	   loadLittleEndian(*payload, FRAME_FINGERPRINTSIZE) !=
+	   models->fingerprint[model]){
+		return -1;
+	}
+	*payload += FRAME_FINGERPRINTSIZE;
+	*payloadSize -= FRAME_FINGERPRINTSIZE;
+	return model;
+}
+
+/*
+ * blocksHold - checks that the blocks of a frame add up to size bytes and
+ *              that no block claims more bytes than its payload can code
+ *
+ * A code is at least a bit long. It stands for at most two bytes in blocks
+ * of byte tables and order-1 models, and for a character of at most four
+ * bytes in wide alphabet blocks. In LZ77 blocks a match of up to
+ * LZ77_MAXMATCH bytes takes two codes, and tANS blocks are kept within
+ * FRAME_ANS_MAXRATIO by the encoder.
+ */
+static bool blocksHold(const unsigned char *input, size_t length,
+                       uint64_t size){
+	uint64_t total = 0;
+	size_t position = FRAME_HEADERSIZE;
+
+	while(position + FRAME_BLOCKHEADERSIZE <= length){
+		int type = input[position] & FRAME_TYPEMASK;
+		uint64_t rawSize = loadLittleEndian(input + position + 1, 4);
+		uint64_t payloadSize = loadLittleEndian(input + position + 5, 4);
+		uint64_t most = type == FRAME_BLOCK_LZ77 ?
+		                payloadSize * 4 * LZ77_MAXMATCH :
+		                type == FRAME_BLOCK_ANS ?
+		                payloadSize * FRAME_ANS_MAXRATIO :
+		                type == FRAME_BLOCK_WIDE ?
+		                payloadSize * 32 : payloadSize * 16;
+
+		position += FRAME_BLOCKHEADERSIZE;
+		if(payloadSize > length - position || rawSize > most){
+			return false;
+		}
+		position += payloadSize;
+		if(type == FRAME_BLOCK_END){
+			return total == size;
+		}
+		total += rawSize;
+	}
+	return false;
+}
+
+/*
+ * frameDecodedSize - the size of the original data of a single frame, see
+ *                    frame_decodedSize
+ */
+static int64_t frameDecodedSize(const unsigned char *input, size_t length){
+	uint64_t size;
+
+	if(!frame_isFrame(input, length)){
+		return -1;
+	}
+	size = loadLittleEndian(input + 6, 8);
+
+	/*
+	 * No code is shorter than a bit and no symbol longer than four bytes
+	 * (a UTF-8 character of a wide block); frames beyond that need the
+	 * bounds of their block types
+	 */
+	if(size / 32 > length && !blocksHold(input, length, size)){
+		return -1;
+	}
+	if(size > INT64_MAX){
+		return -1;
+	}
+	return (int64_t)size;
+}
+
+/*
+ * frameLength - the number of bytes of the frame at the start of input,
+ *               found from its block headers
+ *
+ * Returns:     the length up to and including the end block, 0 if input
+ *              ends before it
+ */
+static size_t frameLength(const unsigned char *input, size_t length){
+	size_t position = FRAME_HEADERSIZE;
+
+	while(position + FRAME_BLOCKHEADERSIZE <= length){
+		int type = input[position] & FRAME_TYPEMASK;
+		uint64_t payloadSize = loadLittleEndian(input + position + 5, 4);
+
+		position += FRAME_BLOCKHEADERSIZE;
+		if(payloadSize > length - position){
+			return 0;
+		}
+		position += payloadSize;
+		if(type == FRAME_BLOCK_END){
+			return position;
+		}
+	}
+	return 0;
+}
+
+/*
+ * listFrames - finds the frames of a file, from its index if it has one
+ *
+ * Parameter:   spans   - receives the frames, to be deallocated with free
+ *                        if any are found
+ *
+ * Returns:     the number of frames, 0 if input doesn't start with a frame
+ *
+ * Comments:    Without an index the frames are found from their block
+ *              headers, and the search stops at anything that isn't a
+ *              frame. A frame without an end block is listed up to the
+ *              end of input, so that decoding it fails.
+ */
+static size_t listFrames(const unsigned char *input, size_t length,
+                         frameSpan **spans){
+	size_t count = 0;
+	size_t capacity = 0;
+	size_t position = 0;
+
+	*spans = NULL;
+	if(readIndex(input, length, spans, &count)){
+		return count;
+	}
+	while(frame_isFrame(input + position, length - position)){
+		size_t frame = frameLength(input + position, length - position);
+
+		if(count == capacity){
+			capacity = capacity == 0 ? 4 : capacity * 2;
+			*spans = realloc(*spans, capacity * sizeof(**spans));
+		}
+		(*spans)[count].offset = position;
+		(*spans)[count].length = frame > 0 ? frame : length - position;
+		count++;
+		if(frame == 0){
+			break;
+		}
+		position += frame;
+	}
+	return count;
+}
+
+/*
+ * readIndex - reads the frame index at the end of a file
+ *
+ * Parameter:   spans   - receives the frames, to be deallocated with free,
+ *                        NULL to only check the index
+ *              count   - receives the number of frames
+ *
+ * Returns:     true if the file ends with an index whose frames are in
+ *              order, start with frame headers and have the sizes of
+ *              those headers, false otherwise
+ */
+static bool readIndex(const unsigned char *input, size_t length,
+                      frameSpan **spans, size_t *count){
+	const unsigned char *entries;
+	uint64_t frames;
+	uint64_t start;
+	frameSpan *found;
+
+	if(length < FRAME_INDEXOVERHEAD ||
+	   memcmp(input + length - 4, indexMagic, sizeof(indexMagic))){
+		return false;
+	}
+	frames = loadLittleEndian(input + length - 8, 4);
+	if(frames == 0 || frames > (length - FRAME_INDEXOVERHEAD) /
+	                            (FRAME_INDEXENTRYSIZE + FRAME_HEADERSIZE)){
+		return false;
+	}
+	start = length - FRAME_INDEXOVERHEAD - frames * FRAME_INDEXENTRYSIZE;
+	if(memcmp(input + start, indexMagic, sizeof(indexMagic))){
+		return false;
+	}
+
+	entries = input + start + 4;
+	found = malloc(frames * sizeof(*found));
+	for(uint64_t i = 0; i < frames; i++){
+		uint64_t offset = loadLittleEndian(entries +
+		                                   i * FRAME_INDEXENTRYSIZE, 8);
+		uint64_t end = i + 1 < frames ?
+		               loadLittleEndian(entries +
+		                                (i + 1) * FRAME_INDEXENTRYSIZE, 8) :
+		               start;
+
+		if((i == 0 && offset != 0) || end <= offset || end > start ||
+		   !frame_isFrame(input + offset, (size_t)(end - offset)) ||
+		   memcmp(input + offset + 6,
+		          entries + i * FRAME_INDEXENTRYSIZE + 8, 8)){
+			free(found);
+			return false;
+		}
+		found[i].offset = offset;
+		found[i].length = end - offset;
+	}
+	if(spans != NULL){
+		*spans = found;
+		*count = (size_t)frames;
+	} else {
+		free(found);
+	}
+	return true;
+}
+
+static void writeBlockHeader(unsigned char *header, int type,
+                             uint32_t rawSize, uint32_t payloadSize){
+	header[0] = (unsigned char)type;
+	storeLittleEndian(header + 1, rawSize, 4);
+	storeLittleEndian(header + 5, payloadSize, 4);
+}
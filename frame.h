@@ -0,0 +1,327 @@
+/* The frame format - a self describing container for Huffman coded data.
+ *
+ * Unlike the legacy bitstream, a frame records the size of the original
+ * data and carries its own code tables, so it can be decoded without the
+ * frequency file and without an EOT symbol. All integers are little endian.
+ *
+ * Frame header:
+ *
+ *      offset  size    content
+ *      0       4       magic 0x89 'H' 'U' 'F'
+ *      4       1       format version (FRAME_VERSION)
+ *      5       1       flags, reserved (0)
+ *      6       8       size of the original data
+ *
+ * The header is followed by blocks, each of them holding up to a block size
+ * of the original data. Every block is coded with the cheapest of the
+ * table already in use, the models of a registry trained on frequency
+ * files (see registry.h), or a fresh table computed from the block and
+ * stored with it. The bit stream of every block starts on a byte boundary:
+ *
+ *      offset  size    content
+ *      0       1       block type (FRAME_BLOCK_*) in the low 6 bits, the
+ *                      number of substreams in the high 2 bits
+ *      1       4       size of the original data in the block
+ *      5       4       size of the payload that follows
+ *      9       ...     payload
+ *
+ * Blocks coded with a byte table (TABLE, REPEAT, GLOBAL and MODEL) may be
+ * split into 4 or 8 substreams (substream bits 1 or 2, 0 is a single
+ * stream).
+ * Substream k codes the k-th part of the block, every part but the last
+ * being the block size divided by the number of substreams, rounded up.
+ * The payload then starts with the sizes in bytes of all substreams but
+ * the last (4 bytes each), followed by the table if any, and the
+ * substreams one after the other. The decoder runs one bit reader per
+ * substream in the same loop, so the symbols of different substreams are
+ * decoded in parallel by the processor.
+ *
+ * Block types:
+ *
+ *      FRAME_BLOCK_END     the last block of the frame, no data
+ *      FRAME_BLOCK_TABLE   a serialized code table (see codetable.h)
+ *                          followed by the bits coded with that table
+ *      FRAME_BLOCK_REPEAT  bits coded with the table of the previous block
+ *      FRAME_BLOCK_GLOBAL  the fingerprint of the global escape table
+ *                          (see codeTable_fingerprint, 4 bytes, before
+ *                          the substream sizes) followed by the bits
+ *                          coded with that table, model 0 of the
+ *                          registry, which the decoder builds from the
+ *                          same frequency file as the encoder. Blocks
+ *                          whose fingerprint differs from that of the
+ *                          decoder's table don't decode.
+ *      FRAME_BLOCK_ORDER1  a serialized order-1 model (see order1.h)
+ *                          followed by the bits coded with it. The
+ *                          first context is the last byte of the
+ *                          previous block. The table used by REPEAT
+ *                          is left unchanged.
+ *      FRAME_BLOCK_WIDE    a serialized wide alphabet model (see
+ *                          alphabet.h) followed by the bits coded with
+ *                          it. The table used by REPEAT is left
+ *                          unchanged.
+ *      FRAME_BLOCK_STORED  the original data itself, used when no model
+ *                          makes the block smaller. The table used by
+ *                          REPEAT is left unchanged.
+ *      FRAME_BLOCK_MODEL   the number of a registry model (1 byte) and
+ *                          the fingerprint of its escape table (4
+ *                          bytes), before the substream sizes, followed
+ *                          by the bits coded with that table. Model 0 is
+ *                          always written as a GLOBAL block. Like GLOBAL
+ *                          blocks, the block doesn't decode if the model
+ *                          of that number in the decoder's registry has
+ *                          another fingerprint, e.g. because the
+ *                          frequency files were given in another order.
+ *      FRAME_BLOCK_LZ77    a serialized LZ77 model (see lz77.h) followed
+ *                          by the bits of the literals and matches of
+ *                          the block. Matches only reach back within the
+ *                          block, so the block decodes on its own. The
+ *                          table used by REPEAT is left unchanged.
+ *      FRAME_BLOCK_ANS     a serialized tANS model (see ans.h) followed
+ *                          by the bits coded with it, at most
+ *                          FRAME_ANS_MAXRATIO bytes per byte of payload.
+ *                          The table used by REPEAT is left unchanged.
+ *
+ * A file may hold several frames one after the other, each with its own
+ * header, tables and end block. They decode as one stream: the data of
+ * every frame follows that of the frame before. Frames are added to a file
+ * with frame_append, which writes an index after the last frame so that
+ * the next append finds the end of the frames without reading them:
+ *
+ *      offset  size    content
+ *      0       4       magic 0x89 'H' 'U' 'I'
+ *      4       16 * n  for each of the n frames, its offset in the file
+ *                      (8) and the size of its original data (8)
+ *      ...     4       n
+ *      ...     4       magic 0x89 'H' 'U' 'I'
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __FRAME_H
+#define __FRAME_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "codetable.h"
+#include "registry.h"
+
+#define FRAME_VERSION 3
+#define FRAME_HEADERSIZE 14
+#define FRAME_BLOCKHEADERSIZE 9
+
+// Default amount of original data per block
+#define FRAME_BLOCKSIZE (1 << 17)
+
+#define FRAME_BLOCK_END 0
+#define FRAME_BLOCK_TABLE 1
+#define FRAME_BLOCK_REPEAT 2
+#define FRAME_BLOCK_GLOBAL 3
+#define FRAME_BLOCK_ORDER1 4
+#define FRAME_BLOCK_WIDE 5
+#define FRAME_BLOCK_STORED 6
+#define FRAME_BLOCK_MODEL 7
+#define FRAME_BLOCK_LZ77 8
+#define FRAME_BLOCK_ANS 9
+
+#define FRAME_TYPEMASK 0x3f
+#define FRAME_STREAMSHIFT 6
+#define FRAME_MAXSTREAMS 8
+
+/*
+ * Most original bytes per payload byte of an ANS block. Moves of a byte
+ * that dominates a block may cost no bits at all, so unlike Huffman codes
+ * the bits don't bound the size of the block.
+ */
+#define FRAME_ANS_MAXRATIO 4096
+
+// Blocks smaller than this are never split into substreams
+#define FRAME_STREAMS_MINSIZE 4096
+
+// Bytes of the frame index besides its entries, and bytes per entry
+#define FRAME_INDEXOVERHEAD 12
+#define FRAME_INDEXENTRYSIZE 16
+
+// Bytes of the fingerprint of a registry model in a block
+#define FRAME_FINGERPRINTSIZE 4
+
+// Most threads frame_decodeInto decodes with
+#define FRAME_MAXTHREADS 64
+
+/*
+ * Struct 'frameOptions'
+ * Settings of the frame encoder
+ *
+ *      blockSize   - amount of original data per block (> 0)
+ *      models      - the registry of models trained on frequency
+ *                    files, NULL or empty if there is none
+ *      order1      - also consider coding blocks with an order-1 model
+ *      alphabet    - also consider coding blocks with this wide alphabet
+ *                    (ALPHABET_UTF8 or ALPHABET_PAIR), ALPHABET_BYTE for
+ *                    bytes only
+ *      streams     - number of substreams of blocks coded with a byte
+ *                    table: 1, 4 or 8
+ *      lzLevel     - also consider coding blocks with LZ77 matching at
+ *                    this level (see lz77.h), 0 for never
+ *      lzWindow    - longest distance of an LZ77 match, 0 for the block
+ *                    size. Matches stay inside their block, so larger
+ *                    windows are cut down to the block size
+ *      ans         - also consider coding blocks with tANS (see ans.h)
+ */
+typedef struct {
+    size_t blockSize;
+    const modelRegistry *models;
+    bool order1;
+    int alphabet;
+    int streams;
+    int lzLevel;
+    size_t lzWindow;
+    bool ans;
+} frameOptions;
+
+/*
+ * frame_isFrame - checks if a buffer starts with a frame header
+ */
+bool frame_isFrame(const unsigned char *data, size_t length);
+
+/*
+ * frame_defaultOptions - fills in the default encoder settings: blocks of
+ *                        FRAME_BLOCKSIZE bytes, no models, no
+ *                        order-1 models, no wide alphabet, a single
+ *                        stream per block, no LZ77 matching (with a
+ *                        window of a block once it is turned on) and
+ *                        no tANS
+ */
+void frame_defaultOptions(frameOptions *options);
+
+/*
+ * frame_encode - encodes a buffer as a frame
+ *
+ * Parameter:   input   - the data to encode
+ *              length  - number of bytes in input
+ *              options - encoder settings
+ *              output  - file that receives the frame
+ *
+ * Returns:     number of bytes written, 0 on write errors
+ *
+ * Comments:    Every block is read twice, once for its histogram and once
+ *              for coding, so the input should be in memory (see
+ *              mapfile.h). The table of each block is chosen by comparing
+ *              the exact coded sizes (including the size of a stored
+ *              table) of the candidate tables on the block's histogram.
+ *              Blocks that would not shrink are stored, so the frame is
+ *              never more than FRAME_BLOCKHEADERSIZE bytes per block
+ *              larger than the input (plus the frame header and the end
+ *              block).
+ */
+uint64_t frame_encode(const unsigned char *input, size_t length,
+                      const frameOptions *options, FILE *output);
+
+/*
+ * frame_maxEncodedSize - the largest frame frame_encode writes for length
+ *                        bytes of input in blocks of blockSize
+ */
+uint64_t frame_maxEncodedSize(uint64_t length, size_t blockSize);
+
+/*
+ * frame_encodeInto - like frame_encode, but writes the frame to memory
+ *
+ * Parameter:   output      - buffer that receives the frame
+ *              capacity    - size of output, frame_maxEncodedSize is
+ *                            always enough
+ *
+ * Returns:     number of bytes written, 0 if output is too small
+ */
+uint64_t frame_encodeInto(const unsigned char *input, size_t length,
+                          const frameOptions *options, unsigned char *output,
+                          size_t capacity);
+
+/*
+ * frame_appendOffset - finds where frame_append puts the next frame of a
+ *                      file
+ *
+ * Parameter:   file    - the contents of the file
+ *              length  - number of bytes in file
+ *
+ * Returns:     the offset after the last frame, where the index starts if
+ *              the file has one, 0 for an empty file, -1 if the file holds
+ *              anything but frames and their index
+ */
+int64_t frame_appendOffset(const unsigned char *file, size_t length);
+
+/*
+ * frame_append - encodes a buffer as a frame that follows the frames of a
+ *                file and writes the index of all of them after it
+ *
+ * Parameter:   file            - the contents of the file
+ *              fileLength      - number of bytes in file
+ *              input, length,
+ *              options         - see frame_encode
+ *              output          - the file, opened for writing and
+ *                                positioned at frame_appendOffset
+ *
+ * Returns:     number of bytes written, 0 if the file holds anything but
+ *              frames and their index, or on write errors
+ *
+ * Comments:    The frames already in the file are neither decoded nor
+ *              copied; with an index only the index is read, so an
+ *              append costs the new data and the index. The new frame
+ *              and index are always longer than the old index, so the
+ *              file never needs to be cut.
+ */
+uint64_t frame_append(const unsigned char *file, size_t fileLength,
+                      const unsigned char *input, size_t length,
+                      const frameOptions *options, FILE *output);
+
+/*
+ * frame_decode - decodes a frame, or all frames of a file one after the
+ *                other
+ *
+ * Parameter:   input           - the frames
+ *              length          - number of bytes in input
+ *              models          - the registry used by the encoder, NULL if
+ *                                no frequency file is available
+ *              output          - file that receives the decoded data
+ *
+ * Returns:     number of bytes decoded, -1 if the frame is corrupt, needs a
+ *              model that wasn't given or the output couldn't be written
+ */
+int64_t frame_decode(const unsigned char *input, size_t length,
+                     const modelRegistry *models, FILE *output);
+
+/*
+ * frame_decodedSize - the size of the original data of the frames, from
+ *                     their headers
+ *
+ * Returns:     the size, -1 if input doesn't start with a frame header or
+ *              the size of a frame is more than its bytes can hold
+ *
+ * Comments:    Frames that claim more than 32 bytes per byte of frame are
+ *              only believed if the sizes of their blocks add up to it and
+ *              every block can hold its share.
+ */
+int64_t frame_decodedSize(const unsigned char *input, size_t length);
+
+/*
+ * frame_decodeInto - like frame_decode, but decodes to memory with up to
+ *                    threads threads
+ *
+ * Parameter:   output  - buffer of frame_decodedSize bytes that receives
+ *                        the decoded data
+ *              threads - number of threads (<= FRAME_MAXTHREADS), 1 to
+ *                        decode in the calling thread only
+ *
+ * Returns:     see frame_decode
+ *
+ * Comments:    Every block is decoded straight to its place in output.
+ *              Frames with only byte table, LZ77 and stored blocks are
+ *              decoded by threads workers, each taking the next block;
+ *              order-1 and wide alphabet blocks need the blocks before
+ *              them, so frames with such blocks are decoded in order.
+ */
+int64_t frame_decodeInto(const unsigned char *input, size_t length,
+                         const modelRegistry *models, unsigned char *output,
+                         int threads);
+
+#endif
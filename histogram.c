@@ -0,0 +1,142 @@
+/* Implementation of the datatype 'histogram', see histogram.h for the
+ * description of the file format.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "histogram.h"
+#include "bitio.h"
+
+static const unsigned char histogramMagic[8] = "HUFHIST";
+
+static uint64_t scaleCount(uint64_t count, double factor);
+static uint64_t addSaturated(uint64_t a, uint64_t b);
+
+histogram *histogram_empty(void){
+	return calloc(1, sizeof(histogram));
+}
+
+void histogram_addBytes(histogram *h, const unsigned char *buffer,
+                        size_t length){
+	for(size_t i = 0; i < length; i++){
+		h->count[buffer[i]]++;
+	}
+}
+
+uint64_t histogram_addFile(histogram *h, FILE *file){
+	unsigned char buffer[1 << 16];
+	size_t readBytes;
+	uint64_t total = 0;
+
+	while((readBytes = fread(buffer, 1, sizeof(buffer), file)) > 0){
+		histogram_addBytes(h, buffer, readBytes);
+		total += readBytes;
+	}
+	return total;
+}
+
+void histogram_merge(histogram *h, const histogram *other, double weight){
+	for(int i = 0; i < HISTOGRAM_SYMBOLS; i++){
+		h->count[i] = addSaturated(h->count[i],
+		                           scaleCount(other->count[i], weight));
+	}
+}
+
+void histogram_decay(histogram *h, double factor){
+	for(int i = 0; i < HISTOGRAM_SYMBOLS; i++){
+		h->count[i] = scaleCount(h->count[i], factor);
+	}
+}
+
+uint64_t histogram_total(const histogram *h){
+	uint64_t total = 0;
+	for(int i = 0; i < HISTOGRAM_SYMBOLS; i++){
+		total = addSaturated(total, h->count[i]);
+	}
+	return total;
+}
+
+bool histogram_isHistogramFile(FILE *file){
+	unsigned char magic[sizeof(histogramMagic)];
+	long position = ftell(file);
+	size_t readBytes = fread(magic, 1, sizeof(magic), file);
+
+	fseek(file, position, SEEK_SET);
+	return readBytes == sizeof(magic) &&
+	       !memcmp(magic, histogramMagic, sizeof(magic));
+}
+
+int histogram_load(histogram *h, FILE *file){
+	if(histogram_isHistogramFile(file)){
+		return histogram_read(h, file);
+	}
+	histogram_addFile(h, file);
+	return 0;
+}
+
+int histogram_read(histogram *h, FILE *file){
+	unsigned char header[16];
+	unsigned char counts[8 * HISTOGRAM_SYMBOLS];
+
+	if(fread(header, 1, sizeof(header), file) != sizeof(header) ||
+	   memcmp(header, histogramMagic, sizeof(histogramMagic)) ||
+	   loadLittleEndian(header + 8, 4) != HISTOGRAM_VERSION ||
+	   loadLittleEndian(header + 12, 4) != HISTOGRAM_SYMBOLS){
+		return -1;
+	}
+	if(fread(counts, 1, sizeof(counts), file) != sizeof(counts)){
+		return -1;
+	}
+	for(int i = 0; i < HISTOGRAM_SYMBOLS; i++){
+		h->count[i] = loadLittleEndian(counts + 8 * i, 8);
+	}
+	return 0;
+}
+
+int histogram_write(const histogram *h, FILE *file){
+	unsigned char header[16];
+	unsigned char counts[8 * HISTOGRAM_SYMBOLS];
+
+	memcpy(header, histogramMagic, sizeof(histogramMagic));
+	storeLittleEndian(header + 8, HISTOGRAM_VERSION, 4);
+	storeLittleEndian(header + 12, HISTOGRAM_SYMBOLS, 4);
+	for(int i = 0; i < HISTOGRAM_SYMBOLS; i++){
+		storeLittleEndian(counts + 8 * i, h->count[i], 8);
+	}
+	if(fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+	   fwrite(counts, 1, sizeof(counts), file) != sizeof(counts)){
+		return -1;
+	}
+	return 0;
+}
+
+void histogram_free(histogram *h){
+	free(h);
+}
+
+/*
+ * scaleCount - multiplies a count with a non-negative factor, rounding to
+ *              the nearest integer but never letting a seen symbol reach 0
+ *              unless the factor itself is 0.
+ */
+static uint64_t scaleCount(uint64_t count, double factor){
+	double scaled;
+
+	if(count == 0 || factor <= 0){
+		return 0;
+	}
+	scaled = (double)count * factor + 0.5;
+	if(scaled >= 18446744073709551615.0){
+		return UINT64_MAX;
+	}
+	if(scaled < 1){
+		return 1;
+	}
+	return (uint64_t)scaled;
+}
+
+static uint64_t addSaturated(uint64_t a, uint64_t b){
+	return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+}
@@ -0,0 +1,136 @@
+/* Datatype 'histogram' - a symbol frequency table with 64-bit counts that
+ * can be stored in a binary file, folded together with new training data,
+ * merged with other histograms and decayed.
+ *
+ * File format (all integers little endian):
+ *
+ *      offset  size    content
+ *      0       8       magic "HUFHIST\0"
+ *      8       4       format version (HISTOGRAM_VERSION)
+ *      12      4       number of symbols (HISTOGRAM_SYMBOLS)
+ *      16      8*256   count of each symbol
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HISTOGRAM_SYMBOLS 256
+#define HISTOGRAM_VERSION 1
+
+typedef struct {
+    uint64_t count[HISTOGRAM_SYMBOLS];
+} histogram;
+
+/*
+ * histogram_empty - creates a histogram where all counts are zero
+ *
+ * Returns:     pointer to the new histogram, NULL if out of memory.
+ *              Deallocate with histogram_free.
+ */
+histogram *histogram_empty(void);
+
+/*
+ * histogram_addBytes - folds a buffer of raw bytes into the histogram
+ *
+ * Parameter:   h       - the histogram to update
+ *              buffer  - bytes to count
+ *              length  - number of bytes in buffer
+ */
+void histogram_addBytes(histogram *h, const unsigned char *buffer,
+                        size_t length);
+
+/*
+ * histogram_addFile - folds all bytes from the current position to the end
+ *                     of a file into the histogram
+ *
+ * Parameter:   h       - the histogram to update
+ *              file    - file opened for reading
+ *
+ * Returns:     number of bytes read from file
+ */
+uint64_t histogram_addFile(histogram *h, FILE *file);
+
+/*
+ * histogram_merge - adds the counts of another histogram multiplied with a
+ *                   weight
+ *
+ * Parameter:   h       - the histogram to update
+ *              other   - the histogram to merge into h
+ *              weight  - factor applied to every count of other (>= 0)
+ *
+ * Comments:    Scaled counts are rounded to the nearest integer, but a
+ *              symbol seen in other never drops to zero unless weight is 0.
+ *              Sums saturate at UINT64_MAX.
+ */
+void histogram_merge(histogram *h, const histogram *other, double weight);
+
+/*
+ * histogram_decay - multiplies every count by a factor in [0, 1] to let
+ *                   old training data fade out
+ *
+ * Parameter:   h       - the histogram to update
+ *              factor  - decay factor
+ *
+ * Comments:    Symbols that have been seen keep a count of at least 1 as
+ *              long as factor > 0.
+ */
+void histogram_decay(histogram *h, double factor);
+
+/*
+ * histogram_total - sums all counts of the histogram
+ *
+ * Returns:     the total count, saturated at UINT64_MAX
+ */
+uint64_t histogram_total(const histogram *h);
+
+/*
+ * histogram_isHistogramFile - checks if a file starts with the histogram
+ *                             magic
+ *
+ * Parameter:   file    - seekable file opened for reading
+ *
+ * Comments:    The file position is restored before returning.
+ */
+bool histogram_isHistogramFile(FILE *file);
+
+/*
+ * histogram_load - reads a histogram file, or counts the bytes of any
+ *                  other file
+ *
+ * Parameter:   h       - empty histogram that receives the counts
+ *              file    - seekable file opened for reading
+ *
+ * Returns:     0 on success, -1 if a histogram file is corrupt
+ */
+int histogram_load(histogram *h, FILE *file);
+
+/*
+ * histogram_read - reads a histogram file
+ *
+ * Parameter:   h       - histogram that receives the counts
+ *              file    - file positioned at the histogram magic
+ *
+ * Returns:     0 on success, -1 if the file is not a valid histogram
+ */
+int histogram_read(histogram *h, FILE *file);
+
+/*
+ * histogram_write - writes the histogram in the binary file format
+ *
+ * Returns:     0 on success, -1 on write errors
+ */
+int histogram_write(const histogram *h, FILE *file);
+
+/*
+ * histogram_free - deallocates the histogram
+ */
+void histogram_free(histogram *h);
+
+#endif
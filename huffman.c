@@ -4,13 +4,75 @@
  * The program is implemented as command line application
  *
  * Parameter:	- [-encode]/[-decode]
+ * 				- [OPTIONS] -blocksize N, -order1, -alphabet A,
+ * 				  -lz LEVEL, -window N, -ans, -streams N,
+ * 				  -legacy
+ * 				  (see parseOptions)
  * 				- [FILE1] text file that will be used to build
- * 				  the frequency table
+ * 				  the frequency table, or a histogram file
+ * 				  built with -train
  * 				- [FILE2] input that will be encoded/decoded
  * 				  depending on the first argument
  * 				- [FILE3] file name of output file that will
  * 				  be either huffman encoded or plain text.
  *
+ * 	            - [-train] [-decay FACTOR] HISTFILE FILE...
+ * 	              folds FILE... into the histogram file HISTFILE,
+ * 	              optionally decaying the old counts first
+ * 	            - [-merge] OUTFILE HISTFILE[:WEIGHT]...
+ * 	              sums weighted histogram files into OUTFILE
+ * 	            - [-auto] [OPTIONS] FILE1 FILE2
+ * 	              encodes FILE1 with code tables computed from FILE1
+ * 	              itself and stores tables and code in FILE2. Such
+ * 	              files are decoded with -decode FILE1 FILE2, FILE0
+ * 	              is not needed.
+ * 	            - [-auto]/[-encode] -append [OPTIONS] [FILE0] FILE1
+ * 	              FILE2
+ * 	              adds FILE1 as a new frame to the end of FILE2
+ * 	              without decoding what is already there
+ *
+ * 	            - [-adaptive] [-rebuild N] FILE1 FILE2
+ * 	              encodes FILE1 in one pass with adaptive Huffman
+ * 	              coding (see adaptive.h). "-" stands for standard
+ * 	              input / output. Decoded with -decode FILE1 FILE2.
+ *
+ * 	            - [-encode]/[-decode] -builtin [OPTIONS] FILE1 FILE2
+ * 	              like -encode / -decode with the model compiled
+ * 	              into the program (see builtin.h) in place of FILE0
+ *
+ * 	            - [-encode] -records [-builtin] [FILE0] FILE1 FILE2
+ * 	              codes every line of FILE1 as a record of its own
+ * 	              with the global table of FILE0 or the built in
+ * 	              model. Decoded with -decode [-builtin] [FILE0].
+ *
+ * 	            - [-encode]/[-decode] -batch LIST [-threads N]
+ * 	              [OPTIONS] [FILE0]
+ * 	              codes every file named in LIST with one model
+ * 	              built from FILE0 (or -builtin) on N workers
+ *
+ * 	            - [-serve] [-threads N] [OPTIONS] SOCKET [FILE0]
+ * 	              serves encode and decode requests on the Unix
+ * 	              socket SOCKET with the models of FILE0 (or
+ * 	              -builtin), see daemon.h. SIGHUP loads them again.
+ * 	            - [-encode]/[-decode] -connect SOCKET FILE1 FILE2
+ * 	              has the daemon at SOCKET code FILE1
+ * 	            - [-loadgen] [-threads N] [-requests N] SOCKET FILE1
+ * 	              measures throughput and latency of the daemon at
+ * 	              SOCKET coding FILE1 over N connections
+ *
+ * 	            - [-dryrun] [-blocksize N] [-builtin] [-legacy] FILE1
+ * 	              [FILE0...]
+ * 	              prints the exact coded size of FILE1 with every
+ * 	              model without coding it
+ *
+ * 	            -encode writes the frame format (see frame.h) where
+ * 	            every block uses the table of FILE1, the table of the
+ * 	            previous block or a table of its own, whichever is
+ * 	            smallest. FILE1 may also be several files separated
+ * 	            by commas, each block then uses the best of their
+ * 	            tables (see registry.h). -legacy selects the original
+ * 	            bitstream.
+ *
  * 	Output:     - the program returns 0 upon completion
  *
  * 	Comments:   The program uses the datatypes 'tree_3cell',
@@ -23,34 +85,102 @@
  * and Lorenz Gerber <dv15lgr@cs.umu.se>
  * February 18, 2016.
  */
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <inttypes.h>
 #include "tree_3cell.h"
 #include "prioqueue.h"
 #include "bitset.h"
+#include "histogram.h"
+#include "huffmantree.h"
+#include "mapfile.h"
+#include "frame.h"
+#include "adaptive.h"
+#include "alphabet.h"
+#include "lz77.h"
+#include "kernels.h"
+#include "builtin.h"
+#include "record.h"
+#include "batch.h"
+#include "ioring.h"
+#include "outmap.h"
+#include "registry.h"
+#include "daemon.h"
+#include "legacy.h"
 
 
+#define MAXBITSIZE 30
+
+// Requests -loadgen sends of each kind when -requests isn't given
+#define LOADGEN_REQUESTS 10000
+
 /*
- * Struct 'freqChar'
- * Node for 'tree_3cell' datatype that allows
- * to store both a frequency and a character value
+ * Struct 'cliOptions'
+ * Settings given between the mode and the file names, see parseOptions
  */
 typedef struct {
-  int value;
-  unsigned char character;
-} freqChar;
+    frameOptions frame;
+    bool legacy;
+    bool builtin;
+    bool records;
+    bool append;
+    char *batchList;
+    char *socketPath;
+    int threads;
+    bool asyncIo;
+    uint32_t rebuildInterval;
+    uint64_t requests;
+} cliOptions;
 
-#define MAXBITSIZE 30
+/*
+ * Struct 'modelSource'
+ * Where the models of a daemon are loaded from, see reloadModels
+ */
+typedef struct {
+    char *freqPath;
+    const cliOptions *options;
+} modelSource;
 
-void getFrequency(int *frequency, FILE* file);
-int compareTrees(VALUE tree1, VALUE tree2);
-binary_tree *buildHuffmanTree (int *frequency, int (*compare)(VALUE, VALUE));
+int getFrequency(uint64_t *frequency, FILE* file);
 void traverseTree(binaryTree_pos pos,
                   binary_tree *huffmanTree, int navPath[],
                   int freeIndex, bitset *pathArray[]);
 void encodeFile(FILE* encodeThis, FILE* output, bitset *pathArray[]);
-void decodeFile(FILE* decodeThis, FILE* output, binary_tree* huffmanTree);
+void decodeFile(FILE* decodeThis, FILE* output, binary_tree* huffmanTree,
+                int threads);
+int parseOptions(int argc, char **argv, cliOptions *options);
+modelRegistry *loadModels(char *freqPath, const cliOptions *options);
+int encodeFrame(char *freqPath, char *inPath, char *outPath,
+                cliOptions *options);
+int decodeFrame(char *freqPath, char *inPath, char *outPath,
+                const cliOptions *options);
+int writeFrame(const mapped_file *input, char *outPath,
+               const frameOptions *options, ioring *ring,
+               uint64_t *writeBytes);
+int appendFrame(const mapped_file *input, char *outPath,
+                const frameOptions *options, uint64_t *writeBytes);
+bool isFrameFile(FILE *file);
+int encodeRecords(char *freqPath, char *inPath, char *outPath);
+int decodeRecords(char *freqPath, char *inPath, char *outPath);
+bool isRecordFile(char *path);
+int batchCode(bool encode, char *freqPath, cliOptions *options);
+int serve(char *socketPath, char *freqPath, const cliOptions *options);
+modelRegistry *reloadModels(void *context);
+int remoteCode(bool encode, char *socketPath, char *inPath, char *outPath);
+int loadGenerator(char *socketPath, char *inPath,
+                  const cliOptions *options);
+int adaptiveCode(bool encode, char *inPath, char *outPath,
+                 uint32_t rebuildInterval);
+bool isAdaptiveFile(char *path);
+int dryRun(char *inPath, char **models, int modelCount,
+           const cliOptions *options);
+uint64_t legacyCost(char *freqPath, const uint64_t *frequency);
+int trainHistogram(int argc, char **argv);
+int mergeHistograms(int argc, char **argv);
 int wrongArgs(void);
 
 int main(int argc, char **argv){
@@ -59,17 +189,174 @@ int main(int argc, char **argv){
     /*
      * Variables
      */
-    int frequency[256] = { 0 };
+    uint64_t frequency[256] = { 0 };
 	int navPath[MAXBITSIZE] = {-1};
 	int freeIndex = 0;
 
 
+	// Pick the coding kernels for this processor once, up front
+	kernels_get();
+
+
+	/*
+	 * The histogram modes take a variable number of files and are handled
+	 * separately from encode / decode
+	 */
+	if(argc > 1 && !strcmp(argv[1], "-train")){
+		return trainHistogram(argc, argv);
+	}
+	if(argc > 1 && !strcmp(argv[1], "-merge")){
+		return mergeHistograms(argc, argv);
+	}
+
+
+	/*
+	 * Options come between the mode and the file names
+	 */
+	if(argc < 2){
+		return wrongArgs();
+	}
+	cliOptions options;
+	frame_defaultOptions(&options.frame);
+	options.legacy = false;
+	options.builtin = false;
+	options.records = false;
+	options.append = false;
+	options.batchList = NULL;
+	options.socketPath = NULL;
+	options.threads = 0;
+	options.asyncIo = false;
+	options.rebuildInterval = ADAPTIVE_REBUILD;
+	options.requests = LOADGEN_REQUESTS;
+	int argIndex = parseOptions(argc, argv, &options);
+	if(argIndex < 0){
+		return wrongArgs();
+	}
+	int files = argc - argIndex;
+
+	// Only frames can be appended to, see frame.h
+	if(options.append && (options.legacy || options.records ||
+	   options.batchList != NULL || options.socketPath != NULL)){
+		return wrongArgs();
+	}
+
+	/*
+	 * A dry run only measures, it writes nothing. It knows the costs of
+	 * byte tables only, blocks of other models aren't estimated.
+	 */
+	if(files >= 1 && !strcmp(argv[1], "-dryrun")){
+		if(options.frame.order1 || options.frame.alphabet != ALPHABET_BYTE ||
+		   options.frame.lzLevel > 0 || options.frame.ans ||
+		   options.frame.streams > 1){
+			fprintf(stderr, "-dryrun can't estimate -order1, -alphabet, "
+			        "-lz, -ans or -streams\n");
+			return wrongArgs();
+		}
+		return dryRun(argv[argIndex], argv + argIndex + 1, files - 1,
+		              &options);
+	}
+
+	/*
+	 * The daemon and its clients, see daemon.h
+	 */
+	if(!strcmp(argv[1], "-serve")){
+		if(files < 1 || files > 2 || (files == 2 && options.builtin)){
+			return wrongArgs();
+		}
+		return serve(argv[argIndex], files == 2 ? argv[argIndex + 1] : NULL,
+		             &options);
+	}
+	if(!strcmp(argv[1], "-loadgen")){
+		if(files != 2){
+			return wrongArgs();
+		}
+		return loadGenerator(argv[argIndex], argv[argIndex + 1], &options);
+	}
+	if(options.socketPath != NULL){
+		bool encode = !strcmp(argv[1], "-encode");
+		if((!encode && strcmp(argv[1], "-decode")) || files != 2){
+			return wrongArgs();
+		}
+		return remoteCode(encode, options.socketPath, argv[argIndex],
+		                  argv[argIndex + 1]);
+	}
+
+	/*
+	 * A batch builds the model once for all files of its list
+	 */
+	if(options.batchList != NULL){
+		bool encode = !strcmp(argv[1], "-encode");
+		if((!encode && strcmp(argv[1], "-decode")) || files > 1 ||
+		   (files == 1 && options.builtin) ||
+		   (encode && files == 0 && !options.builtin)){
+			return wrongArgs();
+		}
+		return batchCode(encode, files == 1 ? argv[argIndex] : NULL,
+		                 &options);
+	}
+
+	/*
+	 * Frames carry their own tables, so neither encoding in -auto mode nor
+	 * decoding them needs a frequency file. -encode writes frames that may
+	 * also use the table of the frequency file, unless -legacy is given.
+	 */
+	if(files == 2 && !strcmp(argv[1], "-auto")){
+		return encodeFrame(NULL, argv[argIndex], argv[argIndex + 1],
+		                   &options);
+	}
+	if(files == 2 && !strcmp(argv[1], "-decode")){
+		if(isRecordFile(argv[argIndex])){
+			return decodeRecords(NULL, argv[argIndex], argv[argIndex + 1]);
+		}
+		if(isAdaptiveFile(argv[argIndex])){
+			return adaptiveCode(false, argv[argIndex], argv[argIndex + 1], 0);
+		}
+		return decodeFrame(NULL, argv[argIndex], argv[argIndex + 1],
+		                   &options);
+	}
+	if(options.records && !strcmp(argv[1], "-encode")){
+		if(files == 2 && options.builtin){
+			return encodeRecords(NULL, argv[argIndex], argv[argIndex + 1]);
+		}
+		if(files == 3 && !options.builtin){
+			return encodeRecords(argv[argIndex], argv[argIndex + 1],
+			                     argv[argIndex + 2]);
+		}
+		return wrongArgs();
+	}
+	if(files == 2 && options.builtin && !strcmp(argv[1], "-encode")){
+		return encodeFrame(NULL, argv[argIndex], argv[argIndex + 1],
+		                   &options);
+	}
+	if(files == 3 && !options.legacy && !strcmp(argv[1], "-decode") &&
+	   isRecordFile(argv[argIndex + 1])){
+		return decodeRecords(argv[argIndex], argv[argIndex + 1],
+		                     argv[argIndex + 2]);
+	}
+	if(files == 3 && !options.legacy && !strcmp(argv[1], "-encode")){
+		return encodeFrame(argv[argIndex], argv[argIndex + 1],
+		                   argv[argIndex + 2], &options);
+	}
+
+
+	/*
+	 * Adaptive streams need no model at all and are coded in one pass
+	 */
+	if(files == 2 && !strcmp(argv[1], "-adaptive")){
+		return adaptiveCode(true, argv[argIndex], argv[argIndex + 1],
+		                    options.rebuildInterval);
+	}
+
+
 	/*
 	 * Check number of command line arguments
 	 */
-    if(argc <= 4){
+    if(files != 3){
 		return wrongArgs();
 	}
+	char *freqPath = argv[argIndex];
+	char *inPath = argv[argIndex + 1];
+	char *outPath = argv[argIndex + 2];
 
 
 	/*
@@ -92,28 +379,45 @@ int main(int argc, char **argv){
 	/*
 	 * Check and open files
 	 */
-    FILE* freqFilep = fopen(argv[2], "rt");
-	if(freqFilep == NULL){
-		fprintf(stderr, "Couldn't open frequency file %s\n", argv[2]);
-		return wrongArgs();
-	}
-
 	FILE *infilep;
 	if (selector == 1) {
-		infilep = fopen(argv[3], "rt");
+		infilep = fopen(inPath, "rt");
 	} else {
-		infilep = fopen(argv[3], "rb");
+		infilep = fopen(inPath, "rb");
 	}
 
 	if(infilep == NULL){
-		fprintf(stderr, "Couldn't open input file %s\n", argv[3]);
+		fprintf(stderr, "Couldn't open input file %s\n", inPath);
+		return wrongArgs();
+	}
+
+	/*
+	 * Frames bring their own tables and use FILE0 only for the models,
+	 * which may be several files (see loadModels)
+	 */
+	if(selector == 2 && !options.legacy && isFrameFile(infilep)){
+		fclose(infilep);
+		return decodeFrame(freqPath, inPath, outPath, &options);
+	}
+
+    FILE* freqFilep = fopen(freqPath, "rt");
+	if(freqFilep == NULL){
+		fprintf(stderr, "Couldn't open frequency file %s\n", freqPath);
 		return wrongArgs();
 	}
 
-	FILE *outfilep = fopen(argv[4], "w");
+	// The tree of a legacy stream is that of FILE0, it has to be intact
+	if(getFrequency(frequency, freqFilep) != 0){
+		fprintf(stderr, "Corrupt histogram file %s\n", freqPath);
+		fclose(freqFilep);
+		fclose(infilep);
+		return EXIT_FAILURE;
+	}
+
+	FILE *outfilep = fopen(outPath, "w");
 
 	if(outfilep == NULL){
-		fprintf(stderr, "Couldn't open output file %s\n", argv[4]);
+		fprintf(stderr, "Couldn't open output file %s\n", outPath);
 		return wrongArgs();
 	}
 
@@ -124,9 +428,6 @@ int main(int argc, char **argv){
      */
     switch(selector) {
 		case 1:
-			// Make frequency table
-			getFrequency(frequency, freqFilep);
-			
 			// Build huffman tree
 			binary_tree *treeEncode = buildHuffmanTree(frequency, compareTrees);
 			
@@ -147,20 +448,19 @@ int main(int argc, char **argv){
 			// Screen output
             long readBytes = ftell(infilep);
             long writeBytes = ftell(outfilep);
-			printf("%ld bytes read from %s.\n", readBytes, argv[3]);
+			printf("%ld bytes read from %s.\n", readBytes, inPath);
 			printf("%ld bytes used in encoded form.\n", writeBytes);
 			break;
 			
 		case 2:
 
-			// Make frequency table
-			getFrequency(frequency, freqFilep);
-			
 			// Build huffman tree
 			binary_tree *treeDecode = buildHuffmanTree(frequency, compareTrees);
 
 			// Decode the input file
-			decodeFile(infilep, outfilep, treeDecode);
+			decodeFile(infilep, outfilep, treeDecode,
+			           options.threads > 0 ? options.threads :
+			                                 batch_defaultThreads());
 
 			binaryTree_free(treeDecode);
 			break;
@@ -184,30 +484,43 @@ int main(int argc, char **argv){
  * getFrequency - calculates a frequency table on an text input file
  *                using the 256 characters of the extended ASCII table.
  *
- * Parameter:   frequency - pointer to an int array of length 256. Here the
+ * Parameter:   frequency - pointer to an array of length 256. Here the
  *                          frequencies will be summed and stored
  *              file      - pointer of type FILE. The input file has to be
- *                          a standard text file.
+ *                          a standard text file or a histogram file
+ *                          written by the -train / -merge modes.
+ *
+ * Returns:     0 on success, -1 if the file is a corrupt or truncated
+ *              histogram file
+ *
+ * Counts are summed in 64 bits, so text files of any size can be used.
+ * When the total is larger than the int range the tree labels had in
+ * earlier versions, all counts are scaled down proportionally, keeping
+ * every seen character at a count of at least 1. Legacy streams carry no
+ * model, so the tree built here has to stay the same one that earlier
+ * versions built from the same file.
  */
-void getFrequency(int* frequency, FILE* file){
-	int finished=0;
-	int ch;
+int getFrequency(uint64_t *frequency, FILE* file){
+	histogram *counts = histogram_empty();
+	uint64_t limit = INT_MAX / 1000 - 2 * HISTOGRAM_SYMBOLS;
+	uint64_t total;
 	
 	// Increase freqeuncy of EOT character by 1
 	frequency[4]++;
 	
-	while (finished!=1){
-		ch = fgetc(file);
-
-        // Stop reading at EOF
-		if (ch == EOF){
-			finished=1;
-		} else {
-
-			// increase the frequency of the character read
-			frequency[ch]++;
-		}
+	if(histogram_load(counts, file) != 0){
+		histogram_free(counts);
+		return -1;
+	}
+	total = histogram_total(counts);
+	if(total > limit){
+		histogram_decay(counts, (double)(limit - HISTOGRAM_SYMBOLS) /
+		                        (double)total);
 	}
+	for(int iii = 0; iii < 256; iii++){
+		frequency[iii] += counts->count[iii];
+	}
+	histogram_free(counts);
 	
 	/*
 	 * The following lines solve the problem high high numbers of zero frequency
@@ -223,141 +536,6 @@ void getFrequency(int* frequency, FILE* file){
 			frequency[iii]=1;
 		}
 	}
-}
-
-/*
- * compareTrees - is the compare function used in the priorityQueue datatype
- *
- * Paramter:    tree1   - pointer to a binary tree datatype
- *              tree2   - pointer to a binary tree dataype
- *
- * Comments:    This function assumes a freqChar struct to be stored as
- *              the label of the binary tree. The actual comparison is done
- *              between the 'value' of each tree's root.
- */
-int compareTrees(VALUE tree1, VALUE tree2){
-	freqChar tmp1;
-	freqChar tmp2;
-	tmp1 = *(freqChar*)binaryTree_inspectLabel(tree1, binaryTree_root(tree1));
-	tmp2 = *(freqChar*)binaryTree_inspectLabel(tree2, binaryTree_root(tree2));
-	
-	// Compares the frequency value in the struct
-	if (tmp1.value > tmp2.value){
-		return 0;
-	}
-	else{
-		return 1;
-	}
-}
-
-/*
- * buildHuffmanTree:    - This function builds a huffman tree from a frequency 
- *                        table
- *
- * Parameter:           frequency   - a pointer to an int array of length 256 
- *                                    that represents an extended ASCII 
- *                                    character frequency table generated by 
- *                                    the function getFrequency
- *                      compare     - pointer to a function that compares the 
- *                                    root label of the two binary trees. This 
- *                                    function will be used as argument for the 
- *                                    priority queue datatype.
- *
- *  The function first makes root/leafs for all 256 characters in the extended 
- *  ASCII table and puts them in a priority queue (datatype pqueue from 
- *  prioqueue.c /.h). Then in a while loop, two elements at a time are removed 
- *  from the priority queue. And linked into a new binary tree root. The label 
- *  of the new tree root contains as value the combined values of the two 
- *  children. This is repeated until just one element is left in the priority 
- *  queue.
- */
-binary_tree *buildHuffmanTree (int *frequency, int (*compare)(VALUE, VALUE)){
-	pqueue *treebuildingQueue = pqueue_empty (compare);
-    int allChars;
-	binary_tree *tree1;
-	binary_tree *tree2;
-	binary_tree *newTree; 
-	
-	/*
-	 * Create one tree for each character and put all of them in a
-	 * priority queue.
-	 */
-	for (allChars = 0; allChars < 256; allChars++){
-		freqChar *nodeLabel = malloc(sizeof(freqChar));
-		nodeLabel->character = allChars;
-		nodeLabel->value = frequency[allChars];
-		newTree = binaryTree_create(); 
-		binaryTree_setMemHandler(newTree, free);
-		binaryTree_setLabel(newTree, nodeLabel, binaryTree_root(newTree));
-		pqueue_insert(treebuildingQueue, newTree);
-	}
-	
-
-    /*
-	 * While priority queue isn't empty take out the two front values and
-	 * connect these two trees with a new node (tree), put this new combined
-	 * tree in the queue.
-	 */
-    while(!pqueue_isEmpty(treebuildingQueue)){
-
-        // Create new tree with one node
-		newTree = binaryTree_create(); 
-		binaryTree_setMemHandler(newTree, free);
-
-
-		/*
-		 * Take out the first tree from the queue and save the values on its
-		 * label.
-		 */
-		tree1 = pqueue_inspect_first(treebuildingQueue);
-		freqChar *labelTree1 =
-                binaryTree_inspectLabel(tree1, binaryTree_root(tree1));
-		pqueue_delete_first(treebuildingQueue);
-		
-		// When the last tree has been taken out return that tree
-		if(pqueue_isEmpty(treebuildingQueue)){
-			binaryTree_free(newTree);
-			binaryTree_setMemHandler(tree1, free);
-			pqueue_free(treebuildingQueue); 
-			return tree1; 
-		}
-		else{
-			
-			/*
-			 * Take out the second tree from the queue and save the values on
-			 * its label.
-			 */
-			tree2 = pqueue_inspect_first(treebuildingQueue);
-			freqChar *labelTree2 =
-                    binaryTree_inspectLabel(tree2, binaryTree_root(tree2));
-			pqueue_delete_first(treebuildingQueue);
-			
-			// Initiate and give values to the new node label
-			freqChar *labelCombinedTree = malloc(sizeof(freqChar));
-			labelCombinedTree->value = labelTree1->value + labelTree2->value;
-			labelCombinedTree->character = -1;
-			
-			// Set label on the new tree and insert a left and right child
-			binaryTree_setLabel(newTree, labelCombinedTree,
-				binaryTree_root(newTree));
-			
-			/*
-			 * Set the two trees from the queue
-			 * as right/left child on the
-			 * new node.
-			 */
-			newTree->root->rightChild = tree1->root;
-			newTree->root->leftChild = tree2->root;
-			tree1->root->parent = newTree->root;
-			tree2->root->parent = newTree->root;
-			
-			// Insert the new tree in the queue
-			pqueue_insert(treebuildingQueue, newTree);
-			free(tree1);
-			free(tree2);
-		}
-	}
-	pqueue_free(treebuildingQueue);
 	return 0;
 }
 
@@ -410,48 +588,46 @@ void traverseTree(binaryTree_pos pos, binary_tree *huffmanTree, int navPath[],
  *              outputfile    - file where encoded text is stored
  *              pathArray     - array with pointers to bitsets with binary code 
  *                              for all characters
+ *
+ * The bit sequence is packed into bytes as it is produced and written in
+ * pieces, so the memory used doesn't grow with the input. As in earlier
+ * versions only whole bytes are written; the bits of a last incomplete
+ * byte are dropped.
  */
 void encodeFile(FILE *encodeThis, FILE *output, bitset *pathArray[]){
-	unsigned char tmp;
-	int lengthCharBitset;
-	int lengthCharCompound;
-	bitset *compoundBitset = bitset_empty();
-	char* writeToFile;
+	unsigned char writeToFile[1 << 16];
+	size_t filled = 0;
+	unsigned int pending = 0;
+	int pendingBits = 0;
+	int ch;
+	bool finished = false;
 	
-	while((tmp = fgetc(encodeThis))){
-		if (feof(encodeThis)) {
-			// Adds the EOT character at the end of the encoded bit sequence
-			lengthCharBitset = bitset_size(pathArray[4]);
-			for(int iii = 0; iii < lengthCharBitset; iii++){
-				lengthCharCompound = bitset_size(compoundBitset);
-				bitset_setBitValue(compoundBitset, lengthCharCompound,
-                                   bitset_memberOf(pathArray[4], iii));
-			}
-			break;
-		} else {
-			// Take all bit sequences and add them all to one bitset
-			lengthCharBitset = bitset_size(pathArray[(int)tmp]);
-			for(int iii = 0; iii < lengthCharBitset; iii++) {
-				if (bitset_size(compoundBitset) == -1){
-					lengthCharCompound = 0;
-				} else {
-					lengthCharCompound = bitset_size(compoundBitset);
+	while(!finished){
+		ch = fgetc(encodeThis);
+		
+		// Adds the EOT character at the end of the encoded bit sequence
+		if(ch == EOF){
+			ch = 4;
+			finished = true;
+		}
+		
+		// Append the bit sequence of the character
+		bitset *code = pathArray[ch];
+		size_t lengthCharBitset = bitset_size(code);
+		for(size_t iii = 0; iii < lengthCharBitset; iii++){
+			pending |= (unsigned int)bitset_memberOf(code, iii) << pendingBits;
+			if(++pendingBits == 8){
+				writeToFile[filled++] = (unsigned char)pending;
+				pending = 0;
+				pendingBits = 0;
+				if(filled == sizeof(writeToFile)){
+					fwrite(writeToFile, 1, filled, output);
+					filled = 0;
 				}
-				bitset_setBitValue(compoundBitset,lengthCharCompound, 
-					bitset_memberOf(pathArray[(int)tmp], iii));
 			}
 		}
 	}
-	
-	// Write the whole bitset to output file
-	writeToFile = toByteArray(compoundBitset);
-	for(int iii = 0; iii < bitset_size(compoundBitset)/8; iii++){
-		fputc((unsigned char)writeToFile[iii], output);
-	}
-	
-	// Free allocated memory
-	free(writeToFile);
-	bitset_free(compoundBitset);
+	fwrite(writeToFile, 1, filled, output);
 }
 
 /*
@@ -460,64 +636,1499 @@ void encodeFile(FILE *encodeThis, FILE *output, bitset *pathArray[]){
  * Parameters:  inputfile     - file to be decoded
  *              outputfile    - file where decoded text is stored
  *              huffmanTree   - tree used to decode
+ *              threads       - most threads to decode with
  * 
- * This function follows the path through the tree from the input file until a 
- * leaf is found, the character on this leaf is printed in the output file.
+ * The codes of the tree are read with a lookup table instead of one step
+ * through the tree per bit. Large inputs are cut into chunks that threads
+ * decode speculatively and that are stitched where their codes line up
+ * (see legacy.h); the output is the same as decoding serially.
  */
-void decodeFile(FILE* decodeThis, FILE* output, binary_tree* huffmanTree){
-	int size;
-	int decodingPos = 0;
-	freqChar* currentLabel;
-	binaryTree_pos treePos = binaryTree_root(huffmanTree);
+void decodeFile(FILE* decodeThis, FILE* output, binary_tree* huffmanTree,
+                int threads){
+	uint64_t size;
+	unsigned char *inputText;
+	legacyDecoder *decoder;
 	
 	// Get length of input file
 	fseek(decodeThis, 0, SEEK_END);
-	size = ftell(decodeThis);
+	long end = ftell(decodeThis);
 	fseek(decodeThis, 0, SEEK_SET);
-	int inputTextArray[size];
+	size = end > 0 ? (uint64_t)end : 0;
+	if(size > SIZE_MAX / 2){
+		fprintf(stderr, "Input file is too large to decode\n");
+		return;
+	}
+	inputText = malloc(size > 0 ? (size_t)size : 1);
+	if(inputText == NULL){
+		fprintf(stderr, "Not enough memory to decode the input file\n");
+		return;
+	}
 	
 	// Read all characters
-	for (int currentRead = 0; currentRead < size; currentRead++) {
-		inputTextArray[currentRead] = fgetc(decodeThis);
-	}
+	size = fread(inputText, 1, (size_t)size, decodeThis);
 
-    // Characters have to be translated into bitsequence
-	bool *bitSeqToConvert;
-	bitSeqToConvert = (bool*) calloc(size * 8,sizeof(bool));
-	
-	// Convert every read character to a binary sequence
-	for (int currentTranslateChar = 0; currentTranslateChar < size;
-         currentTranslateChar++){
-		for (int bytePosition = 0; bytePosition < 8; bytePosition++) {
-			bitSeqToConvert[currentTranslateChar * 8 + bytePosition] =
-                    (inputTextArray[currentTranslateChar] >> bytePosition) & 1;
-		}
+	decoder = legacyDecoder_create(huffmanTree);
+	if(decoder == NULL ||
+	   legacyDecoder_decode(decoder, inputText, (size_t)size, threads,
+	                        output) < 0){
+		fprintf(stderr, "Couldn't write the decoded text\n");
+		legacyDecoder_free(decoder);
+		free(inputText);
+		return;
 	}
-	
-	/*
-	 * According to binary sequence move through tree until leaf is reached at
-	 * leaf print associated character to output file.
-	 */
-	while(decodingPos < size * 8){
-		if(binaryTree_hasLeftChild(huffmanTree, treePos) ||
-                binaryTree_hasRightChild(huffmanTree, treePos)){
-			if(bitSeqToConvert[decodingPos] == 0){
-				treePos = binaryTree_leftChild(huffmanTree, treePos);
-				decodingPos++;
+	legacyDecoder_free(decoder);
+	free(inputText);
+	printf("File decoded successfully!\n");
+}
+
+/*
+ * parseOptions - reads the options that follow the mode argument
+ *
+ * Parameter:   argc, argv  - the command line arguments of the program
+ *              options     - settings to update
+ *
+ * Options:     -blocksize N    amount of data per frame block, N may end
+ *                              with K or M
+ *              -legacy         read / write the legacy bitstream instead
+ *                              of frames
+ *              -builtin        use the model compiled into the program
+ *                              instead of a frequency file
+ *              -batch LIST     code the files named in LIST with one model
+ *                              (see batchCode)
+ *              -threads N      number of workers of a batch or daemon
+ *                              or of decoding a frame or legacy stream,
+ *                              default one per processor, or number of
+ *                              connections of -loadgen
+ *              -connect SOCKET have the daemon at SOCKET code the file
+ *              -requests N     number of requests -loadgen sends of each
+ *                              kind
+ *              -io B           read and write frames with io_uring
+ *                              (B = uring) where the system has it, or
+ *                              with buffered I/O (B = buffered, default)
+ *              -records        encode every line of the input as a small
+ *                              record of its own (see record.h)
+ *              -append         add the input as a new frame to the end
+ *                              of the output file instead of replacing it
+ *              -rebuild N      symbols between rebuilds of the adaptive
+ *                              tree, 0 for never
+ *              -order1         let frame blocks use tables conditioned on
+ *                              the previous byte
+ *              -alphabet A     let frame blocks code UTF-8 characters
+ *                              (A = utf8) or byte pairs (A = pair) instead
+ *                              of single bytes, A = byte turns it off
+ *              -lz LEVEL       let frame blocks replace repeated strings
+ *                              by LZ77 matches, searching harder the
+ *                              higher LEVEL (1 to 9) is, 0 turns it off
+ *              -window N       longest distance of an LZ77 match, N may
+ *                              end with K or M (at most 16M). Matches
+ *                              stay inside their block, the default
+ *                              and the limit is the block size
+ *              -ans            let frame blocks use tANS coding (see ans.h)
+ *                              in place of Huffman codes
+ *              -streams N      split blocks coded with a byte table into N
+ *                              (1, 4 or 8) substreams that are decoded in
+ *                              parallel
+ *
+ * Returns:     index of the first file name, -1 on unknown options
+ */
+int parseOptions(int argc, char **argv, cliOptions *options){
+	int argIndex = 2;
+
+	while(argIndex < argc && argv[argIndex][0] == '-' &&
+	      argv[argIndex][1] != '\0'){
+		if(!strcmp(argv[argIndex], "-legacy")){
+			options->legacy = true;
+			argIndex++;
+		} else if(!strcmp(argv[argIndex], "-builtin")){
+			options->builtin = true;
+			argIndex++;
+		} else if(!strcmp(argv[argIndex], "-batch") &&
+		          argIndex + 1 < argc){
+			options->batchList = argv[argIndex + 1];
+			argIndex += 2;
+		} else if(!strcmp(argv[argIndex], "-connect") &&
+		          argIndex + 1 < argc){
+			options->socketPath = argv[argIndex + 1];
+			argIndex += 2;
+		} else if(!strcmp(argv[argIndex], "-requests") &&
+		          argIndex + 1 < argc){
+			char *end;
+			unsigned long long requests = strtoull(argv[argIndex + 1], &end,
+			                                       10);
+			if(*end != '\0' || requests == 0 || requests > (1ull << 32)){
+				fprintf(stderr, "Number of requests must be 1 to 2^32\n");
+				return -1;
+			}
+			options->requests = (uint64_t)requests;
+			argIndex += 2;
+		} else if(!strcmp(argv[argIndex], "-threads") &&
+		          argIndex + 1 < argc){
+			int threads = atoi(argv[argIndex + 1]);
+			if(threads < 1 || threads > 1024){
+				fprintf(stderr, "Number of threads must be 1 to 1024\n");
+				return -1;
+			}
+			options->threads = threads;
+			argIndex += 2;
+		} else if(!strcmp(argv[argIndex], "-io") && argIndex + 1 < argc){
+			if(!strcmp(argv[argIndex + 1], "uring")){
+				options->asyncIo = true;
+			} else if(!strcmp(argv[argIndex + 1], "buffered")){
+				options->asyncIo = false;
+			} else {
+				fprintf(stderr, "I/O backend must be uring or buffered\n");
+				return -1;
+			}
+			argIndex += 2;
+		} else if(!strcmp(argv[argIndex], "-records")){
+			options->records = true;
+			argIndex++;
+		} else if(!strcmp(argv[argIndex], "-append")){
+			options->append = true;
+			argIndex++;
+		} else if(!strcmp(argv[argIndex], "-order1")){
+			options->frame.order1 = true;
+			argIndex++;
+		} else if(!strcmp(argv[argIndex], "-alphabet") &&
+		          argIndex + 1 < argc){
+			if(!strcmp(argv[argIndex + 1], "utf8")){
+				options->frame.alphabet = ALPHABET_UTF8;
+			} else if(!strcmp(argv[argIndex + 1], "pair")){
+				options->frame.alphabet = ALPHABET_PAIR;
+			} else if(!strcmp(argv[argIndex + 1], "byte")){
+				options->frame.alphabet = ALPHABET_BYTE;
+			} else {
+				fprintf(stderr, "Alphabet must be utf8, pair or byte\n");
+				return -1;
+			}
+			argIndex += 2;
+		} else if(!strcmp(argv[argIndex], "-ans")){
+			options->frame.ans = true;
+			argIndex++;
+		} else if(!strcmp(argv[argIndex], "-lz") && argIndex + 1 < argc){
+			char *end;
+			long level = strtol(argv[argIndex + 1], &end, 10);
+			if(*end != '\0' || level < 0 || level > LZ77_MAXLEVEL){
+				fprintf(stderr, "LZ77 level must be 0 to %d\n",
+				        LZ77_MAXLEVEL);
+				return -1;
+			}
+			options->frame.lzLevel = (int)level;
+			argIndex += 2;
+		} else if(!strcmp(argv[argIndex], "-window") &&
+		          argIndex + 1 < argc){
+			char *end;
+			unsigned long long size = strtoull(argv[argIndex + 1], &end, 10);
+			if(*end == 'K' || *end == 'k'){
+				size <<= 10;
+				end++;
+			} else if(*end == 'M' || *end == 'm'){
+				size <<= 20;
+				end++;
+			}
+			if(*end != '\0' || size == 0 || size > LZ77_MAXWINDOW){
+				fprintf(stderr, "Window must be between 1 and 16M\n");
+				return -1;
 			}
-			else if(bitSeqToConvert[decodingPos] == 1){
-				treePos = binaryTree_rightChild(huffmanTree, treePos);
-				decodingPos++;
+			options->frame.lzWindow = (size_t)size;
+			argIndex += 2;
+		} else if(!strcmp(argv[argIndex], "-streams") &&
+		          argIndex + 1 < argc){
+			int streams = atoi(argv[argIndex + 1]);
+			if(streams != 1 && streams != 4 && streams != 8){
+				fprintf(stderr, "Number of streams must be 1, 4 or 8\n");
+				return -1;
 			}
+			options->frame.streams = streams;
+			argIndex += 2;
+		} else if(!strcmp(argv[argIndex], "-blocksize") &&
+		          argIndex + 1 < argc){
+			char *end;
+			unsigned long long size = strtoull(argv[argIndex + 1], &end, 10);
+			if(*end == 'K' || *end == 'k'){
+				size <<= 10;
+				end++;
+			} else if(*end == 'M' || *end == 'm'){
+				size <<= 20;
+				end++;
+			}
+			if(*end != '\0' || size == 0 || size > (1u << 30)){
+				fprintf(stderr, "Block size must be between 1 and 1G\n");
+				return -1;
+			}
+			options->frame.blockSize = (size_t)size;
+			argIndex += 2;
+		} else if(!strcmp(argv[argIndex], "-rebuild") &&
+		          argIndex + 1 < argc){
+			char *end;
+			unsigned long interval = strtoul(argv[argIndex + 1], &end, 10);
+			if(*end != '\0' || interval > UINT32_MAX){
+				fprintf(stderr, "Rebuild interval must be a number\n");
+				return -1;
+			}
+			options->rebuildInterval = (uint32_t)interval;
+			argIndex += 2;
+		} else {
+			fprintf(stderr, "Unknown option %s\n", argv[argIndex]);
+			return -1;
+		}
+	}
+	if(options->frame.lzWindow > options->frame.blockSize){
+		fprintf(stderr, "Window is larger than the block size, matches "
+		        "reach back at most %zu bytes\n", options->frame.blockSize);
+	}
+	return argIndex;
+}
+
+/*
+ * loadModels - builds the registry of models a frame is coded with
+ *
+ * Parameter:   freqPath    - frequency file, or several separated by commas
+ *                            (see registry_loadList), NULL for none
+ *              options     - the settings: -builtin for the built in model
+ *                            when there is no frequency file
+ *
+ * Returns:     the registry, empty if there are no models, NULL if a
+ *              frequency file couldn't be read
+ *
+ * Unlike the legacy format the models use the real counts of the files,
+ * see registry_loadTable.
+ */
+modelRegistry *loadModels(char *freqPath, const cliOptions *options){
+	modelRegistry *models = registry_create();
+
+	if(freqPath != NULL){
+		if(registry_loadList(models, freqPath) < 0){
+			fprintf(stderr, "Couldn't open frequency file %s\n", freqPath);
+			registry_free(models);
+			return NULL;
+		}
+	} else if(options->builtin){
+		registry_add(models, builtin_table(), builtin_decodeTable());
+	}
+	return models;
+}
+
+/*
+ * encodeFrame - implements the -auto mode and the -encode mode for frames
+ *
+ * Parameter:   freqPath    - frequency files of the models, NULL in -auto
+ *                            mode or for the built in model
+ *              inPath      - name of the file to encode
+ *              outPath     - name of the file where the frame is stored
+ *              options     - the settings, options->frame for the encoder
+ *
+ * The input is mapped (or read with many reads in flight) into memory so
+ * that building the block histograms and encoding costs a single read of
+ * the file.
+ */
+int encodeFrame(char *freqPath, char *inPath, char *outPath,
+                cliOptions *options){
+	modelRegistry *models = loadModels(freqPath, options);
+	ioring *ring = NULL;
+	mapped_file *input;
+	uint64_t writeBytes;
+	int result;
+
+	if(models == NULL){
+		return wrongArgs();
+	}
+	options->frame.models = models;
+	if(options->asyncIo){
+		ring = ioring_create();
+	}
+	input = ioring_readFile(ring, inPath);
+	if(input == NULL){
+		fprintf(stderr, "Couldn't open input file %s\n", inPath);
+		ioring_free(ring);
+		registry_free(models);
+		return wrongArgs();
+	}
+
+	if(options->append){
+		result = appendFrame(input, outPath, &options->frame, &writeBytes);
+	} else {
+		result = writeFrame(input, outPath, &options->frame, ring,
+		                    &writeBytes);
+	}
+	ioring_free(ring);
+	registry_free(models);
+	options->frame.models = NULL;
+	if(result != 0){
+		mapfile_close(input);
+		return result;
+	}
+
+	// Screen output
+	printf("%zu bytes read from %s.\n", input->length, inPath);
+	printf("%" PRIu64 " bytes used in encoded form.\n", writeBytes);
+	mapfile_close(input);
+	return 0;
+}
+
+/*
+ * writeFrame - encodes a file in memory and writes the frame
+ *
+ * Parameter:   input       - the file to encode
+ *              outPath     - name of the file where the frame is stored
+ *              options     - frame encoder settings
+ *              ring        - ring to write through, NULL to write in place
+ *              writeBytes  - receives the size of the frame
+ *
+ * Returns:     0 on success, the exit status of the program otherwise
+ *
+ * Without a ring the output file is created at the largest possible frame
+ * size, the frame is encoded straight into its mapping and the file is cut
+ * to the real size afterwards.
+ */
+int writeFrame(const mapped_file *input, char *outPath,
+               const frameOptions *options, ioring *ring,
+               uint64_t *writeBytes){
+	bool failed;
+
+	if(ring != NULL){
+		FILE *outfilep = ioring_openWriter(ring, outPath);
+		if(outfilep == NULL){
+			fprintf(stderr, "Couldn't open output file %s\n", outPath);
+			return wrongArgs();
+		}
+		*writeBytes = frame_encode(input->data, input->length, options,
+		                           outfilep);
+		failed = fclose(outfilep) != 0 || ioring_flush(ring) != 0;
+	} else {
+		output_map *output = outmap_create(outPath,
+		        frame_maxEncodedSize(input->length, options->blockSize));
+		if(output == NULL){
+			fprintf(stderr, "Couldn't open output file %s\n", outPath);
+			return wrongArgs();
+		}
+		*writeBytes = frame_encodeInto(input->data, input->length, options,
+		                               output->data, output->size);
+		failed = outmap_close(output, *writeBytes) != 0;
+	}
+	if(failed || *writeBytes == 0){
+		fprintf(stderr, "Couldn't write output file %s\n", outPath);
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
+
+/*
+ * appendFrame - encodes a file in memory as a frame at the end of the
+ *               frames of another
+ *
+ * Parameter:   input       - the file to encode
+ *              outPath     - name of the file the frame is added to, it is
+ *                            created if it doesn't exist
+ *              options     - frame encoder settings
+ *              writeBytes  - receives the size of the frame and the new
+ *                            index
+ *
+ * Returns:     0 on success, the exit status of the program otherwise
+ *
+ * The output file is mapped only to read its index (see frame_append), the
+ * frame is written over the old index through a stream.
+ */
+int appendFrame(const mapped_file *input, char *outPath,
+                const frameOptions *options, uint64_t *writeBytes){
+	mapped_file *existing = NULL;
+	FILE *outfilep = fopen(outPath, "r+b");
+	int64_t offset = 0;
+	bool failed;
+
+	if(outfilep == NULL && errno == ENOENT){
+		outfilep = fopen(outPath, "wb");
+	} else if(outfilep != NULL){
+		existing = mapfile_open(outPath);
+		if(existing == NULL){
+			fclose(outfilep);
+			outfilep = NULL;
+		}
+	}
+	if(outfilep == NULL){
+		fprintf(stderr, "Couldn't open output file %s\n", outPath);
+		return wrongArgs();
+	}
+	if(existing != NULL){
+		offset = frame_appendOffset(existing->data, existing->length);
+	}
+	if(offset < 0){
+		fprintf(stderr, "%s is not a file of frames, nothing can be "
+		        "appended to it\n", outPath);
+		fclose(outfilep);
+		mapfile_close(existing);
+		return EXIT_FAILURE;
+	}
+
+	*writeBytes = 0;
+	if(fseeko(outfilep, (off_t)offset, SEEK_SET) == 0){
+		*writeBytes = frame_append(existing != NULL ? existing->data : NULL,
+		                           existing != NULL ? existing->length : 0,
+		                           input->data, input->length, options,
+		                           outfilep);
+	}
+	failed = fclose(outfilep) != 0;
+	if(existing != NULL){
+		mapfile_close(existing);
+	}
+	if(failed || *writeBytes == 0){
+		fprintf(stderr, "Couldn't write output file %s\n", outPath);
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
+
+/*
+ * decodeFrame - decodes a file in the frame format
+ *
+ * Parameter:   freqPath    - frequency files of the models, NULL if none
+ *                            were given
+ *              inPath      - name of the encoded file
+ *              outPath     - name of the file where decoded data is stored
+ *              options     - the settings: -builtin for the built in model
+ *                            when there is no frequency file, -io and
+ *                            -threads
+ *
+ * The size of the decoded data is in the frame header, so without a ring
+ * the output file is created at its final size and the blocks are decoded
+ * straight into its mapping, by several threads when the frame allows it.
+ */
+int decodeFrame(char *freqPath, char *inPath, char *outPath,
+                const cliOptions *options){
+	modelRegistry *models;
+	ioring *ring = options->asyncIo ? ioring_create() : NULL;
+	mapped_file *input = ioring_readFile(ring, inPath);
+	int64_t decodedBytes;
+	bool failed;
+
+	if(input == NULL){
+		fprintf(stderr, "Couldn't open input file %s\n", inPath);
+		ioring_free(ring);
+		return wrongArgs();
+	}
+	if(!frame_isFrame(input->data, input->length)){
+		fprintf(stderr, "%s is not in the frame format, "
+		        "a frequency file is needed to decode it\n", inPath);
+		mapfile_close(input);
+		ioring_free(ring);
+		return wrongArgs();
+	}
+	models = loadModels(freqPath, options);
+	if(models == NULL){
+		mapfile_close(input);
+		ioring_free(ring);
+		return wrongArgs();
+	}
+
+	if(ring != NULL){
+		FILE *outfilep = ioring_openWriter(ring, outPath);
+		if(outfilep == NULL){
+			fprintf(stderr, "Couldn't open output file %s\n", outPath);
+			mapfile_close(input);
+			ioring_free(ring);
+			registry_free(models);
+			return wrongArgs();
 		}
-		else{
-			currentLabel = (freqChar *) binaryTree_inspectLabel(huffmanTree, treePos);
-			fprintf(output, "%c", currentLabel->character);
-			treePos = binaryTree_root(huffmanTree);
+		decodedBytes = frame_decode(input->data, input->length, models,
+		                            outfilep);
+		failed = fclose(outfilep) != 0 || ioring_flush(ring) != 0;
+	} else {
+		int64_t size = frame_decodedSize(input->data, input->length);
+		int threads = options->threads > 0 ? options->threads :
+		                                     batch_defaultThreads();
+		output_map *output;
+		if(size < 0){
+			fprintf(stderr, "Couldn't decode %s, the file is corrupt\n",
+			        inPath);
+			mapfile_close(input);
+			registry_free(models);
+			return EXIT_FAILURE;
+		}
+		output = outmap_create(outPath, (uint64_t)size);
+		if(output == NULL){
+			fprintf(stderr, "Couldn't open output file %s\n", outPath);
+			mapfile_close(input);
+			registry_free(models);
+			return wrongArgs();
 		}
+		if(threads > FRAME_MAXTHREADS){
+			threads = FRAME_MAXTHREADS;
+		}
+		decodedBytes = frame_decodeInto(input->data, input->length, models,
+		                                output->data, threads);
+		failed = outmap_close(output, decodedBytes > 0 ?
+		                              (uint64_t)decodedBytes : 0) != 0;
+	}
+	mapfile_close(input);
+	ioring_free(ring);
+	registry_free(models);
+	if(failed || decodedBytes < 0){
+		fprintf(stderr, "Couldn't decode %s, the file is corrupt or needs "
+		        "the frequency files it was encoded with\n", inPath);
+		return EXIT_FAILURE;
 	}
-	free(bitSeqToConvert);
 	printf("File decoded successfully!\n");
+	return 0;
+}
+
+/*
+ * isFrameFile - checks if an opened file is in the frame format
+ *
+ * Comments:    The file position is restored before returning.
+ */
+bool isFrameFile(FILE *file){
+	unsigned char header[FRAME_HEADERSIZE];
+	long position = ftell(file);
+	size_t readBytes = fread(header, 1, sizeof(header), file);
+
+	fseek(file, position, SEEK_SET);
+	return frame_isFrame(header, readBytes);
+}
+
+/*
+ * encodeRecords - implements the -records mode
+ *
+ * Parameter:   freqPath    - frequency file for the model, NULL to use the
+ *                            built in model
+ *              inPath      - name of the file whose lines are the records
+ *              outPath     - name of the record file to write
+ *
+ * Every line, including its newline, is one record, so decoding gives back
+ * the file exactly. The lines are coded in batches through one reused
+ * buffer.
+ */
+int encodeRecords(char *freqPath, char *inPath, char *outPath){
+	enum { BATCH = 4096 };
+	const unsigned char *records[BATCH];
+	size_t lengths[BATCH];
+	unsigned char header[RECORD_HEADERSIZE];
+	codeTable *global = NULL;
+	recordModel *model;
+	mapped_file *input;
+	unsigned char *buffer = NULL;
+	size_t capacity = 0;
+	uint64_t writeBytes = RECORD_HEADERSIZE;
+	uint64_t recordCount = 0;
+	size_t position = 0;
+	FILE *outfilep;
+	bool failed = false;
+
+	if(freqPath != NULL){
+		global = registry_loadTable(freqPath);
+		if(global == NULL){
+			fprintf(stderr, "Couldn't open frequency file %s\n", freqPath);
+			return wrongArgs();
+		}
+		model = recordModel_create(global, NULL);
+	} else {
+		model = recordModel_create(builtin_table(), builtin_decodeTable());
+	}
+	input = mapfile_open(inPath);
+	outfilep = input == NULL ? NULL : fopen(outPath, "wb");
+	if(outfilep == NULL){
+		fprintf(stderr, "Couldn't open %s file %s\n",
+		        input == NULL ? "input" : "output",
+		        input == NULL ? inPath : outPath);
+		if(input != NULL){
+			mapfile_close(input);
+		}
+		recordModel_free(model);
+		if(global != NULL){
+			codeTable_free(global);
+		}
+		return wrongArgs();
+	}
+
+	record_writeHeader(header, freqPath == NULL ? RECORD_MODEL_BUILTIN :
+	                                              RECORD_MODEL_FILE);
+	failed = fwrite(header, 1, sizeof(header), outfilep) != sizeof(header);
+	while(!failed && position < input->length){
+		size_t count = 0;
+		size_t needed = 0;
+
+		// Split the next batch of lines
+		while(count < BATCH && position < input->length){
+			const unsigned char *line = input->data + position;
+			const unsigned char *end = memchr(line, '\n',
+			                                  input->length - position);
+			size_t length = end == NULL ? input->length - position :
+			                              (size_t)(end - line) + 1;
+			records[count] = line;
+			lengths[count] = length;
+			needed += record_maxEncodedSize(length);
+			position += length;
+			count++;
+		}
+		if(needed > capacity){
+			capacity = needed;
+			free(buffer);
+			buffer = malloc(capacity);
+			if(buffer == NULL){
+				failed = true;
+				break;
+			}
+		}
+		size_t coded = record_encodeBatch(model, records, lengths, count,
+		                                  buffer);
+		failed = fwrite(buffer, 1, coded, outfilep) != coded;
+		writeBytes += coded;
+		recordCount += count;
+	}
+
+	free(buffer);
+	recordModel_free(model);
+	if(global != NULL){
+		codeTable_free(global);
+	}
+	if(fclose(outfilep) != 0 || failed){
+		fprintf(stderr, "Couldn't write output file %s\n", outPath);
+		mapfile_close(input);
+		return EXIT_FAILURE;
+	}
+
+	// Screen output
+	printf("%zu bytes read from %s.\n", input->length, inPath);
+	printf("%" PRIu64 " records, %" PRIu64 " bytes used in encoded form.\n",
+	       recordCount, writeBytes);
+	mapfile_close(input);
+	return 0;
+}
+
+/*
+ * decodeRecords - decodes a record file written by encodeRecords
+ *
+ * Parameter:   freqPath    - frequency file the records were coded with,
+ *                            NULL for the built in model
+ *              inPath      - name of the record file
+ *              outPath     - name of the file where the records are stored
+ */
+int decodeRecords(char *freqPath, char *inPath, char *outPath){
+	enum { BATCH = 4096 };
+	size_t lengths[BATCH];
+	codeTable *global = NULL;
+	recordModel *model;
+	mapped_file *input = mapfile_open(inPath);
+	unsigned char *buffer;
+	size_t capacity = 1 << 20;
+	size_t position = RECORD_HEADERSIZE;
+	FILE *outfilep;
+	bool failed = false;
+
+	if(input == NULL || !record_isRecordFile(input->data, input->length)){
+		fprintf(stderr, "Couldn't open input file %s\n", inPath);
+		if(input != NULL){
+			mapfile_close(input);
+		}
+		return wrongArgs();
+	}
+	if((input->data[5] == RECORD_MODEL_BUILTIN) != (freqPath == NULL)){
+		fprintf(stderr, "%s was coded with %s\n", inPath,
+		        freqPath == NULL ? "a frequency file, give it as FILE0" :
+		                           "the built in model, use -builtin");
+		mapfile_close(input);
+		return wrongArgs();
+	}
+	if(freqPath != NULL){
+		global = registry_loadTable(freqPath);
+		if(global == NULL){
+			fprintf(stderr, "Couldn't open frequency file %s\n", freqPath);
+			mapfile_close(input);
+			return wrongArgs();
+		}
+		model = recordModel_create(global, NULL);
+	} else {
+		model = recordModel_create(builtin_table(), builtin_decodeTable());
+	}
+	outfilep = fopen(outPath, "wb");
+	if(outfilep == NULL){
+		fprintf(stderr, "Couldn't open output file %s\n", outPath);
+		mapfile_close(input);
+		recordModel_free(model);
+		if(global != NULL){
+			codeTable_free(global);
+		}
+		return wrongArgs();
+	}
+
+	buffer = malloc(capacity);
+	failed = buffer == NULL;
+	while(!failed && position < input->length){
+		size_t used;
+		size_t filled = 0;
+		long count = record_decodeBatch(model, input->data + position,
+		                                input->length - position, buffer,
+		                                capacity, lengths, BATCH, &used);
+		if(count < 0){
+			failed = true;
+			break;
+		}
+		if(count == 0){
+			// The next record is larger than the buffer
+			uint64_t length;
+			if(loadVarint(input->data + position, input->length - position,
+			              &length) < 0 || length > input->length * 8){
+				failed = true;
+				break;
+			}
+			capacity = (size_t)length;
+			free(buffer);
+			buffer = malloc(capacity);
+			if(buffer == NULL){
+				failed = true;
+				break;
+			}
+			continue;
+		}
+		for(long i = 0; i < count; i++){
+			filled += lengths[i];
+		}
+		failed = fwrite(buffer, 1, filled, outfilep) != filled;
+		position += used;
+	}
+
+	free(buffer);
+	mapfile_close(input);
+	recordModel_free(model);
+	if(global != NULL){
+		codeTable_free(global);
+	}
+	if(fclose(outfilep) != 0 || failed){
+		fprintf(stderr, "Couldn't decode %s, the file is corrupt or needs "
+		        "the frequency file it was encoded with\n", inPath);
+		return EXIT_FAILURE;
+	}
+	printf("File decoded successfully!\n");
+	return 0;
+}
+
+/*
+ * batchCode - implements the -batch mode
+ *
+ * Parameter:   encode      - true to encode, false to decode
+ *              freqPath    - frequency files of the models, NULL for the
+ *                            built in model or none
+ *              options     - the settings, options->batchList is the list
+ *                            of files
+ *
+ * The list is read with batch_readList. The models (and their decode tables)
+ * are built once here and shared by all workers through a sharedRegistry.
+ */
+int batchCode(bool encode, char *freqPath, cliOptions *options){
+	batchOptions batch;
+	batchStats stats;
+	modelRegistry *models;
+	char **inputs;
+	char **outputs;
+	long count = batch_readList(options->batchList, encode, &inputs,
+	                            &outputs);
+	int result;
+
+	if(count < 0){
+		fprintf(stderr, "Couldn't read list file %s\n", options->batchList);
+		return wrongArgs();
+	}
+	models = loadModels(freqPath, options);
+	if(models == NULL){
+		batch_freeList(inputs, outputs, (size_t)count);
+		return wrongArgs();
+	}
+	batch.encode = encode;
+	batch.frame = options->frame;
+	batch.models = registry_share(models);
+	batch.threads = options->threads > 0 ? options->threads :
+	                                       batch_defaultThreads();
+	batch.asyncIo = options->asyncIo;
+
+	result = batch_run(inputs, outputs, (size_t)count, &batch, &stats);
+	batch_freeList(inputs, outputs, (size_t)count);
+	registry_unshare(batch.models);
+
+	// Aggregate throughput of the whole batch
+	printf("%" PRIu64 " files %s, %" PRIu64 " failed, with %d threads and "
+	       "%s I/O.\n", stats.files, encode ? "encoded" : "decoded",
+	       stats.failed, batch.threads, stats.asyncIo ? "io_uring" :
+	                                                    "buffered");
+	printf("%" PRIu64 " bytes read, %" PRIu64 " bytes written in %.3f s "
+	       "(%.1f MB/s, %.0f files/s).\n", stats.bytesIn, stats.bytesOut,
+	       stats.seconds, stats.seconds > 0 ?
+	       (double)(encode ? stats.bytesIn : stats.bytesOut) / 1e6 /
+	       stats.seconds : 0.0,
+	       stats.seconds > 0 ? (double)stats.files / stats.seconds : 0.0);
+	return result == 0 ? 0 : EXIT_FAILURE;
+}
+
+/*
+ * serve - implements the -serve mode
+ *
+ * Parameter:   socketPath  - name of the socket to listen on
+ *              freqPath    - frequency files of the models, NULL for the
+ *                            built in model or none
+ *              options     - the settings, options->frame for the encoder
+ *
+ * The daemon runs until SIGINT or SIGTERM, see daemon_run.
+ */
+int serve(char *socketPath, char *freqPath, const cliOptions *options){
+	modelSource source = { freqPath, options };
+	daemonOptions daemon;
+	modelRegistry *models = loadModels(freqPath, options);
+
+	if(models == NULL){
+		return wrongArgs();
+	}
+	daemon.frame = options->frame;
+	daemon.threads = options->threads > 0 ? options->threads :
+	                                        batch_defaultThreads();
+	daemon.reload = reloadModels;
+	daemon.context = &source;
+
+	printf("Serving on %s with %d workers.\n", socketPath, daemon.threads);
+	fflush(stdout);
+	if(daemon_run(socketPath, models, &daemon) != 0){
+		fprintf(stderr, "Couldn't serve on %s\n", socketPath);
+		return EXIT_FAILURE;
+	}
+	printf("Daemon stopped.\n");
+	return 0;
+}
+
+/*
+ * reloadModels - loads the models of a daemon again, on SIGHUP
+ *
+ * Parameter:   context     - the modelSource of the daemon
+ *
+ * Returns:     the registry, NULL if a frequency file couldn't be read
+ */
+modelRegistry *reloadModels(void *context){
+	modelSource *source = context;
+
+	return loadModels(source->freqPath, source->options);
+}
+
+/*
+ * remoteCode - has a daemon encode or decode a file
+ *
+ * Parameter:   encode      - true to encode, false to decode
+ *              socketPath  - name of the socket of the daemon
+ *              inPath      - file to code
+ *              outPath     - file that receives the result
+ */
+int remoteCode(bool encode, char *socketPath, char *inPath, char *outPath){
+	daemonReply reply = { NULL, 0, 0 };
+	mapped_file *input = mapfile_open(inPath);
+	FILE *outfilep;
+	int status;
+	int fd;
+
+	if(input == NULL){
+		fprintf(stderr, "Couldn't open input file %s\n", inPath);
+		return wrongArgs();
+	}
+	fd = daemon_connect(socketPath);
+	if(fd < 0){
+		fprintf(stderr, "No daemon is listening on %s\n", socketPath);
+		mapfile_close(input);
+		return EXIT_FAILURE;
+	}
+	status = daemon_call(fd, encode ? DAEMON_ENCODE : DAEMON_DECODE,
+	                     input->data, input->length, &reply);
+	daemon_disconnect(fd);
+	if(status != DAEMON_OK){
+		fprintf(stderr, status < 0 ? "The daemon couldn't take %s\n" :
+		        encode ? "The daemon couldn't encode %s\n" :
+		        "The daemon couldn't decode %s, the file is corrupt or "
+		        "needs other models\n", inPath);
+		free(reply.data);
+		mapfile_close(input);
+		return EXIT_FAILURE;
+	}
+
+	outfilep = fopen(outPath, "wb");
+	if(outfilep == NULL ||
+	   fwrite(reply.data, 1, reply.length, outfilep) != reply.length ||
+	   fclose(outfilep) != 0){
+		fprintf(stderr, "Couldn't write output file %s\n", outPath);
+		free(reply.data);
+		mapfile_close(input);
+		return EXIT_FAILURE;
+	}
+	if(encode){
+		printf("%zu bytes read from %s.\n", input->length, inPath);
+		printf("%zu bytes used in encoded form.\n", reply.length);
+	} else {
+		printf("File decoded successfully!\n");
+	}
+	free(reply.data);
+	mapfile_close(input);
+	return 0;
+}
+
+/*
+ * loadGenerator - implements the -loadgen mode
+ *
+ * Parameter:   socketPath  - name of the socket of the daemon
+ *              inPath      - payload of the requests
+ *              options     - the settings, options->threads connections
+ *                            send options->requests requests of each kind
+ *
+ * The daemon first encodes the file and decodes the result once, which
+ * must give back the file. Then the file is encoded and its frame decoded
+ * as many times as asked, and the throughput and latency of each are
+ * printed.
+ */
+int loadGenerator(char *socketPath, char *inPath,
+                  const cliOptions *options){
+	daemonReply frame = { NULL, 0, 0 };
+	daemonReply decoded = { NULL, 0, 0 };
+	int clients = options->threads > 0 ? options->threads :
+	                                     batch_defaultThreads();
+	mapped_file *input = mapfile_open(inPath);
+	bool failed;
+	int fd;
+
+	if(input == NULL){
+		fprintf(stderr, "Couldn't open input file %s\n", inPath);
+		return wrongArgs();
+	}
+	fd = daemon_connect(socketPath);
+	if(fd < 0){
+		fprintf(stderr, "No daemon is listening on %s\n", socketPath);
+		mapfile_close(input);
+		return EXIT_FAILURE;
+	}
+	failed = daemon_call(fd, DAEMON_ENCODE, input->data, input->length,
+	                     &frame) != DAEMON_OK ||
+	         daemon_call(fd, DAEMON_DECODE, frame.data, frame.length,
+	                     &decoded) != DAEMON_OK ||
+	         decoded.length != input->length ||
+	         memcmp(decoded.data, input->data, input->length) != 0;
+	daemon_disconnect(fd);
+	free(decoded.data);
+	if(failed){
+		fprintf(stderr, "The daemon didn't give back %s\n", inPath);
+		free(frame.data);
+		mapfile_close(input);
+		return EXIT_FAILURE;
+	}
+
+	for(int pass = 0; pass < 2; pass++){
+		bool encode = pass == 0;
+		daemonBenchStats stats;
+
+		if(daemon_benchmark(socketPath,
+		                    encode ? DAEMON_ENCODE : DAEMON_DECODE,
+		                    encode ? input->data : frame.data,
+		                    encode ? input->length : frame.length, clients,
+		                    options->requests, &stats) != 0){
+			failed = true;
+		}
+		printf("%s: %" PRIu64 " requests of %zu bytes, %" PRIu64 " failed, "
+		       "with %d connections.\n", encode ? "encode" : "decode",
+		       stats.requests, encode ? input->length : frame.length,
+		       stats.failed, clients);
+		printf("%.0f requests/s, %.1f MB/s, latency median %.1f us, "
+		       "p99 %.1f us, max %.1f us.\n", stats.seconds > 0 ?
+		       (double)stats.requests / stats.seconds : 0.0,
+		       stats.seconds > 0 ? (double)stats.requests *
+		       (double)input->length / 1e6 / stats.seconds : 0.0,
+		       stats.median, stats.p99, stats.slowest);
+	}
+	free(frame.data);
+	mapfile_close(input);
+	return failed ? EXIT_FAILURE : 0;
+}
+
+/*
+ * isRecordFile - checks if a file is a record file
+ */
+bool isRecordFile(char *path){
+	unsigned char header[RECORD_HEADERSIZE];
+	size_t readBytes;
+	FILE *file = fopen(path, "rb");
+
+	if(file == NULL){
+		return false;
+	}
+	readBytes = fread(header, 1, sizeof(header), file);
+	fclose(file);
+	return record_isRecordFile(header, readBytes);
+}
+
+/*
+ * adaptiveCode - implements the -adaptive mode and decodes its streams
+ *
+ * Parameter:   encode          - true to encode, false to decode
+ *              inPath          - input file, "-" for standard input
+ *              outPath         - output file, "-" for standard output
+ *              rebuildInterval - symbols between rebuilds of the tree
+ *
+ * Both directions work on the data as it arrives, so they can be used in
+ * pipes of live streams.
+ */
+int adaptiveCode(bool encode, char *inPath, char *outPath,
+                 uint32_t rebuildInterval){
+	bool useStdin = !strcmp(inPath, "-");
+	bool useStdout = !strcmp(outPath, "-");
+	FILE *infilep = useStdin ? stdin : fopen(inPath, "rb");
+	FILE *outfilep;
+	int64_t result;
+
+	if(infilep == NULL){
+		fprintf(stderr, "Couldn't open input file %s\n", inPath);
+		return wrongArgs();
+	}
+	outfilep = useStdout ? stdout : fopen(outPath, "wb");
+	if(outfilep == NULL){
+		fprintf(stderr, "Couldn't open output file %s\n", outPath);
+		if(!useStdin){
+			fclose(infilep);
+		}
+		return wrongArgs();
+	}
+
+	if(encode){
+		uint64_t writeBytes = adaptive_encodeStream(infilep, outfilep,
+		                                            rebuildInterval);
+		result = writeBytes > 0 ? (int64_t)writeBytes : -1;
+	} else {
+		result = adaptive_decodeStream(infilep, outfilep);
+	}
+	if(!useStdin){
+		fclose(infilep);
+	}
+	if((!useStdout && fclose(outfilep) != 0) || result < 0){
+		fprintf(stderr, encode ? "Couldn't write output file %s\n" :
+		        "Couldn't decode %s, the stream is corrupt or truncated\n",
+		        encode ? outPath : inPath);
+		return EXIT_FAILURE;
+	}
+
+	// Keep standard output clean when it carries the data
+	FILE *report = useStdout ? stderr : stdout;
+	if(encode){
+		fprintf(report, "%" PRId64 " bytes used in encoded form.\n", result);
+	} else {
+		fprintf(report, "File decoded successfully!\n");
+	}
+	return 0;
+}
+
+/*
+ * isAdaptiveFile - checks if a file holds an adaptive stream
+ *
+ * Parameter:   path    - name of the file, "-" for standard input which
+ *                        can't be inspected and has to be an adaptive
+ *                        stream since frames need the whole file
+ */
+bool isAdaptiveFile(char *path){
+	unsigned char header[ADAPTIVE_HEADERSIZE];
+	size_t readBytes;
+	FILE *file;
+
+	if(!strcmp(path, "-")){
+		return true;
+	}
+	file = fopen(path, "rb");
+	if(file == NULL){
+		return false;
+	}
+	readBytes = fread(header, 1, sizeof(header), file);
+	fclose(file);
+	return adaptive_isStream(header, readBytes);
+}
+
+/*
+ * dryRun - implements the -dryrun mode
+ *
+ * Parameter:   inPath      - name of the file to measure
+ *              models      - frequency files to score, text or histogram
+ *              modelCount  - number of frequency files
+ *              options     - the settings: -blocksize for the estimated
+ *                            frames, -builtin to also score the built in
+ *                            model, -legacy to also score the legacy
+ *                            bitstream of every frequency file
+ *
+ * With several frequency files the last row is the frame of a registry
+ * of all of them (-encode FILE0,FILE0,...), which picks the cheapest
+ * model for every block.
+ *
+ * Nothing is coded. The histogram of every block is taken once and all
+ * models are scored against it in one pass (see codeTable_scoreTables);
+ * the payload bits are the exact sum of count * code length. The frame
+ * sizes follow the choices of frame_encode between the previous table,
+ * the model, a fresh table and storing the block, so they are exact for
+ * single stream frames of byte tables. Frames that may use other models
+ * or substreams are not estimated, main rejects their options.
+ */
+int dryRun(char *inPath, char **models, int modelCount,
+           const cliOptions *options){
+	mapped_file *input = mapfile_open(inPath);
+	int count = modelCount + (options->builtin ? 1 : 0);
+	int rows = count + (modelCount > 1 ? 2 : 1);
+	const codeTable **tables;
+	const codeTable **current;
+	codeTable **own;
+	codeTable *fresh;
+	uint64_t *blockBits;
+	uint64_t *modelBits;
+	uint64_t *frameBytes;
+	uint64_t frequency[256] = { 0 };
+	uint64_t freshBits = 0;
+	uint64_t overhead;
+	size_t blockSize = options->frame.blockSize;
+	uint64_t blocks;
+
+	if(input == NULL){
+		fprintf(stderr, "Couldn't open input file %s\n", inPath);
+		return EXIT_FAILURE;
+	}
+	tables = calloc(rows, sizeof(codeTable *));
+	for(int k = 0; k < modelCount; k++){
+		tables[k] = registry_loadTable(models[k]);
+		if(tables[k] == NULL){
+			fprintf(stderr, "Couldn't read frequency file %s\n", models[k]);
+			for(int j = 0; j < k; j++){
+				codeTable_free((codeTable *)tables[j]);
+			}
+			free(tables);
+			mapfile_close(input);
+			return EXIT_FAILURE;
+		}
+	}
+	if(options->builtin){
+		tables[modelCount] = builtin_table();
+	}
+
+	// Frame header, block headers and the end block
+	blocks = (input->length + blockSize - 1) / blockSize;
+	overhead = FRAME_HEADERSIZE + (blocks + 1) * FRAME_BLOCKHEADERSIZE;
+
+	/*
+	 * Row 0 is a frame of fresh tables only (-auto), row k + 1 a frame that
+	 * may also use model k, and the last row, if there are several files,
+	 * one that may use any of them. Every row has its own previous table.
+	 */
+	fresh = codeTable_create(256);
+	current = calloc(rows, sizeof(codeTable *));
+	own = malloc(rows * sizeof(codeTable *));
+	frameBytes = malloc(rows * sizeof(uint64_t));
+	for(int r = 0; r < rows; r++){
+		own[r] = codeTable_create(256);
+		frameBytes[r] = overhead;
+	}
+	blockBits = malloc(rows * sizeof(uint64_t));
+	modelBits = malloc(rows * sizeof(uint64_t));
+
+	for(size_t offset = 0; offset < input->length; offset += blockSize){
+		size_t blockLength = input->length - offset < blockSize ?
+		                     input->length - offset : blockSize;
+		uint64_t blockFrequency[256] = { 0 };
+		unsigned char lengths[256];
+		uint64_t tableBits;
+		uint64_t costFresh;
+
+		for(size_t i = 0; i < blockLength; i++){
+			blockFrequency[input->data[offset + i]]++;
+		}
+		for(int i = 0; i < 256; i++){
+			frequency[i] += blockFrequency[i];
+		}
+		getCodeLengths(blockFrequency, lengths, CODETABLE_MAXLENGTH);
+		codeTable_setLengths(fresh, lengths);
+		tableBits = codeTable_cost(fresh, blockFrequency);
+		freshBits += tableBits;
+		costFresh = tableBits + 8 * codeTable_serializedSize(fresh);
+
+		codeTable_scoreTables(tables, count, blockFrequency, blockBits);
+		for(int r = 0; r < rows; r++){
+			uint64_t costRepeat = current[r] == NULL ? UINT64_MAX :
+			                      codeTable_byteCost(current[r], blockFrequency);
+			uint64_t costGlobal = r == 0 ? UINT64_MAX : blockBits[r - 1];
+			int model = r - 1;
+			uint64_t costBest;
+
+			/*
+			 * Every model adds its fingerprint, the registry adds a byte
+			 * for the number of all but model 0
+			 */
+			if(r > 0 && r <= count && costGlobal != UINT64_MAX){
+				costGlobal += 8 * FRAME_FINGERPRINTSIZE;
+			}
+			if(r > count){
+				for(int k = 0; k < modelCount; k++){
+					uint64_t cost = blockBits[k];
+					if(cost != UINT64_MAX){
+						cost += 8 * FRAME_FINGERPRINTSIZE + (k > 0 ? 8 : 0);
+					}
+					if(k == 0 || cost < costGlobal){
+						costGlobal = cost;
+						model = k;
+					}
+				}
+			}
+
+			costBest = costRepeat < costGlobal ? costRepeat : costGlobal;
+			costBest = costFresh < costBest ? costFresh : costBest;
+
+			// The same choice as frame_encode, see there
+			if(costBest >= 8 * (uint64_t)blockLength){
+				frameBytes[r] += blockLength;
+				continue;
+			}
+			frameBytes[r] += (costBest + 7) / 8;
+			if(costRepeat <= costGlobal && costRepeat <= costFresh){
+				continue;
+			} else if(costGlobal <= costFresh){
+				current[r] = tables[model];
+			} else {
+				codeTable_setLengths(own[r], lengths);
+				current[r] = own[r];
+			}
+		}
+	}
+
+	// The payload of every model, from the histogram of the whole file
+	codeTable_scoreTables(tables, count, frequency, modelBits);
+
+	printf("%zu bytes in %s, %" PRIu64 " blocks of %zu bytes.\n",
+	       input->length, inPath, blocks, blockSize);
+	printf("%-32s %20s %16s\n", "model", "payload bits", "frame bytes");
+	printf("%-32s %20" PRIu64 " %16" PRIu64 "\n", "stored",
+	       8 * (uint64_t)input->length, overhead + input->length);
+	printf("%-32s %20" PRIu64 " %16" PRIu64 "\n", "fresh tables",
+	       freshBits, frameBytes[0]);
+	for(int k = 0; k < count; k++){
+		const char *name = k < modelCount ? models[k] : "builtin";
+		if(modelBits[k] == UINT64_MAX){
+			printf("%-32s %20s %16" PRIu64 "\n", name, "-",
+			       frameBytes[k + 1]);
+		} else {
+			printf("%-32s %20" PRIu64 " %16" PRIu64 "\n", name,
+			       modelBits[k], frameBytes[k + 1]);
+		}
+	}
+
+	if(rows > count + 1){
+		char name[40];
+		snprintf(name, sizeof(name), "registry of %d models", modelCount);
+		printf("%-32s %20s %16" PRIu64 "\n", name, "-", frameBytes[rows - 1]);
+	}
+
+	// The legacy bitstream has no blocks, only whole bytes are written
+	int result = 0;
+	for(int k = 0; options->legacy && k < modelCount; k++){
+		char name[40];
+		uint64_t bits = legacyCost(models[k], frequency);
+		if(bits == UINT64_MAX){
+			fprintf(stderr, "Couldn't read frequency file %s\n", models[k]);
+			result = EXIT_FAILURE;
+			break;
+		}
+		snprintf(name, sizeof(name), "legacy %s", models[k]);
+		printf("%-32s %20" PRIu64 " %16" PRIu64 "\n", name, bits, bits / 8);
+	}
+
+	for(int k = 0; k < modelCount; k++){
+		codeTable_free((codeTable *)tables[k]);
+	}
+	for(int r = 0; r < rows; r++){
+		codeTable_free(own[r]);
+	}
+	free(tables);
+	free(current);
+	free(own);
+	free(frameBytes);
+	free(blockBits);
+	free(modelBits);
+	codeTable_free(fresh);
+	mapfile_close(input);
+	return result;
+}
+
+/*
+ * legacyCost - computes the size of the legacy bitstream of some data
+ *
+ * Parameter:   freqPath    - frequency file of the legacy tree, see
+ *                            getFrequency
+ *              frequency   - count of every byte of the data
+ *
+ * Returns:     the number of bits, including the EOT character,
+ *              UINT64_MAX if the frequency file can't be read
+ */
+uint64_t legacyCost(char *freqPath, const uint64_t *frequency){
+	uint64_t legacyFrequency[256] = { 0 };
+	int navPath[256];
+	bitset *pathArray[256];
+	binary_tree *tree;
+	uint64_t bits;
+	FILE *freqFilep = fopen(freqPath, "rb");
+
+	if(freqFilep == NULL){
+		return UINT64_MAX;
+	}
+	if(getFrequency(legacyFrequency, freqFilep) != 0){
+		fclose(freqFilep);
+		return UINT64_MAX;
+	}
+	fclose(freqFilep);
+	tree = buildHuffmanTree(legacyFrequency, compareTrees);
+	traverseTree(binaryTree_root(tree), tree, navPath, 0, pathArray);
+
+	bits = bitset_size(pathArray[4]);
+	for(int i = 0; i < 256; i++){
+		bits += frequency[i] * bitset_size(pathArray[i]);
+		bitset_free(pathArray[i]);
+	}
+	binaryTree_free(tree);
+	return bits;
+}
+
+/*
+ * trainHistogram - implements the -train mode
+ *
+ * Parameter:   argc, argv - the command line arguments of the program:
+ *                           -train [-decay FACTOR] HISTFILE FILE...
+ *
+ * The histogram in HISTFILE is loaded (or started empty if the file does not
+ * exist), optionally multiplied by FACTOR, and the bytes of every FILE are
+ * added to it. Only the new files are read, so the cost of keeping a model
+ * up to date is proportional to the new data. The result replaces HISTFILE
+ * through a rename so a failed run never leaves a half written histogram.
+ */
+int trainHistogram(int argc, char **argv){
+	int argIndex = 2;
+	double decay = 1;
+	char *histPath;
+	char *tmpPath;
+	histogram *trained;
+	FILE *histFilep;
+
+	if(argIndex + 1 < argc && !strcmp(argv[argIndex], "-decay")){
+		char *end;
+		decay = strtod(argv[argIndex + 1], &end);
+		if(*end != '\0' || decay < 0 || decay > 1){
+			fprintf(stderr, "Decay factor must be a number in [0, 1]\n");
+			return wrongArgs();
+		}
+		argIndex += 2;
+	}
+	if(argc - argIndex < 2){
+		return wrongArgs();
+	}
+	histPath = argv[argIndex++];
+
+	// Load the existing histogram, if any
+	trained = histogram_empty();
+	histFilep = fopen(histPath, "rb");
+	if(histFilep != NULL){
+		if(histogram_read(trained, histFilep) != 0){
+			fprintf(stderr, "%s is not a histogram file\n", histPath);
+			fclose(histFilep);
+			histogram_free(trained);
+			return EXIT_FAILURE;
+		}
+		fclose(histFilep);
+		histogram_decay(trained, decay);
+	}
+
+	// Fold in the new training data
+	for(; argIndex < argc; argIndex++){
+		FILE *trainFilep = fopen(argv[argIndex], "rb");
+		if(trainFilep == NULL){
+			fprintf(stderr, "Couldn't open training file %s\n",
+			        argv[argIndex]);
+			histogram_free(trained);
+			return EXIT_FAILURE;
+		}
+		uint64_t readBytes = histogram_addFile(trained, trainFilep);
+		fclose(trainFilep);
+		printf("%" PRIu64 " bytes read from %s.\n", readBytes,
+		       argv[argIndex]);
+	}
+
+	// Write to a temporary file and move it into place
+	tmpPath = malloc(strlen(histPath) + 5);
+	sprintf(tmpPath, "%s.tmp", histPath);
+	histFilep = fopen(tmpPath, "wb");
+	if(histFilep == NULL || histogram_write(trained, histFilep) != 0 ||
+	   fclose(histFilep) != 0 || rename(tmpPath, histPath) != 0){
+		fprintf(stderr, "Couldn't write histogram file %s\n", histPath);
+		remove(tmpPath);
+		free(tmpPath);
+		histogram_free(trained);
+		return EXIT_FAILURE;
+	}
+	printf("%" PRIu64 " symbols counted in %s.\n", histogram_total(trained),
+	       histPath);
+	free(tmpPath);
+	histogram_free(trained);
+	return 0;
+}
+
+/*
+ * mergeHistograms - implements the -merge mode
+ *
+ * Parameter:   argc, argv - the command line arguments of the program:
+ *                           -merge OUTFILE HISTFILE[:WEIGHT]...
+ *
+ * Every histogram file is multiplied with its weight (default 1) and the
+ * sum is written to OUTFILE.
+ */
+int mergeHistograms(int argc, char **argv){
+	histogram *merged;
+	histogram *part;
+	FILE *outFilep;
+
+	if(argc < 4){
+		return wrongArgs();
+	}
+	merged = histogram_empty();
+	part = histogram_empty();
+	for(int argIndex = 3; argIndex < argc; argIndex++){
+		char *path = argv[argIndex];
+		char *separator = strrchr(path, ':');
+		double weight = 1;
+		FILE *histFilep;
+
+		// A trailing ':WEIGHT' is only a weight if it parses as a number
+		if(separator != NULL && separator[1] != '\0'){
+			char *end;
+			double parsed = strtod(separator + 1, &end);
+			if(*end == '\0' && parsed >= 0){
+				weight = parsed;
+				*separator = '\0';
+			}
+		}
+
+		histFilep = fopen(path, "rb");
+		if(histFilep == NULL || histogram_read(part, histFilep) != 0){
+			fprintf(stderr, "Couldn't read histogram file %s\n", path);
+			if(histFilep != NULL){
+				fclose(histFilep);
+			}
+			histogram_free(part);
+			histogram_free(merged);
+			return EXIT_FAILURE;
+		}
+		fclose(histFilep);
+		histogram_merge(merged, part, weight);
+	}
+
+	outFilep = fopen(argv[2], "wb");
+	if(outFilep == NULL || histogram_write(merged, outFilep) != 0){
+		fprintf(stderr, "Couldn't write histogram file %s\n", argv[2]);
+		if(outFilep != NULL){
+			fclose(outFilep);
+		}
+		histogram_free(part);
+		histogram_free(merged);
+		return EXIT_FAILURE;
+	}
+	fclose(outFilep);
+	printf("%" PRIu64 " symbols counted in %s.\n", histogram_total(merged),
+	       argv[2]);
+	histogram_free(part);
+	histogram_free(merged);
+	return 0;
 }
 
 /*
@@ -526,12 +2137,82 @@ void decodeFile(FILE* decodeThis, FILE* output, binary_tree* huffmanTree){
  * This function prints error message and usage and then returns 0.
  */
 int wrongArgs(void){
-	fprintf(stderr, "USAGE:\nhuffman [OPTION] [FILE0] [FILE1] [FILE2]\n");
+	fprintf(stderr, "USAGE:\nhuffman [OPTION] [-blocksize N] [-order1] "
+	"[-alphabet A] [-lz LEVEL] [-window N] [-ans] [-streams N] [-io B] "
+	"[-legacy] [-append] [FILE0] [FILE1] [FILE2]\n");
 	fprintf(stderr, "Options:\n-encode encodes FILE1 acording to the frequence" 
 	" analysis done on FILE0. ");
 	fprintf(stderr, "Stores the result in FILE2\n");
 	fprintf(stderr, "-decode decodes FILE1 acording to the frequence analysis" 
 	" done on FILE0. ");
 	fprintf(stderr, "Stores the result in FILE2\n");
+	fprintf(stderr, "-encode writes the frame format, which carries its "
+	"own tables and which versions of the program from before frames "
+	"can't read. -legacy writes the original bitstream instead. -decode "
+	"reads both formats.\n");
+	fprintf(stderr, "FILE0 is either a text file or a histogram file. "
+	"Frames may use several, separated by commas, every block is coded "
+	"with the best of them.\n");
+	fprintf(stderr, "-blocksize N sets the amount of data per block, "
+	"-order1 allows tables that depend on the previous byte, "
+	"-alphabet utf8|pair codes characters or byte pairs, "
+	"-lz 1-9 replaces repeated strings by matches reaching back at most "
+	"-window N bytes within a block (by default the whole block), "
+	"-ans allows tANS coding, close to the entropy of skewed data, "
+	"-streams 4|8 splits blocks into substreams that decode in parallel, "
+	"-legacy reads / writes the original bitstream format, -threads N "
+	"decodes it on N threads, -append adds FILE1 as a new frame to the "
+	"end of FILE2.\n");
+	fprintf(stderr, "\nhuffman -auto [-blocksize N] [-order1] [-alphabet A] "
+	"[-lz LEVEL] [-window N] [-ans] [-streams N] [-append] FILE1 FILE2\n");
+	fprintf(stderr, "-auto encodes FILE1 with a model built from FILE1 "
+	"itself and stores model and result in FILE2\n");
+	fprintf(stderr, "\nhuffman -adaptive [-rebuild N] FILE1 FILE2\n");
+	fprintf(stderr, "-adaptive encodes FILE1 in one pass, adapting the "
+	"model after every symbol. \"-\" is standard input / output.\n");
+	fprintf(stderr, "\nhuffman -encode|-decode -builtin [OPTIONS] FILE1 "
+	"FILE2\n");
+	fprintf(stderr, "-builtin uses the model compiled into the program "
+	"instead of FILE0\n");
+	fprintf(stderr, "\nhuffman -encode -records [-builtin] [FILE0] FILE1 "
+	"FILE2\n");
+	fprintf(stderr, "-records codes every line of FILE1 on its own with the "
+	"model of FILE0 or the built in model, for many small messages\n");
+	fprintf(stderr, "\nhuffman -encode|-decode -batch LIST [-threads N] "
+	"[OPTIONS] [FILE0]\n");
+	fprintf(stderr, "-batch codes every file in LIST, one per line as "
+	"\"INPUT\" or \"INPUT<tab>OUTPUT\", loading the model only once. "
+	"Outputs default to INPUT.huf when encoding and INPUT without .huf "
+	"when decoding.\n");
+	fprintf(stderr, "-io uring reads and writes frames with many I/Os in "
+	"flight where the system supports io_uring.\n");
+	fprintf(stderr, "\nhuffman -serve [-threads N] [OPTIONS] SOCKET "
+	"[FILE0]\n");
+	fprintf(stderr, "-serve encodes and decodes for clients of the Unix "
+	"socket SOCKET with the models loaded once, SIGHUP loads them again.\n");
+	fprintf(stderr, "\nhuffman -encode|-decode -connect SOCKET FILE1 "
+	"FILE2\n");
+	fprintf(stderr, "-connect has the daemon at SOCKET code FILE1 and "
+	"stores the result in FILE2\n");
+	fprintf(stderr, "\nhuffman -loadgen [-threads N] [-requests N] SOCKET "
+	"FILE1\n");
+	fprintf(stderr, "-loadgen sends N requests to encode FILE1 and N to "
+	"decode it over several connections and prints throughput and "
+	"latency.\n");
+	fprintf(stderr, "\nhuffman -decode FILE1 FILE2\n");
+	fprintf(stderr, "decodes FILE1 written by -auto or -adaptive, no FILE0 "
+	"is needed\n");
+	fprintf(stderr, "\nhuffman -dryrun [-blocksize N] [-builtin] [-legacy] "
+	"FILE1 [FILE0...]\n");
+	fprintf(stderr, "-dryrun prints the exact coded size of FILE1 with a "
+	"fresh table, the built in model and the model of every FILE0 (with "
+	"-legacy also as legacy bitstream) without coding anything. It "
+	"doesn't take -order1, -alphabet, -lz, -ans or -streams.\n");
+	fprintf(stderr, "\nhuffman -train [-decay FACTOR] HISTFILE FILE...\n");
+	fprintf(stderr, "-train adds the bytes of FILE... to HISTFILE, "
+	"multiplying its old counts with FACTOR first.\n");
+	fprintf(stderr, "\nhuffman -merge OUTFILE HISTFILE[:WEIGHT]...\n");
+	fprintf(stderr, "-merge stores the weighted sum of the histograms in "
+	"OUTFILE\n");
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,423 @@
+/* Construction of Huffman trees and code lengths from frequency tables,
+ * see huffmantree.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdlib.h>
+#include "huffmantree.h"
+
+typedef struct {
+	uint64_t count;
+	int symbol;
+} sortedCount;
+
+static void minimumRedundancy(uint64_t *a, int n);
+static int compareCounts(const void *a, const void *b);
+
+/*
+ * compareTrees - is the compare function used in the priorityQueue datatype
+ *
+ * Paramter:    tree1   - pointer to a binary tree datatype
+ *              tree2   - pointer to a binary tree dataype
+ *
+ * Comments:    This function assumes a freqChar struct to be stored as
+ *              the label of the binary tree. The actual comparison is done
+ *              between the 'value' of each tree's root.
+ */
+int compareTrees(VALUE tree1, VALUE tree2){
+	freqChar tmp1;
+	freqChar tmp2;
+	tmp1 = *(freqChar*)binaryTree_inspectLabel(tree1, binaryTree_root(tree1));
+	tmp2 = *(freqChar*)binaryTree_inspectLabel(tree2, binaryTree_root(tree2));
+	
+	// Compares the frequency value in the struct
+	if (tmp1.value > tmp2.value){
+		return 0;
+	}
+	else{
+		return 1;
+	}
+}
+
+/*
+ * buildHuffmanTree:    - This function builds a huffman tree from a frequency 
+ *                        table
+ *
+ * Parameter:           frequency   - a pointer to an array of length 256 
+ *                                    that represents an extended ASCII 
+ *                                    character frequency table generated by 
+ *                                    the function getFrequency
+ *                      compare     - pointer to a function that compares the 
+ *                                    root label of the two binary trees. This 
+ *                                    function will be used as argument for the 
+ *                                    priority queue datatype.
+ *
+ *  The function first makes root/leafs for all characters in the extended 
+ *  ASCII table with a frequency above zero and puts them in a priority queue
+ *  (datatype pqueue from prioqueue.c /.h). Then in a while loop, two elements at a time are removed 
+ *  from the priority queue. And linked into a new binary tree root. The label 
+ *  of the new tree root contains as value the combined values of the two 
+ *  children. This is repeated until just one element is left in the priority 
+ *  queue. The sum of all frequencies has to fit in 64 bits.
+ */
+binary_tree *buildHuffmanTree (const uint64_t *frequency,
+                               int (*compare)(VALUE, VALUE)){
+	pqueue *treebuildingQueue = pqueue_empty (compare);
+    int allChars;
+	binary_tree *tree1;
+	binary_tree *tree2;
+	binary_tree *newTree; 
+	
+	/*
+	 * Create one tree for each occurring character and put all of them in
+	 * a priority queue.
+	 */
+	for (allChars = 0; allChars < 256; allChars++){
+		if (frequency[allChars] == 0){
+			continue;
+		}
+		freqChar *nodeLabel = malloc(sizeof(freqChar));
+		nodeLabel->character = allChars;
+		nodeLabel->value = frequency[allChars];
+		newTree = binaryTree_create(); 
+		binaryTree_setMemHandler(newTree, free);
+		binaryTree_setLabel(newTree, nodeLabel, binaryTree_root(newTree));
+		pqueue_insert(treebuildingQueue, newTree);
+	}
+	
+
+    /*
+	 * While priority queue isn't empty take out the two front values and
+	 * connect these two trees with a new node (tree), put this new combined
+	 * tree in the queue.
+	 */
+    while(!pqueue_isEmpty(treebuildingQueue)){
+
+        // Create new tree with one node
+		newTree = binaryTree_create(); 
+		binaryTree_setMemHandler(newTree, free);
+
+
+		/*
+		 * Take out the first tree from the queue and save the values on its
+		 * label.
+		 */
+		tree1 = pqueue_inspect_first(treebuildingQueue);
+		freqChar *labelTree1 =
+                binaryTree_inspectLabel(tree1, binaryTree_root(tree1));
+		pqueue_delete_first(treebuildingQueue);
+		
+		// When the last tree has been taken out return that tree
+		if(pqueue_isEmpty(treebuildingQueue)){
+			binaryTree_free(newTree);
+			binaryTree_setMemHandler(tree1, free);
+			pqueue_free(treebuildingQueue); 
+			return tree1; 
+		}
+		else{
+			
+			/*
+			 * Take out the second tree from the queue and save the values on
+			 * its label.
+			 */
+			tree2 = pqueue_inspect_first(treebuildingQueue);
+			freqChar *labelTree2 =
+                    binaryTree_inspectLabel(tree2, binaryTree_root(tree2));
+			pqueue_delete_first(treebuildingQueue);
+			
+			// Initiate and give values to the new node label
+			freqChar *labelCombinedTree = malloc(sizeof(freqChar));
+			labelCombinedTree->value = labelTree1->value + labelTree2->value;
+			labelCombinedTree->character = -1;
+			
+			// Set label on the new tree and insert a left and right child
+			binaryTree_setLabel(newTree, labelCombinedTree,
+				binaryTree_root(newTree));
+			
+			/*
+			 * Set the two trees from the queue
+			 * as right/left child on the
+			 * new node.
+			 */
+			newTree->root->rightChild = tree1->root;
+			newTree->root->leftChild = tree2->root;
+			tree1->root->parent = newTree->root;
+			tree2->root->parent = newTree->root;
+			
+			// Insert the new tree in the queue
+			pqueue_insert(treebuildingQueue, newTree);
+			free(tree1);
+			free(tree2);
+		}
+	}
+	pqueue_free(treebuildingQueue);
+	return 0;
+}
+
+/*
+ * getCodeLengths - computes Huffman code lengths for the 256 byte symbols,
+ *                  see huffmantree.h
+ */
+int getCodeLengths(const uint64_t *frequency, unsigned char *lengths,
+                   int maxLength){
+	sortedCount sorted[256];
+	uint64_t depth[256];
+	uint64_t total = 0;
+	uint64_t divisor = 1;
+	int present = 0;
+	int longest;
+
+	for (int i = 0; i < 256; i++){
+		lengths[i] = 0;
+		if (frequency[i] > 0){
+			sorted[present].count = frequency[i];
+			sorted[present++].symbol = i;
+			total += frequency[i] < UINT64_MAX - total ?
+			         frequency[i] : UINT64_MAX - total;
+		}
+	}
+
+	// Trees of zero or one leaf have no edges to count
+	if (present <= 1){
+		if (present == 1){
+			lengths[sorted[0].symbol] = 1;
+		}
+		return present;
+	}
+	qsort(sorted, present, sizeof(sortedCount), compareCounts);
+
+	// The weight of the root must not overflow
+	while (total / divisor > UINT64_MAX / 2){
+		divisor *= 2;
+	}
+
+	do {
+		for (int i = 0; i < present; i++){
+			depth[i] = sorted[i].count / divisor > 0 ?
+			           sorted[i].count / divisor : 1;
+		}
+		minimumRedundancy(depth, present);
+
+		// The rarest symbol has the longest code
+		longest = (int)depth[0];
+
+		// Too deep: flatten the distribution and try again
+		divisor *= 2;
+	} while (longest > maxLength);
+
+	for (int i = 0; i < present; i++){
+		lengths[sorted[i].symbol] = (unsigned char)depth[i];
+	}
+	return longest;
+}
+
+/*
+ * getSparseCodeLengths - computes code lengths for many symbols, see
+ *                        huffmantree.h
+ *
+ * Leaves sorted by count form the first queue, the internal nodes the
+ * second; the internal nodes are created in non-decreasing order of
+ * weight, so the two smallest trees are always at the queue fronts. Only
+ * the parent of every node is kept, the depth of a node is the depth of
+ * its parent plus one.
+ */
+int getSparseCodeLengths(const uint64_t *frequency, int symbols,
+                         unsigned char *lengths, int maxLength){
+	sortedCount *sorted;
+	uint64_t *weight;
+	int *parent;
+	int *depth;
+	uint64_t total = 0;
+	uint64_t divisor = 1;
+	int longest;
+
+	if (symbols <= 1){
+		if (symbols == 1){
+			lengths[0] = 1;
+		}
+		return symbols;
+	}
+
+	sorted = malloc(symbols * sizeof(sortedCount));
+	for (int i = 0; i < symbols; i++){
+		sorted[i].count = frequency[i];
+		sorted[i].symbol = i;
+		total += frequency[i] < UINT64_MAX - total ?
+		         frequency[i] : UINT64_MAX - total;
+	}
+	qsort(sorted, symbols, sizeof(sortedCount), compareCounts);
+
+	weight = malloc((2 * symbols - 1) * sizeof(uint64_t));
+	parent = malloc((2 * symbols - 1) * sizeof(int));
+	depth = malloc((2 * symbols - 1) * sizeof(int));
+
+	// The weight of the root must not overflow
+	while (total / divisor > UINT64_MAX / 2){
+		divisor *= 2;
+	}
+
+	do {
+		int leaf = 0;
+		int node = symbols;
+		int nodes = symbols;
+
+		for (int i = 0; i < symbols; i++){
+			weight[i] = sorted[i].count / divisor > 0 ?
+			            sorted[i].count / divisor : 1;
+		}
+		while (nodes < 2 * symbols - 1){
+			int smallest[2];
+			for (int k = 0; k < 2; k++){
+				if (leaf < symbols &&
+				    (node == nodes || weight[leaf] <= weight[node])){
+					smallest[k] = leaf++;
+				} else {
+					smallest[k] = node++;
+				}
+			}
+			weight[nodes] = weight[smallest[0]] + weight[smallest[1]];
+			parent[smallest[0]] = nodes;
+			parent[smallest[1]] = nodes;
+			nodes++;
+		}
+
+		longest = 0;
+		depth[nodes - 1] = 0;
+		for (int i = nodes - 2; i >= 0; i--){
+			depth[i] = depth[parent[i]] + 1;
+			if (depth[i] > longest){
+				longest = depth[i];
+			}
+		}
+
+		// Too deep: flatten the distribution and try again
+		divisor *= 2;
+	} while (longest > maxLength);
+
+	for (int i = 0; i < symbols; i++){
+		lengths[sorted[i].symbol] = (unsigned char)depth[i];
+	}
+	free(sorted);
+	free(weight);
+	free(parent);
+	free(depth);
+	return longest;
+}
+
+/*
+ * getEscapeCodeLengths - computes code lengths for bytes and an escape
+ *                        symbol, see huffmantree.h
+ */
+int getEscapeCodeLengths(const uint64_t *frequency, unsigned char *lengths,
+                         int maxLength){
+	uint64_t counts[257];
+	unsigned char coded[257];
+	int symbol[257];
+	uint64_t total = 0;
+	uint64_t escaped = 1;
+	int present = 0;
+	int longest;
+
+	for (int i = 0; i < 256; i++){
+		total += frequency[i] < UINT64_MAX - total ?
+		         frequency[i] : UINT64_MAX - total;
+	}
+	for (int i = 0; i < 256; i++){
+		lengths[i] = 0;
+		if (frequency[i] > 0 && frequency[i] >= total >> maxLength){
+			counts[present] = frequency[i];
+			symbol[present++] = i;
+		} else {
+			escaped += frequency[i] < UINT64_MAX - escaped ?
+			           frequency[i] : UINT64_MAX - escaped;
+		}
+	}
+	counts[present] = escaped;
+	symbol[present++] = 256;
+
+	longest = getSparseCodeLengths(counts, present, coded, maxLength);
+	for (int i = 0; i < present; i++){
+		lengths[symbol[i]] = coded[i];
+	}
+	return longest;
+}
+
+/*
+ * minimumRedundancy - turns sorted weights into Huffman code lengths in
+ *                     place
+ *
+ * Parameter:   a   - array of n weights in non-decreasing order, receives
+ *                    the code length of every weight
+ *              n   - number of weights, at least 2
+ *
+ * Comments:    The method of Moffat and Katajainen. The first pass merges
+ *              the two smallest of the remaining leaves and internal nodes
+ *              like the two queue method, but stores every internal node
+ *              in the slot of a leaf that has already been merged, and
+ *              replaces the weight of a merged internal node by the index
+ *              of its parent. The second pass turns those parent indices
+ *              into depths of the internal nodes, the third hands out the
+ *              leaf depths level by level from the largest weight down.
+ *              Runs in linear time without any memory besides a.
+ */
+static void minimumRedundancy(uint64_t *a, int n){
+	int root = 0;
+	int leaf = 2;
+	int next;
+	uint64_t available;
+	uint64_t used;
+	uint64_t depth;
+
+	// Set parent pointers from left to right
+	a[0] += a[1];
+	for (next = 1; next < n - 1; next++){
+		if (leaf >= n || a[root] < a[leaf]){
+			a[next] = a[root];
+			a[root++] = next;
+		} else {
+			a[next] = a[leaf++];
+		}
+		if (leaf >= n || (root < next && a[root] < a[leaf])){
+			a[next] += a[root];
+			a[root++] = next;
+		} else {
+			a[next] += a[leaf++];
+		}
+	}
+
+	// Depths of the internal nodes from right to left, the root is last
+	a[n - 2] = 0;
+	for (next = n - 3; next >= 0; next--){
+		a[next] = a[a[next]] + 1;
+	}
+
+	// Depths of the leaves: every free node of a level is a leaf
+	available = 1;
+	used = 0;
+	depth = 0;
+	root = n - 2;
+	next = n - 1;
+	while (available > 0){
+		while (root >= 0 && a[root] == depth){
+			used++;
+			root--;
+		}
+		while (available > used){
+			a[next--] = depth;
+			available--;
+		}
+		available = 2 * used;
+		depth++;
+		used = 0;
+	}
+}
+
+static int compareCounts(const void *a, const void *b){
+	const sortedCount *countA = a;
+	const sortedCount *countB = b;
+	if (countA->count != countB->count){
+		return countA->count < countB->count ? -1 : 1;
+	}
+	return countA->symbol - countB->symbol;
+}
@@ -0,0 +1,93 @@
+/* Construction of Huffman trees and code lengths from frequency tables.
+ *
+ * The legacy bitstream (see huffman.c) walks a Huffman tree built with the
+ * datatypes 'tree_3cell' and 'prioqueue'. The code tables of the frame
+ * format (see codetable.h) only need code lengths, which are computed from
+ * sorted counts without building a tree.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __HUFFMANTREE_H
+#define __HUFFMANTREE_H
+
+#include <stdint.h>
+#include "tree_3cell.h"
+#include "prioqueue.h"
+
+/*
+ * Struct 'freqChar'
+ * Node for 'tree_3cell' datatype that allows
+ * to store both a frequency and a character value
+ */
+typedef struct {
+  uint64_t value;
+  unsigned char character;
+} freqChar;
+
+int compareTrees(VALUE tree1, VALUE tree2);
+binary_tree *buildHuffmanTree (const uint64_t *frequency,
+                               int (*compare)(VALUE, VALUE));
+
+/*
+ * getCodeLengths - computes Huffman code lengths for the 256 byte symbols
+ *
+ * Parameter:   frequency   - array of 256 symbol counts. Symbols with
+ *                            count 0 get no code.
+ *              lengths     - array of 256 that receives the code length of
+ *                            every symbol, 0 for symbols without code
+ *              maxLength   - longest code length allowed
+ *
+ * Returns:     the longest code length assigned, 0 if no symbol occurs
+ *
+ * Comments:    Only the lengths are computed: the counts are sorted and
+ *              turned into code lengths in place in one array, no tree
+ *              nodes are allocated, which keeps building a table per block
+ *              cheap. When the code gets longer than maxLength the counts
+ *              are flattened and the lengths computed again until they
+ *              fit. A single occurring symbol gets a code of length 1.
+ */
+int getCodeLengths(const uint64_t *frequency, unsigned char *lengths,
+                   int maxLength);
+
+/*
+ * getSparseCodeLengths - computes Huffman code lengths for any number of
+ *                        symbols
+ *
+ * Parameter:   frequency   - array of symbols counts, all of them > 0
+ *              symbols     - number of symbols
+ *              lengths     - array that receives the code lengths
+ *              maxLength   - longest code length allowed
+ *
+ * Returns:     the longest code length assigned, 0 if symbols is 0
+ *
+ * Comments:    Meant for alphabets with many symbols, where a linked list
+ *              priority queue would be too slow. The counts are sorted once
+ *              and merged with two queues in linear time, so no tree nodes
+ *              are allocated. Too deep codes are handled like in
+ *              getCodeLengths.
+ */
+int getSparseCodeLengths(const uint64_t *frequency, int symbols,
+                         unsigned char *lengths, int maxLength);
+
+/*
+ * getEscapeCodeLengths - computes code lengths for the 256 byte symbols and
+ *                        an escape symbol
+ *
+ * Parameter:   frequency   - array of 256 byte counts
+ *              lengths     - array of 257 that receives the code lengths,
+ *                            the last one for the escape symbol
+ *              maxLength   - longest code length allowed
+ *
+ * Returns:     the longest code length assigned
+ *
+ * Comments:    Bytes that don't occur, or are so rare that their ideal
+ *              code would be longer than maxLength, get no code and are
+ *              sent as the escape code followed by a literal instead. The
+ *              escape symbol is weighted with their combined count, at
+ *              least 1, so it always gets a code.
+ */
+int getEscapeCodeLengths(const uint64_t *frequency, unsigned char *lengths,
+                         int maxLength);
+
+#endif
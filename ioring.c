@@ -0,0 +1,518 @@
+/* Implementation of the datatype 'ioring', see ioring.h.
+ *
+ * The ring is driven with the raw system calls, so no library is needed
+ * beyond the kernel headers. Every operation in flight owns one of
+ * IORING_DEPTH slots; a write slot also owns the registered buffer with
+ * the same index. Operations are queued in the submission ring and only
+ * handed to the kernel when the program has to wait for a completion, so
+ * every io_uring_enter submits a batch.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ioring.h"
+
+#ifdef HUFFMAN_IO_URING
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+/*
+ * Struct 'ioringFile'
+ * A file opened with ioring_openWriter
+ *
+ *      ring    - the ring it is written through
+ *      fd      - file descriptor
+ *      name    - name of the file, for error messages
+ *      offset  - position of the next write
+ *      slot    - slot whose buffer is being filled, -1 if none
+ *      fill    - bytes in the buffer of slot
+ *      pending - writes in flight
+ *      closing - fclose has been called
+ *      failed  - a write failed
+ */
+typedef struct {
+    ioring *ring;
+    int fd;
+    char *name;
+    uint64_t offset;
+    int slot;
+    size_t fill;
+    unsigned pending;
+    bool closing;
+    bool failed;
+} ioringFile;
+
+/*
+ * Struct 'ioringSlot'
+ * An operation in flight
+ *
+ *      file    - file of a write, NULL for a read
+ *      fd      - file descriptor of a read
+ *      data    - destination of a read, source of a write
+ *      length  - number of bytes to transfer
+ *      offset  - position in the file
+ */
+typedef struct {
+    ioringFile *file;
+    int fd;
+    unsigned char *data;
+    size_t length;
+    uint64_t offset;
+} ioringSlot;
+
+struct ioring {
+    int fd;
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_cqe *cqes;
+    unsigned tail;
+    unsigned queued;
+    unsigned char *buffers;
+    bool registered;
+    ioringSlot slots[IORING_DEPTH];
+    int freeSlots[IORING_DEPTH];
+    int freeCount;
+    unsigned readsPending;
+    bool readFailed;
+    int errors;
+};
+
+static int takeSlot(ioring *r);
+static void queue(ioring *r, int slot, int opcode);
+static int waitCompletion(ioring *r);
+static void complete(ioring *r, int slot, int result);
+static void submitFill(ioringFile *f);
+static void finishFile(ioringFile *f);
+static ssize_t writerWrite(void *cookie, const char *data, size_t size);
+static int writerClose(void *cookie);
+
+ioring *ioring_create(void){
+	struct io_uring_params params;
+	struct iovec vectors[IORING_DEPTH];
+	ioring *r;
+	int fd;
+
+	memset(&params, 0, sizeof(params));
+	fd = (int)syscall(__NR_io_uring_setup, IORING_DEPTH, &params);
+	if(fd < 0){
+		return NULL;
+	}
+	r = calloc(1, sizeof(ioring));
+	r->fd = fd;
+	r->sqRingSize = params.sq_off.array +
+	                params.sq_entries * sizeof(unsigned);
+	r->cqRingSize = params.cq_off.cqes +
+	                params.cq_entries * sizeof(struct io_uring_cqe);
+	if(params.features & IORING_FEAT_SINGLE_MMAP){
+		if(r->cqRingSize > r->sqRingSize){
+			r->sqRingSize = r->cqRingSize;
+		}
+		r->cqRingSize = 0;
+	}
+	r->sqRing = mmap(NULL, r->sqRingSize, PROT_READ | PROT_WRITE,
+	                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	r->cqRing = r->sqRing;
+	if(r->sqRing != MAP_FAILED && r->cqRingSize > 0){
+		r->cqRing = mmap(NULL, r->cqRingSize, PROT_READ | PROT_WRITE,
+		                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	}
+	r->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqesSize, PROT_READ | PROT_WRITE,
+	               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if(r->sqRing == MAP_FAILED || r->cqRing == MAP_FAILED ||
+	   r->sqes == MAP_FAILED){
+		if(r->sqRing != MAP_FAILED){
+			munmap(r->sqRing, r->sqRingSize);
+		}
+		if(r->cqRing != MAP_FAILED && r->cqRingSize > 0){
+			munmap(r->cqRing, r->cqRingSize);
+		}
+		if(r->sqes != MAP_FAILED){
+			munmap(r->sqes, r->sqesSize);
+		}
+		close(fd);
+		free(r);
+		return NULL;
+	}
+	r->sqHead = (unsigned *)((char *)r->sqRing + params.sq_off.head);
+	r->sqTail = (unsigned *)((char *)r->sqRing + params.sq_off.tail);
+	r->sqMask = (unsigned *)((char *)r->sqRing + params.sq_off.ring_mask);
+	r->sqArray = (unsigned *)((char *)r->sqRing + params.sq_off.array);
+	r->cqHead = (unsigned *)((char *)r->cqRing + params.cq_off.head);
+	r->cqTail = (unsigned *)((char *)r->cqRing + params.cq_off.tail);
+	r->cqMask = (unsigned *)((char *)r->cqRing + params.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)((char *)r->cqRing +
+	                                  params.cq_off.cqes);
+	r->tail = *r->sqTail;
+
+	// Registered buffers save the kernel mapping them on every write
+	r->buffers = malloc((size_t)IORING_DEPTH * IORING_BUFFERSIZE);
+	for(int i = 0; i < IORING_DEPTH; i++){
+		vectors[i].iov_base = r->buffers + (size_t)i * IORING_BUFFERSIZE;
+		vectors[i].iov_len = IORING_BUFFERSIZE;
+		r->freeSlots[i] = IORING_DEPTH - 1 - i;
+	}
+	r->freeCount = IORING_DEPTH;
+	r->registered = syscall(__NR_io_uring_register, fd,
+	                        IORING_REGISTER_BUFFERS, vectors,
+	                        IORING_DEPTH) == 0;
+	return r;
+}
+
+void ioring_free(ioring *r){
+	if(r == NULL){
+		return;
+	}
+	ioring_flush(r);
+	munmap(r->sqes, r->sqesSize);
+	if(r->cqRing != r->sqRing){
+		munmap(r->cqRing, r->cqRingSize);
+	}
+	munmap(r->sqRing, r->sqRingSize);
+	close(r->fd);
+	free(r->buffers);
+	free(r);
+}
+
+mapped_file *ioring_readFile(ioring *r, const char *path){
+	struct stat info;
+	mapped_file *m;
+	unsigned char *data;
+	size_t length;
+	int fd;
+
+	if(r == NULL){
+		return mapfile_open(path);
+	}
+	fd = open(path, O_RDONLY);
+	if(fd < 0){
+		return NULL;
+	}
+
+	// Pipes and special files have no size to split into reads
+	if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)){
+		close(fd);
+		return mapfile_open(path);
+	}
+	length = (size_t)info.st_size;
+	data = malloc(length > 0 ? length : 1);
+	r->readFailed = false;
+	for(size_t offset = 0; offset < length; offset += IORING_BUFFERSIZE){
+		int slot = takeSlot(r);
+		r->slots[slot].file = NULL;
+		r->slots[slot].fd = fd;
+		r->slots[slot].data = data + offset;
+		r->slots[slot].length = length - offset < IORING_BUFFERSIZE ?
+		                        length - offset : IORING_BUFFERSIZE;
+		r->slots[slot].offset = offset;
+		r->readsPending++;
+		queue(r, slot, IORING_OP_READ);
+	}
+	while(r->readsPending > 0){
+		if(waitCompletion(r) != 0){
+			// Reads may still land in data, so it can't be freed
+			close(fd);
+			return NULL;
+		}
+	}
+	close(fd);
+	if(r->readFailed){
+		free(data);
+		return NULL;
+	}
+	m = calloc(1, sizeof(mapped_file));
+	m->data = data;
+	m->length = length;
+	m->mapped = false;
+	return m;
+}
+
+FILE *ioring_openWriter(ioring *r, const char *path){
+	cookie_io_functions_t functions = { NULL, writerWrite, NULL,
+	                                    writerClose };
+	ioringFile *f;
+	FILE *stream;
+	int fd;
+
+	if(r == NULL){
+		return fopen(path, "wb");
+	}
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(fd < 0){
+		return NULL;
+	}
+	f = calloc(1, sizeof(ioringFile));
+	f->ring = r;
+	f->fd = fd;
+	f->name = strdup(path);
+	f->slot = -1;
+	stream = fopencookie(f, "wb", functions);
+	if(stream == NULL){
+		close(fd);
+		free(f->name);
+		free(f);
+		return NULL;
+	}
+
+	// The slot buffers already collect the data
+	setvbuf(stream, NULL, _IONBF, 0);
+	return stream;
+}
+
+int ioring_flush(ioring *r){
+	int errors;
+
+	if(r == NULL){
+		return 0;
+	}
+	while(r->freeCount < IORING_DEPTH){
+		if(waitCompletion(r) != 0){
+			break;
+		}
+	}
+	errors = r->errors;
+	r->errors = 0;
+	return errors;
+}
+
+/*
+ * takeSlot - returns a free slot, waiting for an operation to complete if
+ *            all are in flight
+ */
+static int takeSlot(ioring *r){
+	while(r->freeCount == 0){
+		waitCompletion(r);
+	}
+	return r->freeSlots[--r->freeCount];
+}
+
+/*
+ * queue - adds the operation of a slot to the submission ring, it is
+ *         submitted by the next waitCompletion
+ */
+static void queue(ioring *r, int slot, int opcode){
+	unsigned index = r->tail & *r->sqMask;
+	struct io_uring_sqe *sqe = &r->sqes[index];
+	ioringSlot *s = &r->slots[slot];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = (unsigned char)opcode;
+	sqe->fd = s->file != NULL ? s->file->fd : s->fd;
+	sqe->addr = (uint64_t)(uintptr_t)s->data;
+	sqe->len = (unsigned)s->length;
+	sqe->off = s->offset;
+	sqe->user_data = (uint64_t)slot;
+	if(opcode == IORING_OP_WRITE_FIXED){
+		sqe->buf_index = (uint16_t)slot;
+	}
+	r->sqArray[index] = index;
+	r->tail++;
+	r->queued++;
+	__atomic_store_n(r->sqTail, r->tail, __ATOMIC_RELEASE);
+}
+
+/*
+ * waitCompletion - submits the queued operations, waits until at least one
+ *                  operation is complete and handles all completions
+ *
+ * Returns:     0 on success, -1 if the ring failed
+ */
+static int waitCompletion(ioring *r){
+	unsigned head = *r->cqHead;
+
+	if(head == __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE)){
+		long submitted;
+		do {
+			submitted = syscall(__NR_io_uring_enter, r->fd, r->queued, 1,
+			                    IORING_ENTER_GETEVENTS, NULL, 0);
+		} while(submitted < 0 && errno == EINTR);
+		if(submitted < 0){
+			return -1;
+		}
+		r->queued -= (unsigned)submitted;
+	}
+
+	for(unsigned tail = __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE);
+	    head != tail; head++){
+		struct io_uring_cqe *cqe = &r->cqes[head & *r->cqMask];
+		complete(r, (int)cqe->user_data, cqe->res);
+	}
+	__atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*
+ * complete - finishes an operation and frees its slot
+ *
+ * Parameter:   slot    - slot of the operation
+ *              result  - bytes transferred or -errno
+ *
+ * Comments:    Short transfers are rare for regular files and are finished
+ *              with a blocking pread / pwrite.
+ */
+static void complete(ioring *r, int slot, int result){
+	ioringSlot *s = &r->slots[slot];
+	ioringFile *f = s->file;
+	size_t done = result > 0 ? (size_t)result : 0;
+	int fd = f != NULL ? f->fd : s->fd;
+	bool failed = result < 0;
+
+	while(!failed && done < s->length){
+		ssize_t more = f != NULL ?
+		        pwrite(fd, s->data + done, s->length - done,
+		               (off_t)(s->offset + done)) :
+		        pread(fd, s->data + done, s->length - done,
+		              (off_t)(s->offset + done));
+		failed = more <= 0;
+		done += more > 0 ? (size_t)more : 0;
+	}
+	r->freeSlots[r->freeCount++] = slot;
+
+	if(f == NULL){
+		r->readsPending--;
+		r->readFailed |= failed;
+		return;
+	}
+	s->file = NULL;
+	f->failed |= failed;
+	f->pending--;
+	if(f->closing && f->pending == 0){
+		finishFile(f);
+	}
+}
+
+/*
+ * submitFill - queues the write of the buffer being filled
+ */
+static void submitFill(ioringFile *f){
+	ioring *r = f->ring;
+	ioringSlot *s = &r->slots[f->slot];
+
+	s->length = f->fill;
+	s->offset = f->offset;
+	f->offset += f->fill;
+	f->pending++;
+	queue(r, f->slot, r->registered ? IORING_OP_WRITE_FIXED :
+	                                  IORING_OP_WRITE);
+	f->slot = -1;
+	f->fill = 0;
+}
+
+/*
+ * finishFile - closes a file whose writes are all done
+ */
+static void finishFile(ioringFile *f){
+	if(close(f->fd) != 0 || f->failed){
+		fprintf(stderr, "Couldn't write output file %s\n", f->name);
+		f->ring->errors++;
+	}
+	free(f->name);
+	free(f);
+}
+
+/*
+ * writerWrite - write function of the streams of ioring_openWriter, copies
+ *               data into slot buffers and queues them when they are full
+ */
+static ssize_t writerWrite(void *cookie, const char *data, size_t size){
+	ioringFile *f = cookie;
+	ioring *r = f->ring;
+	size_t written = 0;
+
+	if(f->failed){
+		return -1;
+	}
+	while(written < size){
+		size_t part;
+		if(f->slot < 0){
+			f->slot = takeSlot(r);
+			r->slots[f->slot].file = f;
+			r->slots[f->slot].data = r->buffers +
+			                         (size_t)f->slot * IORING_BUFFERSIZE;
+		}
+		part = IORING_BUFFERSIZE - f->fill;
+		if(part > size - written){
+			part = size - written;
+		}
+		memcpy(r->slots[f->slot].data + f->fill, data + written, part);
+		f->fill += part;
+		written += part;
+		if(f->fill == IORING_BUFFERSIZE){
+			submitFill(f);
+		}
+	}
+	return (ssize_t)size;
+}
+
+/*
+ * writerClose - close function of the streams of ioring_openWriter, the
+ *               file is closed when its last write is done
+ */
+static int writerClose(void *cookie){
+	ioringFile *f = cookie;
+
+	if(f->slot >= 0 && f->fill > 0){
+		submitFill(f);
+	} else if(f->slot >= 0){
+		f->ring->slots[f->slot].file = NULL;
+		f->ring->freeSlots[f->ring->freeCount++] = f->slot;
+	}
+	f->closing = true;
+	if(f->pending == 0){
+		finishFile(f);
+	}
+	return 0;
+}
+
+#else
+
+struct ioring {
+    int unused;
+};
+
+ioring *ioring_create(void){
+	return NULL;
+}
+
+void ioring_free(ioring *r){
+	(void)r;
+}
+
+mapped_file *ioring_readFile(ioring *r, const char *path){
+	(void)r;
+	return mapfile_open(path);
+}
+
+FILE *ioring_openWriter(ioring *r, const char *path){
+	(void)r;
+	return fopen(path, "wb");
+}
+
+int ioring_flush(ioring *r){
+	(void)r;
+	return 0;
+}
+
+#endif
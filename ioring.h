@@ -0,0 +1,86 @@
+/* Datatype 'ioring' - asynchronous file I/O with Linux io_uring.
+ *
+ * Mapped input is read by page faults and output by fwrite, which keeps
+ * only one I/O in flight at a time. On fast storage that leaves the device
+ * idle while the program waits for every single request. An ioring keeps
+ * up to IORING_DEPTH reads and writes in flight and submits them to the
+ * kernel in batches:
+ *
+ *  - ioring_readFile reads a whole file with IORING_DEPTH chunk reads in
+ *    flight, straight into the buffer that holds the file.
+ *  - ioring_openWriter returns a FILE whose data is copied into buffers
+ *    registered with the kernel and written from there while the program
+ *    goes on coding. Files are closed once their last write is done, so
+ *    the writes of one file overlap with reading and coding the next.
+ *
+ * Every function also accepts a NULL ring and then falls back to buffered
+ * I/O (mapfile_open / fopen), which is also what ioring_create's callers
+ * get on systems without io_uring or builds with HUFFMAN_IO_URING turned
+ * off. An ioring is used by one thread only.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __IORING_H
+#define __IORING_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "mapfile.h"
+
+// Most reads and writes in flight at once
+#define IORING_DEPTH 32
+
+// Size of every registered write buffer and of every read
+#define IORING_BUFFERSIZE (1 << 18)
+
+typedef struct ioring ioring;
+
+/*
+ * ioring_create - sets up a ring and registers its write buffers
+ *
+ * Returns:     the ring, NULL if io_uring isn't available
+ */
+ioring *ioring_create(void);
+
+/*
+ * ioring_free - waits for all writes, closes their files and deallocates
+ *               the ring
+ */
+void ioring_free(ioring *r);
+
+/*
+ * ioring_readFile - reads a whole file into memory
+ *
+ * Parameter:   r       - the ring, NULL for mapfile_open
+ *              path    - name of the file
+ *
+ * Returns:     the contents, NULL if the file couldn't be read. Deallocate
+ *              with mapfile_close.
+ */
+mapped_file *ioring_readFile(ioring *r, const char *path);
+
+/*
+ * ioring_openWriter - creates a file and opens it for writing through the
+ *                     ring
+ *
+ * Parameter:   r       - the ring, NULL for fopen
+ *              path    - name of the file
+ *
+ * Returns:     the stream, NULL if the file couldn't be created
+ *
+ * Comments:    fclose returns before the data is written, errors of the
+ *              remaining writes are reported by ioring_flush.
+ */
+FILE *ioring_openWriter(ioring *r, const char *path);
+
+/*
+ * ioring_flush - waits until all writes are done and their files closed
+ *
+ * Returns:     number of files written through the ring that couldn't be
+ *              written since the last flush, each is also reported on
+ *              stderr
+ */
+int ioring_flush(ioring *r);
+
+#endif
@@ -0,0 +1,321 @@
+/* Implementations of the coding kernels, see kernels.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "kernels.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#define CODEMASK ((UINT32_C(1) << KERNELS_LENGTHSHIFT) - 1)
+
+static size_t encodeScalar(const uint32_t *packed, const unsigned char *input,
+                           size_t length, unsigned char *output);
+static int decodeScalar(const decodeTable *table, bitReader *reader,
+                        int streams, unsigned char *const *output,
+                        const size_t *count);
+static const codingKernels *selectKernels(void);
+
+static const codingKernels scalarKernels = {
+	"scalar", encodeScalar, decodeScalar
+};
+static const codingKernels *selected = NULL;
+
+const codingKernels *kernels_get(void){
+	if(selected == NULL){
+		selected = selectKernels();
+	}
+	return selected;
+}
+
+void kernels_packTable(const codeTable *t, uint32_t *packed){
+	uint32_t escapeCode = 0;
+	uint32_t escapeLength = 0;
+
+	if(t->symbols > CODETABLE_ESCAPE){
+		escapeCode = t->code[CODETABLE_ESCAPE];
+		escapeLength = t->length[CODETABLE_ESCAPE];
+	}
+	for(int i = 0; i < 256; i++){
+		if(t->length[i] > 0){
+			packed[i] = t->code[i] |
+			            (uint32_t)t->length[i] << KERNELS_LENGTHSHIFT;
+		} else {
+			packed[i] = (escapeCode | (uint32_t)i << escapeLength) |
+			            (escapeLength + CODETABLE_LITERALBITS) <<
+			            KERNELS_LENGTHSHIFT;
+		}
+	}
+}
+
+/*
+ * encodeScalar - portable encoder, one table entry per byte
+ */
+static size_t encodeScalar(const uint32_t *packed, const unsigned char *input,
+                           size_t length, unsigned char *output){
+	bitWriter writer;
+
+	bitWriter_init(&writer, output);
+	for(size_t i = 0; i < length; i++){
+		uint32_t entry = packed[input[i]];
+		bitWriter_put(&writer, entry & CODEMASK,
+		              (int)(entry >> KERNELS_LENGTHSHIFT));
+	}
+	return bitWriter_finish(&writer);
+}
+
+/*
+ * decodeSymbol - decodes one byte, reading the literal after an escape
+ *
+ * Returns:     the byte, -1 if the bits are not a valid code
+ */
+static inline int32_t decodeSymbol(const decodeTable *table,
+                                   bitReader *reader){
+	int32_t symbol;
+
+	if(reader->bits < CODETABLE_MAXLENGTH){
+		bitReader_refill(reader);
+	}
+	symbol = decodeTable_decode(table, reader);
+	if(symbol == CODETABLE_ESCAPE){
+		symbol = (int32_t)bitReader_read(reader, CODETABLE_LITERALBITS);
+	}
+	return symbol;
+}
+
+/*
+ * decodeScalar - portable decoder
+ *
+ * One symbol of every stream is decoded per round while all streams have
+ * symbols left, then the rest of the longer streams.
+ */
+static int decodeScalar(const decodeTable *table, bitReader *reader,
+                        int streams, unsigned char *const *output,
+                        const size_t *count){
+	size_t rounds = SIZE_MAX;
+
+	for(int s = 0; s < streams; s++){
+		rounds = count[s] < rounds ? count[s] : rounds;
+	}
+	for(size_t i = 0; i < rounds; i++){
+		for(int s = 0; s < streams; s++){
+			int32_t symbol = decodeSymbol(table, &reader[s]);
+			if(symbol < 0){
+				return -1;
+			}
+			output[s][i] = (unsigned char)symbol;
+		}
+	}
+	for(int s = 0; s < streams; s++){
+		for(size_t i = rounds; i < count[s]; i++){
+			int32_t symbol = decodeSymbol(table, &reader[s]);
+			if(symbol < 0){
+				return -1;
+			}
+			output[s][i] = (unsigned char)symbol;
+		}
+	}
+	return 0;
+}
+
+#ifdef KERNELS_X86
+
+/*
+ * The writer of the x86 encoders keeps fewer than 8 bits in its container
+ * between codes. After adding codes it stores all 8 bytes of the container
+ * and advances by the whole bytes, so it never branches on the fill level.
+ * Up to 56 bits can be added between two stores.
+ */
+#define FLUSHBYTES(output, position, container, bits) \
+	do { \
+		storeLittleEndian((output) + (position), (container), 8); \
+		(position) += (size_t)((bits) >> 3); \
+		(container) >>= (bits) & ~7; \
+		(bits) &= 7; \
+	} while(0)
+
+/*
+ * encodeBmi2 - encoder without branches in the writer, two bytes per store
+ */
+__attribute__((target("bmi2")))
+static size_t encodeBmi2(const uint32_t *packed, const unsigned char *input,
+                         size_t length, unsigned char *output){
+	uint64_t container = 0;
+	int bits = 0;
+	size_t position = 0;
+	size_t i = 0;
+
+	for(; i + 2 <= length; i += 2){
+		uint32_t first = packed[input[i]];
+		uint32_t second = packed[input[i + 1]];
+		container |= (uint64_t)_bzhi_u32(first, KERNELS_LENGTHSHIFT) << bits;
+		bits += (int)(first >> KERNELS_LENGTHSHIFT);
+		container |= (uint64_t)_bzhi_u32(second, KERNELS_LENGTHSHIFT) << bits;
+		bits += (int)(second >> KERNELS_LENGTHSHIFT);
+		FLUSHBYTES(output, position, container, bits);
+	}
+	for(; i < length; i++){
+		uint32_t entry = packed[input[i]];
+		container |= (uint64_t)_bzhi_u32(entry, KERNELS_LENGTHSHIFT) << bits;
+		bits += (int)(entry >> KERNELS_LENGTHSHIFT);
+		FLUSHBYTES(output, position, container, bits);
+	}
+	storeLittleEndian(output + position, container, 8);
+	return position + (size_t)((bits + 7) >> 3);
+}
+
+/*
+ * encodeAvx2 - encoder that looks up 8 bytes with one gather
+ *
+ * The codes of bytes 2k and 2k + 1 share a 64-bit lane, where the second
+ * code is shifted behind the first. The 4 merged codes of at most 46 bits
+ * are then added to the writer one after the other.
+ */
+__attribute__((target("avx2,bmi2")))
+static size_t encodeAvx2(const uint32_t *packed, const unsigned char *input,
+                         size_t length, unsigned char *output){
+	const __m256i codeMask = _mm256_set1_epi32((int)CODEMASK);
+	const __m256i lowHalf = _mm256_set1_epi64x(0xffffffff);
+	uint64_t merged[4];
+	uint64_t mergedLength[4];
+	uint64_t container = 0;
+	int bits = 0;
+	size_t position = 0;
+	size_t i = 0;
+
+	for(; i + 8 <= length; i += 8){
+		__m256i index = _mm256_cvtepu8_epi32(
+		        _mm_loadl_epi64((const __m128i *)(input + i)));
+		__m256i entry = _mm256_i32gather_epi32((const int *)packed, index, 4);
+		__m256i code = _mm256_and_si256(entry, codeMask);
+		__m256i codeLength = _mm256_srli_epi32(entry, KERNELS_LENGTHSHIFT);
+		__m256i firstLength = _mm256_and_si256(codeLength, lowHalf);
+
+		_mm256_storeu_si256((__m256i *)merged, _mm256_or_si256(
+		        _mm256_and_si256(code, lowHalf),
+		        _mm256_sllv_epi64(_mm256_srli_epi64(code, 32), firstLength)));
+		_mm256_storeu_si256((__m256i *)mergedLength, _mm256_add_epi64(
+		        firstLength, _mm256_srli_epi64(codeLength, 32)));
+		for(int k = 0; k < 4; k++){
+			container |= merged[k] << bits;
+			bits += (int)mergedLength[k];
+			FLUSHBYTES(output, position, container, bits);
+		}
+	}
+	for(; i < length; i++){
+		uint32_t entry = packed[input[i]];
+		container |= (uint64_t)_bzhi_u32(entry, KERNELS_LENGTHSHIFT) << bits;
+		bits += (int)(entry >> KERNELS_LENGTHSHIFT);
+		FLUSHBYTES(output, position, container, bits);
+	}
+	storeLittleEndian(output + position, container, 8);
+	return position + (size_t)((bits + 7) >> 3);
+}
+
+/*
+ * decodeSymbolBmi2 - decodeSymbol with bzhi for the table indices
+ */
+__attribute__((target("bmi2")))
+static inline int32_t decodeSymbolBmi2(const decodeTable *table,
+                                       bitReader *reader){
+	const decodeEntry *e;
+	uint32_t symbol;
+
+	if(reader->bits < CODETABLE_MAXLENGTH){
+		bitReader_refill(reader);
+	}
+	e = &table->entries[_bzhi_u64(reader->container, table->rootBits)];
+	if(e->subBits){
+		e = &table->entries[e->symbol +
+		                    _bzhi_u64(reader->container >> table->rootBits,
+		                              e->subBits)];
+	}
+	if(e->length == 0){
+		return -1;
+	}
+	reader->container >>= e->length;
+	reader->bits -= e->length;
+	symbol = e->symbol;
+	if(symbol == CODETABLE_ESCAPE){
+		if(reader->bits < CODETABLE_LITERALBITS){
+			bitReader_refill(reader);
+		}
+		symbol = (uint32_t)_bzhi_u64(reader->container, CODETABLE_LITERALBITS);
+		reader->container >>= CODETABLE_LITERALBITS;
+		reader->bits -= CODETABLE_LITERALBITS;
+	}
+	return (int32_t)symbol;
+}
+
+/*
+ * decodeBmi2 - decodeScalar built on decodeSymbolBmi2
+ */
+__attribute__((target("bmi2")))
+static int decodeBmi2(const decodeTable *table, bitReader *reader,
+                      int streams, unsigned char *const *output,
+                      const size_t *count){
+	size_t rounds = SIZE_MAX;
+
+	for(int s = 0; s < streams; s++){
+		rounds = count[s] < rounds ? count[s] : rounds;
+	}
+	for(size_t i = 0; i < rounds; i++){
+		for(int s = 0; s < streams; s++){
+			int32_t symbol = decodeSymbolBmi2(table, &reader[s]);
+			if(symbol < 0){
+				return -1;
+			}
+			output[s][i] = (unsigned char)symbol;
+		}
+	}
+	for(int s = 0; s < streams; s++){
+		for(size_t i = rounds; i < count[s]; i++){
+			int32_t symbol = decodeSymbolBmi2(table, &reader[s]);
+			if(symbol < 0){
+				return -1;
+			}
+			output[s][i] = (unsigned char)symbol;
+		}
+	}
+	return 0;
+}
+
+static const codingKernels bmi2Kernels = {
+	"bmi2", encodeBmi2, decodeBmi2
+};
+static const codingKernels avx2Kernels = {
+	"avx2", encodeAvx2, decodeBmi2
+};
+
+#endif
+
+/*
+ * selectKernels - picks the fastest kernels the processor supports, or the
+ *                 ones named by HUFFMAN_KERNEL if it supports them
+ */
+static const codingKernels *selectKernels(void){
+	const char *forced = getenv("HUFFMAN_KERNEL");
+
+	if(forced != NULL && !strcmp(forced, "scalar")){
+		return &scalarKernels;
+	}
+#ifdef KERNELS_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("bmi2")){
+		if(forced != NULL && !strcmp(forced, "bmi2")){
+			return &bmi2Kernels;
+		}
+		if(__builtin_cpu_supports("avx2")){
+			return &avx2Kernels;
+		}
+		return &bmi2Kernels;
+	}
+#endif
+	return &scalarKernels;
+}
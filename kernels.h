@@ -0,0 +1,72 @@
+/* Coding kernels - the inner loops that code and decode blocks with a byte
+ * table, in several implementations chosen at run time.
+ *
+ * The portable kernel works on every machine. On x86-64 there are also a
+ * kernel compiled for BMI2, whose variable shifts (shlx / shrx) and bit
+ * extraction (bzhi) need no flags and no branches, and an AVX2 kernel that
+ * looks up the codes of 8 bytes with one gather and merges them pairwise
+ * before they are written. The best kernel the processor supports is picked
+ * with cpuid the first time kernels_get is called, so one binary runs
+ * everywhere and is fastest on newer hosts. The environment variable
+ * HUFFMAN_KERNEL (scalar, bmi2 or avx2) overrides the choice for
+ * benchmarking; kernels the processor lacks are never used.
+ *
+ * All kernels produce exactly the same bits.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __KERNELS_H
+#define __KERNELS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "bitio.h"
+#include "codetable.h"
+
+// Bytes the encoders may write past the end of the coded bits
+#define KERNELS_SLACK 8
+
+// Position of the code length in a packed table entry
+#define KERNELS_LENGTHSHIFT 24
+
+/*
+ * Struct 'codingKernels'
+ *
+ *      name    - name of the implementation
+ *      encode  - codes length bytes of input with a packed table (see
+ *                kernels_packTable) and returns the number of bytes of
+ *                coded bits. output needs KERNELS_SLACK bytes more than
+ *                that.
+ *      decode  - decodes count[s] bytes to output[s] from each of the
+ *                streams bit readers, returns 0 on success and -1 if the
+ *                bits are not valid codes. The caller checks the readers
+ *                for overruns.
+ */
+typedef struct {
+    const char *name;
+    size_t (*encode)(const uint32_t *packed, const unsigned char *input,
+                     size_t length, unsigned char *output);
+    int (*decode)(const decodeTable *table, bitReader *reader, int streams,
+                  unsigned char *const *output, const size_t *count);
+} codingKernels;
+
+/*
+ * kernels_get - returns the kernels used on this machine
+ */
+const codingKernels *kernels_get(void);
+
+/*
+ * kernels_packTable - combines code and length of every byte into one
+ *                     32-bit entry: the code bits in the low bits and the
+ *                     length from bit KERNELS_LENGTHSHIFT
+ *
+ * Parameter:   t       - table with 256 symbols, or 257 for an escape table
+ *              packed  - array of 256 entries
+ *
+ * Comments:    A byte without a code gets the escape code followed by the
+ *              byte as literal, which is at most 23 bits.
+ */
+void kernels_packTable(const codeTable *t, uint32_t *packed);
+
+#endif
@@ -0,0 +1,342 @@
+/* Implementation of the datatype 'legacyDecoder', see legacy.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "legacy.h"
+#include "huffmantree.h"
+#include "bitio.h"
+
+// Inner nodes of a tree of at most 256 leaves
+#define LEGACY_MAXNODES 255
+
+/*
+ * Struct 'legacyChunk'
+ * A part of the bitstream decoded by one thread
+ *
+ *      decoder     - the decoder
+ *      input       - the whole bitstream
+ *      length      - number of bytes in input
+ *      start       - first bit of the chunk, on a byte boundary
+ *      end         - bit after the chunk
+ *      starts      - bit k set if a code was started at start + k
+ *      output      - the symbols of the codes started in the chunk
+ *      count       - number of symbols in output
+ *      capacity    - size of output
+ *      next        - bit where the next code would start, at or after end
+ */
+typedef struct {
+    const legacyDecoder *decoder;
+    const unsigned char *input;
+    size_t length;
+    uint64_t start;
+    uint64_t end;
+    uint64_t *starts;
+    unsigned char *output;
+    size_t count;
+    size_t capacity;
+    uint64_t next;
+} legacyChunk;
+
+static int addNode(legacyDecoder *d, binary_tree *tree, binaryTree_pos pos);
+static void fillLookup(legacyDecoder *d, int node, int depth, uint32_t code);
+static void *decodeChunk(void *argument);
+static bool isStart(const legacyChunk *c, uint64_t position);
+static size_t countStarts(const legacyChunk *c, uint64_t position);
+static void seek(bitReader *r, const unsigned char *input, size_t length,
+                 uint64_t position);
+
+/*
+ * readSymbol - reads the next code
+ *
+ * Parameter:   d       - the decoder
+ *              r       - reader at the start of a code
+ *              length  - receives the length of the code
+ *
+ * Returns:     the symbol of the code
+ */
+static inline int readSymbol(const legacyDecoder *d, bitReader *r,
+                             int *length){
+	const legacyEntry *e;
+	int node;
+
+	if(r->bits < LEGACY_LOOKUPBITS){
+		bitReader_refill(r);
+	}
+	e = &d->lookup[bitReader_peek(r, LEGACY_LOOKUPBITS)];
+	if(e->node < 0){
+		bitReader_consume(r, e->length);
+		*length = e->length;
+		return e->symbol;
+	}
+	bitReader_consume(r, LEGACY_LOOKUPBITS);
+	*length = LEGACY_LOOKUPBITS;
+	for(node = e->node; node >= 0; (*length)++){
+		node = d->child[node][bitReader_read(r, 1)];
+	}
+	return -1 - node;
+}
+
+legacyDecoder *legacyDecoder_create(binary_tree *tree){
+	binaryTree_pos root = binaryTree_root(tree);
+	legacyDecoder *d;
+
+	if(!binaryTree_hasLeftChild(tree, root) ||
+	   !binaryTree_hasRightChild(tree, root)){
+		return NULL;
+	}
+	d = calloc(1, sizeof(legacyDecoder));
+	d->child = malloc(LEGACY_MAXNODES * sizeof(*d->child));
+	addNode(d, tree, root);
+	fillLookup(d, 0, 0, 0);
+	return d;
+}
+
+/*
+ * The chunks are decoded in parallel, the stitching that follows is serial
+ * but only decodes the few bits until every chunk synchronizes.
+ */
+int64_t legacyDecoder_decode(const legacyDecoder *d,
+                             const unsigned char *input, size_t length,
+                             int threads, FILE *output){
+	uint64_t total = 8 * (uint64_t)length;
+	size_t chunkCount = length / LEGACY_MINCHUNK;
+	legacyChunk chunks[LEGACY_MAXTHREADS];
+	pthread_t ids[LEGACY_MAXTHREADS];
+	bool started[LEGACY_MAXTHREADS] = { false };
+	unsigned char *extra = NULL;
+	size_t extraCapacity = 0;
+	uint64_t position;
+	int64_t written = 0;
+
+	if(chunkCount > (size_t)threads){
+		chunkCount = (size_t)threads;
+	}
+	if(chunkCount > LEGACY_MAXTHREADS){
+		chunkCount = LEGACY_MAXTHREADS;
+	}
+	if(chunkCount < 1){
+		chunkCount = 1;
+	}
+
+	for(size_t t = 0; t < chunkCount; t++){
+		legacyChunk *c = &chunks[t];
+		c->decoder = d;
+		c->input = input;
+		c->length = length;
+		c->start = 8 * (uint64_t)(length / chunkCount * t);
+		c->end = t + 1 < chunkCount ?
+		         8 * (uint64_t)(length / chunkCount * (t + 1)) : total;
+		c->starts = calloc((c->end - c->start) / 64 + 1, sizeof(uint64_t));
+		c->capacity = (size_t)((c->end - c->start) / 4) + 64;
+		c->output = malloc(c->capacity);
+		c->count = 0;
+	}
+	for(size_t t = 1; t < chunkCount; t++){
+		started[t] = pthread_create(&ids[t], NULL, decodeChunk,
+		                            &chunks[t]) == 0;
+	}
+	decodeChunk(&chunks[0]);
+	for(size_t t = 1; t < chunkCount; t++){
+		if(started[t]){
+			pthread_join(ids[t], NULL);
+		} else {
+			decodeChunk(&chunks[t]);
+		}
+	}
+
+	// The first chunk starts with a code, its output is right as it is
+	if(fwrite(chunks[0].output, 1, chunks[0].count, output) ==
+	   chunks[0].count){
+		written = (int64_t)chunks[0].count;
+	} else {
+		written = -1;
+	}
+	position = chunks[0].next;
+
+	for(size_t t = 1; t < chunkCount && written >= 0; t++){
+		legacyChunk *c = &chunks[t];
+		size_t extraCount = 0;
+		bitReader reader;
+
+		/*
+		 * Go on with the right codes until one starts where the thread of
+		 * the chunk started one too
+		 */
+		if(position < c->end){
+			seek(&reader, input, length, position);
+		}
+		while(position < c->end && !isStart(c, position)){
+			int codeLength;
+			int symbol = readSymbol(d, &reader, &codeLength);
+			if(position + (uint64_t)codeLength >= total){
+				position = total;
+				break;
+			}
+			if(extraCount == extraCapacity){
+				extraCapacity = extraCapacity == 0 ? 256 : 2 * extraCapacity;
+				extra = realloc(extra, extraCapacity);
+			}
+			extra[extraCount++] = (unsigned char)symbol;
+			position += (uint64_t)codeLength;
+		}
+		if(extraCount > 0 &&
+		   fwrite(extra, 1, extraCount, output) != extraCount){
+			written = -1;
+			break;
+		}
+		written += (int64_t)extraCount;
+
+		// From there on the thread read the right codes
+		if(position < c->end){
+			size_t skip = countStarts(c, position);
+			if(fwrite(c->output + skip, 1, c->count - skip, output) !=
+			   c->count - skip){
+				written = -1;
+				break;
+			}
+			written += (int64_t)(c->count - skip);
+			position = c->next;
+		}
+	}
+
+	for(size_t t = 0; t < chunkCount; t++){
+		free(chunks[t].starts);
+		free(chunks[t].output);
+	}
+	free(extra);
+	return written;
+}
+
+void legacyDecoder_free(legacyDecoder *d){
+	if(d == NULL){
+		return;
+	}
+	free(d->child);
+	free(d);
+}
+
+/*
+ * addNode - copies a subtree into the child array of the decoder
+ *
+ * Returns:     the index of the inner node pos, -1 - symbol if it is a leaf
+ */
+static int addNode(legacyDecoder *d, binary_tree *tree, binaryTree_pos pos){
+	int index;
+
+	if(!binaryTree_hasLeftChild(tree, pos) &&
+	   !binaryTree_hasRightChild(tree, pos)){
+		freqChar *leaf = binaryTree_inspectLabel(tree, pos);
+		return -1 - (int)leaf->character;
+	}
+	index = d->nodes++;
+	d->child[index][0] = addNode(d, tree, binaryTree_leftChild(tree, pos));
+	d->child[index][1] = addNode(d, tree, binaryTree_rightChild(tree, pos));
+	return index;
+}
+
+/*
+ * fillLookup - fills the lookup entries of the codes below a node
+ *
+ * Parameter:   d       - the decoder
+ *              node    - an inner node
+ *              depth   - number of bits from the root to node
+ *              code    - those bits, the first in the lowest bit
+ */
+static void fillLookup(legacyDecoder *d, int node, int depth, uint32_t code){
+	for(int bit = 0; bit < 2; bit++){
+		int child = d->child[node][bit];
+		uint32_t childCode = code | (uint32_t)bit << depth;
+		uint32_t values = 1u << (LEGACY_LOOKUPBITS - depth - 1);
+
+		if(child < 0){
+			// Every value that starts with the code is this leaf
+			for(uint32_t rest = 0; rest < values; rest++){
+				legacyEntry *e = &d->lookup[childCode | rest << (depth + 1)];
+				e->node = -1;
+				e->symbol = (unsigned char)(-1 - child);
+				e->length = (unsigned char)(depth + 1);
+			}
+		} else if(depth + 1 == LEGACY_LOOKUPBITS){
+			d->lookup[childCode].node = child;
+		} else {
+			fillLookup(d, child, depth + 1, childCode);
+		}
+	}
+}
+
+/*
+ * decodeChunk - decodes the codes that start in a chunk, as if the chunk
+ *               started with a code
+ */
+static void *decodeChunk(void *argument){
+	legacyChunk *c = argument;
+	uint64_t total = 8 * (uint64_t)c->length;
+	uint64_t position = c->start;
+	bitReader reader;
+
+	seek(&reader, c->input, c->length, position);
+	while(position < c->end){
+		uint64_t offset = position - c->start;
+		int codeLength;
+		int symbol;
+
+		c->starts[offset >> 6] |= UINT64_C(1) << (offset & 63);
+		symbol = readSymbol(c->decoder, &reader, &codeLength);
+		if(position + (uint64_t)codeLength >= total){
+			position = total;
+			break;
+		}
+		if(c->count == c->capacity){
+			c->capacity *= 2;
+			c->output = realloc(c->output, c->capacity);
+		}
+		c->output[c->count++] = (unsigned char)symbol;
+		position += (uint64_t)codeLength;
+	}
+	c->next = position;
+	return NULL;
+}
+
+/*
+ * isStart - checks if the thread of a chunk started a code at a bit of the
+ *           chunk
+ */
+static bool isStart(const legacyChunk *c, uint64_t position){
+	uint64_t offset = position - c->start;
+	return (c->starts[offset >> 6] >> (offset & 63)) & 1;
+}
+
+/*
+ * countStarts - number of codes the thread of a chunk started before a bit
+ *               of the chunk
+ */
+static size_t countStarts(const legacyChunk *c, uint64_t position){
+	uint64_t offset = position - c->start;
+	size_t count = 0;
+
+	for(uint64_t word = 0; word < offset >> 6; word++){
+		count += (size_t)__builtin_popcountll(c->starts[word]);
+	}
+	if(offset & 63){
+		count += (size_t)__builtin_popcountll(c->starts[offset >> 6] &
+		                                      ((UINT64_C(1) << (offset & 63)) -
+		                                       1));
+	}
+	return count;
+}
+
+/*
+ * seek - starts a bit reader at any bit of a buffer before its end
+ */
+static void seek(bitReader *r, const unsigned char *input, size_t length,
+                 uint64_t position){
+	bitReader_init(r, input + position / 8, length - (size_t)(position / 8));
+	if(position % 8 != 0){
+		bitReader_read(r, (int)(position % 8));
+	}
+}
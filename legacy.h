@@ -0,0 +1,105 @@
+/* Datatype 'legacyDecoder' - decodes the legacy bitstream on several
+ * threads.
+ *
+ * The legacy bitstream (see huffman.c) has no blocks and no index, so a
+ * decoder can't know where a code starts anywhere but at the beginning.
+ * Huffman codes synchronize by themselves though: a decoder started in
+ * the middle of a code reads wrong symbols for a while, but as soon as one
+ * of its codes ends where a real code ends, it reads the same symbols as
+ * the real decoder from there on, usually within a few dozen bits.
+ *
+ * The stream is therefore cut into one chunk per thread and every thread
+ * decodes its chunk as if a code started there, marking the positions
+ * where its codes start. The chunks are then stitched in order: the
+ * decoder of the chunk before, which is known to be right, goes on into
+ * the chunk until it reaches a position the thread of the chunk also
+ * started a code at, and the output of the thread is taken from there on.
+ * A chunk that never synchronizes is decoded entirely by the stitching, so
+ * the result is always that of the serial decoder.
+ *
+ * Symbols are read with a lookup table of the first LEGACY_LOOKUPBITS bits
+ * of a code; longer codes continue down the tree one bit at a time.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __LEGACY_H
+#define __LEGACY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "tree_3cell.h"
+
+// Bits of the lookup table
+#define LEGACY_LOOKUPBITS 11
+
+// Smallest chunk a thread is started for, and most threads
+#define LEGACY_MINCHUNK (1 << 16)
+#define LEGACY_MAXTHREADS 64
+
+/*
+ * Struct 'legacyEntry'
+ * Entry of the lookup table
+ *
+ *      node    - node reached after LEGACY_LOOKUPBITS bits of a longer
+ *                code, -1 if the entry is a whole code
+ *      symbol  - the symbol of a whole code
+ *      length  - the length of a whole code
+ */
+typedef struct {
+    int node;
+    unsigned char symbol;
+    unsigned char length;
+} legacyEntry;
+
+/*
+ * Struct 'legacyDecoder'
+ *
+ *      child       - the two children of every inner node of the tree,
+ *                    the index of an inner node or -1 - symbol for a leaf
+ *      nodes       - number of inner nodes, node 0 is the root
+ *      lookup      - entries for every value of the next
+ *                    LEGACY_LOOKUPBITS bits
+ */
+typedef struct {
+    int (*child)[2];
+    int nodes;
+    legacyEntry lookup[1 << LEGACY_LOOKUPBITS];
+} legacyDecoder;
+
+/*
+ * legacyDecoder_create - builds a decoder for the codes of a Huffman tree
+ *
+ * Parameter:   tree    - tree built with buildHuffmanTree (huffmantree.h),
+ *                        not needed after the call
+ *
+ * Returns:     the decoder, NULL if the tree has fewer than two leaves
+ */
+legacyDecoder *legacyDecoder_create(binary_tree *tree);
+
+/*
+ * legacyDecoder_decode - decodes a legacy bitstream
+ *
+ * Parameter:   d       - the decoder
+ *              input   - the bitstream
+ *              length  - number of bytes in input
+ *              threads - most threads to decode with (>= 1)
+ *              output  - file that receives the symbols
+ *
+ * Returns:     number of symbols written, -1 if writing failed
+ *
+ * Comments:    As always in the legacy format every complete code is a
+ *              symbol, the EOT code included, except a code ending
+ *              exactly at the end of the stream.
+ */
+int64_t legacyDecoder_decode(const legacyDecoder *d,
+                             const unsigned char *input, size_t length,
+                             int threads, FILE *output);
+
+/*
+ * legacyDecoder_free - deallocates the decoder
+ */
+void legacyDecoder_free(legacyDecoder *d);
+
+#endif
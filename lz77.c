@@ -0,0 +1,475 @@
+/* LZ77 matching in front of Huffman coding, see lz77.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "lz77.h"
+#include "bitio.h"
+#include "huffmantree.h"
+
+// Bits of the hash of LZ77_MINMATCH bytes
+#define LZ77_HASHBITS 16
+
+/*
+ * Struct 'lzLevel'
+ * Settings of a level
+ *
+ *      chain   - most earlier positions tried per match
+ *      nice    - length of a match that ends the search
+ *      lazy    - put a match off when the next position has a longer one
+ */
+typedef struct {
+    int chain;
+    int nice;
+    bool lazy;
+} lzLevel;
+
+static const lzLevel lzLevels[LZ77_MAXLEVEL + 1] = {
+    { 0, 0, false },
+    { 4, 16, false },
+    { 8, 32, false },
+    { 16, 32, false },
+    { 16, 64, true },
+    { 32, 128, true },
+    { 64, 128, true },
+    { 128, 256, true },
+    { 512, 1024, true },
+    { 4096, LZ77_MAXMATCH, true }
+};
+
+static void findMatches(lzModel *m, const unsigned char *input,
+                        size_t length);
+static uint32_t longestMatch(lzModel *m, const unsigned char *input,
+                             size_t length, size_t position, size_t window,
+                             uint32_t *distance);
+static void addToken(lzModel *m, uint32_t value, uint32_t distance);
+static void buildTable(codeTable *t, const uint64_t *frequency,
+                       int symbols);
+static size_t matchLength(const unsigned char *a, const unsigned char *b,
+                          size_t limit);
+
+/*
+ * bucketOf - finds the bucket of a length or distance value
+ *
+ * Parameter:   value       - the value
+ *              extraBits   - receives the number of extra bits
+ *
+ * Returns:     the bucket
+ */
+static inline int bucketOf(uint32_t value, int *extraBits){
+	int high;
+
+	if(value < 8){
+		*extraBits = 0;
+		return (int)value;
+	}
+	high = 31 - __builtin_clz(value);
+	*extraBits = high - 2;
+	return 8 + (high - 3) * 4 + (int)((value >> (high - 2)) & 3);
+}
+
+/*
+ * bucketBase - finds the smallest value of a bucket
+ *
+ * Parameter:   bucket      - the bucket
+ *              extraBits   - receives the number of extra bits
+ *
+ * Returns:     the value, the extra bits are added to it
+ */
+static inline uint32_t bucketBase(int bucket, int *extraBits){
+	int high;
+
+	if(bucket < 8){
+		*extraBits = 0;
+		return (uint32_t)bucket;
+	}
+	high = (bucket - 8) / 4 + 3;
+	*extraBits = high - 2;
+	return (uint32_t)(4 + ((bucket - 8) & 3)) << (high - 2);
+}
+
+/*
+ * hashOf - hashes the LZ77_MINMATCH bytes at data
+ */
+static inline uint32_t hashOf(const unsigned char *data){
+	uint32_t word = (uint32_t)loadLittleEndian(data, LZ77_MINMATCH);
+	return (word * UINT32_C(0x9e3779b1)) >> (32 - LZ77_HASHBITS);
+}
+
+lzModel *lzModel_create(int level, size_t window){
+	lzModel *m = calloc(1, sizeof(lzModel));
+
+	m->level = level < 1 ? 1 : level > LZ77_MAXLEVEL ? LZ77_MAXLEVEL : level;
+	m->window = window < 1 ? 1 : window > LZ77_MAXWINDOW ? LZ77_MAXWINDOW :
+	                                                       window;
+	m->literals = codeTable_create(LZ77_LITERALCODES);
+	m->distances = codeTable_create(LZ77_DISTANCECODES);
+	return m;
+}
+
+/*
+ * The tables are built from the counts of the buckets; the extra bits
+ * cost the same with any table and are added to the size as they are.
+ */
+uint64_t lzModel_fit(lzModel *m, const unsigned char *input, size_t length){
+	uint64_t literalCount[LZ77_LITERALCODES] = { 0 };
+	uint64_t distanceCount[LZ77_DISTANCECODES] = { 0 };
+	uint64_t extra = 0;
+
+	findMatches(m, input, length);
+	for(size_t i = 0; i < m->tokens; i++){
+		int lengthBits;
+		int distanceBits;
+
+		if(m->distance[i] == 0){
+			literalCount[m->value[i]]++;
+			continue;
+		}
+		literalCount[256 + bucketOf(m->value[i] - LZ77_MINMATCH,
+		                            &lengthBits)]++;
+		distanceCount[bucketOf(m->distance[i] - 1, &distanceBits)]++;
+		extra += (uint64_t)(lengthBits + distanceBits);
+	}
+	buildTable(m->literals, literalCount, LZ77_LITERALCODES);
+	buildTable(m->distances, distanceCount, LZ77_DISTANCECODES);
+	return codeTable_cost(m->literals, literalCount) +
+	       codeTable_cost(m->distances, distanceCount) + extra +
+	       8 * lzModel_serializedSize(m);
+}
+
+size_t lzModel_serializedSize(const lzModel *m){
+	return codeTable_serializedSize(m->literals) +
+	       codeTable_serializedSize(m->distances);
+}
+
+size_t lzModel_serialize(const lzModel *m, unsigned char *buffer){
+	size_t position = codeTable_serialize(m->literals, buffer);
+
+	return position + codeTable_serialize(m->distances, buffer + position);
+}
+
+long lzModel_deserialize(lzModel *m, const unsigned char *buffer,
+                         size_t length){
+	long literalSize = codeTable_deserialize(m->literals, buffer, length);
+	long distanceSize;
+
+	if(literalSize < 0){
+		return -1;
+	}
+	distanceSize = codeTable_deserialize(m->distances, buffer + literalSize,
+	                                     length - (size_t)literalSize);
+	if(distanceSize < 0){
+		return -1;
+	}
+	if(m->literalLookup != NULL){
+		decodeTable_free(m->literalLookup);
+		decodeTable_free(m->distanceLookup);
+	}
+	m->literalLookup = decodeTable_create(m->literals);
+	m->distanceLookup = decodeTable_create(m->distances);
+	return literalSize + distanceSize;
+}
+
+size_t lzModel_encode(const lzModel *m, unsigned char *output){
+	const codeTable *literals = m->literals;
+	const codeTable *distances = m->distances;
+	bitWriter writer;
+
+	bitWriter_init(&writer, output);
+	for(size_t i = 0; i < m->tokens; i++){
+		uint32_t value = m->value[i];
+		uint32_t distance = m->distance[i];
+		int extraBits;
+		int bucket;
+
+		if(distance == 0){
+			bitWriter_put(&writer, literals->code[value],
+			              literals->length[value]);
+			continue;
+		}
+		bucket = bucketOf(value - LZ77_MINMATCH, &extraBits);
+		bitWriter_put(&writer, literals->code[256 + bucket],
+		              literals->length[256 + bucket]);
+		bitWriter_put(&writer, (value - LZ77_MINMATCH) &
+		                       ((UINT32_C(1) << extraBits) - 1), extraBits);
+		bucket = bucketOf(distance - 1, &extraBits);
+		bitWriter_put(&writer, distances->code[bucket],
+		              distances->length[bucket]);
+		bitWriter_put(&writer, (distance - 1) &
+		                       ((UINT32_C(1) << extraBits) - 1), extraBits);
+	}
+	return bitWriter_finish(&writer);
+}
+
+int lzModel_decode(const lzModel *m, const unsigned char *bits,
+                   size_t length, unsigned char *output,
+                   size_t outputLength){
+	bitReader reader;
+	size_t position = 0;
+
+	if(m->literalLookup == NULL){
+		return -1;
+	}
+	bitReader_init(&reader, bits, length);
+	while(position < outputLength){
+		size_t matchSize;
+		size_t distance;
+		int32_t symbol;
+		int extraBits;
+
+		if(reader.bits < CODETABLE_MAXLENGTH){
+			bitReader_refill(&reader);
+		}
+		symbol = decodeTable_decode(m->literalLookup, &reader);
+		if(symbol < 0){
+			return -1;
+		}
+		if(symbol < 256){
+			output[position++] = (unsigned char)symbol;
+			continue;
+		}
+
+		// A match: length and distance with their extra bits
+		matchSize = bucketBase(symbol - 256, &extraBits);
+		matchSize += bitReader_read(&reader, extraBits) + LZ77_MINMATCH;
+		if(reader.bits < CODETABLE_MAXLENGTH){
+			bitReader_refill(&reader);
+		}
+		symbol = decodeTable_decode(m->distanceLookup, &reader);
+		if(symbol < 0){
+			return -1;
+		}
+		distance = bucketBase(symbol, &extraBits);
+		distance += bitReader_read(&reader, extraBits) + 1;
+		if(distance > position || matchSize > outputLength - position){
+			return -1;
+		}
+
+		// Overlapping copies repeat the last distance bytes
+		if(distance >= matchSize){
+			memcpy(output + position, output + position - distance,
+			       matchSize);
+		} else {
+			for(size_t i = 0; i < matchSize; i++){
+				output[position + i] = output[position + i - distance];
+			}
+		}
+		position += matchSize;
+	}
+	return bitReader_overrun(&reader) ? -1 : 0;
+}
+
+void lzModel_free(lzModel *m){
+	codeTable_free(m->literals);
+	codeTable_free(m->distances);
+	if(m->literalLookup != NULL){
+		decodeTable_free(m->literalLookup);
+		decodeTable_free(m->distanceLookup);
+	}
+	free(m->head);
+	free(m->chain);
+	free(m->value);
+	free(m->distance);
+	free(m);
+}
+
+/*
+ * findMatches - splits a block into literals and matches
+ *
+ * Every position is added to the hash chains before the next match is
+ * looked for, also the positions inside matches, so later matches can
+ * start anywhere in earlier data.
+ */
+static void findMatches(lzModel *m, const unsigned char *input,
+                        size_t length){
+	const lzLevel *level = &lzLevels[m->level];
+	size_t window = m->window < length ? m->window : length;
+	size_t chainSize = 1;
+	size_t position = 0;
+	size_t hashed = 0;
+
+	while(chainSize < window){
+		chainSize *= 2;
+	}
+	if(chainSize > m->chainSize){
+		free(m->chain);
+		m->chain = malloc(chainSize * sizeof(int32_t));
+		m->chainSize = chainSize;
+	}
+	if(m->head == NULL){
+		m->head = malloc(((size_t)1 << LZ77_HASHBITS) * sizeof(int32_t));
+	}
+	memset(m->head, 0xff, ((size_t)1 << LZ77_HASHBITS) * sizeof(int32_t));
+	m->tokens = 0;
+
+	while(position < length){
+		uint32_t distance;
+		uint32_t found = longestMatch(m, input, length, position, window,
+		                              &distance);
+
+		hashed = position + 1;
+		if(found < LZ77_MINMATCH){
+			addToken(m, input[position++], 0);
+			continue;
+		}
+
+		// Lazy matching: a longer match one byte on is worth a literal
+		while(level->lazy && found < (uint32_t)level->nice &&
+		      position + 1 < length){
+			uint32_t nextDistance;
+			uint32_t next = longestMatch(m, input, length, position + 1,
+			                             window, &nextDistance);
+			hashed = position + 2;
+			if(next <= found){
+				break;
+			}
+			addToken(m, input[position++], 0);
+			found = next;
+			distance = nextDistance;
+		}
+		addToken(m, found, distance);
+
+		// Positions looked at for lazy matches are already in their chains
+		for(size_t i = hashed; i < position + found; i++){
+			if(i + LZ77_MINMATCH <= length){
+				uint32_t hash = hashOf(input + i);
+				m->chain[i & (m->chainSize - 1)] = m->head[hash];
+				m->head[hash] = (int32_t)i;
+			}
+		}
+		position += found;
+	}
+}
+
+/*
+ * longestMatch - adds a position to its hash chain and finds the longest
+ *                match of the data there with earlier data
+ *
+ * Parameter:   m           - the model
+ *              input       - the block
+ *              length      - size of the block
+ *              position    - where the match starts
+ *              window      - longest distance
+ *              distance    - receives the distance of the match
+ *
+ * Returns:     length of the match, 0 if there is none of at least
+ *              LZ77_MINMATCH bytes
+ */
+static uint32_t longestMatch(lzModel *m, const unsigned char *input,
+                             size_t length, size_t position, size_t window,
+                             uint32_t *distance){
+	const lzLevel *level = &lzLevels[m->level];
+	size_t mask = m->chainSize - 1;
+	size_t limit = length - position < LZ77_MAXMATCH ? length - position :
+	                                                   LZ77_MAXMATCH;
+	size_t best = LZ77_MINMATCH - 1;
+	uint32_t hash;
+	int32_t candidate;
+	int tries = level->chain;
+
+	if(limit < LZ77_MINMATCH){
+		return 0;
+	}
+	hash = hashOf(input + position);
+	candidate = m->head[hash];
+	m->chain[position & mask] = candidate;
+	m->head[hash] = (int32_t)position;
+
+	/*
+	 * Chains are kept modulo the window, an entry that isn't older than
+	 * the position it was reached from has been overwritten
+	 */
+	while(candidate >= 0 && tries-- > 0 &&
+	      position - (size_t)candidate <= window){
+		const unsigned char *earlier = input + candidate;
+		int32_t next;
+
+		if(earlier[best] == input[position + best]){
+			size_t found = matchLength(earlier, input + position, limit);
+			if(found > best){
+				best = found;
+				*distance = (uint32_t)(position - (size_t)candidate);
+				if(found >= (size_t)level->nice || found == limit){
+					break;
+				}
+			}
+		}
+		next = m->chain[(size_t)candidate & mask];
+		if(next >= candidate){
+			break;
+		}
+		candidate = next;
+	}
+	return best >= LZ77_MINMATCH ? (uint32_t)best : 0;
+}
+
+/*
+ * matchLength - counts the equal bytes at the start of a and b, at most
+ *               limit
+ */
+static size_t matchLength(const unsigned char *a, const unsigned char *b,
+                          size_t limit){
+	size_t length = 0;
+
+	// Eight bytes at a time, the first difference from the lowest one
+	while(length + 8 <= limit){
+		uint64_t x;
+		uint64_t y;
+		memcpy(&x, a + length, 8);
+		memcpy(&y, b + length, 8);
+		if(x != y){
+			return length + (size_t)(__builtin_ctzll(x ^ y) >> 3);
+		}
+		length += 8;
+	}
+	while(length < limit && a[length] == b[length]){
+		length++;
+	}
+	return length;
+}
+
+/*
+ * addToken - appends a literal (distance 0) or a match
+ */
+static void addToken(lzModel *m, uint32_t value, uint32_t distance){
+	if(m->tokens == m->tokenCapacity){
+		m->tokenCapacity = m->tokenCapacity == 0 ? 4096 :
+		                                           m->tokenCapacity * 2;
+		m->value = realloc(m->value, m->tokenCapacity * sizeof(uint32_t));
+		m->distance = realloc(m->distance,
+		                      m->tokenCapacity * sizeof(uint32_t));
+	}
+	m->value[m->tokens] = value;
+	m->distance[m->tokens] = distance;
+	m->tokens++;
+}
+
+/*
+ * buildTable - builds a table for the symbols that occur
+ *
+ * getSparseCodeLengths takes counts above zero only, so the symbols that
+ * occur are packed in front and their lengths put back in place after.
+ */
+static void buildTable(codeTable *t, const uint64_t *frequency,
+                       int symbols){
+	uint64_t count[LZ77_LITERALCODES];
+	unsigned char packed[LZ77_LITERALCODES];
+	unsigned char lengths[LZ77_LITERALCODES] = { 0 };
+	int symbol[LZ77_LITERALCODES];
+	int used = 0;
+
+	for(int i = 0; i < symbols; i++){
+		if(frequency[i] > 0){
+			count[used] = frequency[i];
+			symbol[used++] = i;
+		}
+	}
+	getSparseCodeLengths(count, used, packed, CODETABLE_MAXLENGTH);
+	for(int i = 0; i < used; i++){
+		lengths[symbol[i]] = packed[i];
+	}
+	codeTable_setLengths(t, lengths);
+}
@@ -0,0 +1,156 @@
+/* Datatype 'lzModel' - LZ77 matching in front of Huffman coding.
+ *
+ * Order-0 and order-1 codes spend bits on every byte of a phrase that
+ * repeats, however often it does; logs and text are full of such phrases.
+ * An lzModel first replaces repeated strings by matches, a length and the
+ * distance back to an earlier copy, and then Huffman codes what is left
+ * with two tables of its own:
+ *
+ *  - the literal/length table has a code for every byte (a literal) and
+ *    for LZ77_LENGTHCODES buckets of match lengths
+ *  - the distance table has a code for LZ77_DISTANCECODES buckets of
+ *    distances
+ *
+ * A bucket stands for a range of values: values below 8 have a bucket of
+ * their own, larger ones are bucketed by their highest three bits and the
+ * bits below those follow the code as they are (extra bits). A match is
+ * its length code, the extra bits of the length, the distance code and
+ * the extra bits of the distance.
+ *
+ * Matches are found with hash chains over LZ77_MINMATCH bytes. The level
+ * (1 to LZ77_MAXLEVEL) sets how many earlier positions are tried for
+ * every match, when to settle for a match that is long enough, and from
+ * which level on matching is lazy: a match is put off by a literal when
+ * the next position starts a longer one.
+ *
+ * Matches only reach back to data of the same lzModel_fit call, at most
+ * window bytes. Serialized model: the literal/length table, then the
+ * distance table (see codetable.h).
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __LZ77_H
+#define __LZ77_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "codetable.h"
+
+// Shortest and longest match
+#define LZ77_MINMATCH 4
+#define LZ77_MAXMATCH (LZ77_MINMATCH + 65535)
+
+// Largest window, and the window of models only used for decoding
+#define LZ77_MAXWINDOW (1 << 24)
+#define LZ77_WINDOW (1 << 20)
+
+// Highest level, levels start at 1
+#define LZ77_MAXLEVEL 9
+
+// Number of buckets of match lengths and of distances
+#define LZ77_LENGTHCODES 60
+#define LZ77_DISTANCECODES 92
+
+// Symbols of the literal/length table: the bytes, then the length buckets
+#define LZ77_LITERALCODES (256 + LZ77_LENGTHCODES)
+
+/*
+ * Struct 'lzModel'
+ *
+ *      level           - search effort, 1 to LZ77_MAXLEVEL
+ *      window          - longest distance of a match
+ *      literals        - the literal/length table
+ *      distances       - the distance table
+ *      literalLookup   - decode tables of a deserialized model, NULL
+ *      distanceLookup    before
+ *      head            - last position of every hash
+ *      chain           - earlier position with the same hash as a
+ *                        position, indexed modulo chainSize
+ *      chainSize       - power of two at least as large as the window
+ *      value           - byte of every literal, length of every match
+ *      distance        - distance of every match, 0 for literals
+ *      tokens          - number of literals and matches
+ *      tokenCapacity   - size of value and distance
+ */
+typedef struct {
+    int level;
+    size_t window;
+    codeTable *literals;
+    codeTable *distances;
+    decodeTable *literalLookup;
+    decodeTable *distanceLookup;
+    int32_t *head;
+    int32_t *chain;
+    size_t chainSize;
+    uint32_t *value;
+    uint32_t *distance;
+    size_t tokens;
+    size_t tokenCapacity;
+} lzModel;
+
+/*
+ * lzModel_create - creates a model without tables
+ *
+ * Parameter:   level   - search effort, 1 to LZ77_MAXLEVEL
+ *              window  - longest distance of a match, at most
+ *                        LZ77_MAXWINDOW
+ *
+ * Comments:    Models only used for decoding need neither, pass 1 and
+ *              LZ77_WINDOW.
+ */
+lzModel *lzModel_create(int level, size_t window);
+
+/*
+ * lzModel_fit - finds the matches of a block of data and builds the tables
+ *               for coding it
+ *
+ * Returns:     exact size in bits of the serialized model plus the data
+ *              coded with it
+ */
+uint64_t lzModel_fit(lzModel *m, const unsigned char *input, size_t length);
+
+/*
+ * lzModel_serializedSize - bytes needed by lzModel_serialize
+ */
+size_t lzModel_serializedSize(const lzModel *m);
+
+/*
+ * lzModel_serialize - stores the tables
+ *
+ * Returns:     number of bytes written to buffer
+ */
+size_t lzModel_serialize(const lzModel *m, unsigned char *buffer);
+
+/*
+ * lzModel_deserialize - restores tables stored with lzModel_serialize
+ *
+ * Returns:     number of bytes consumed, -1 if the data is not a valid model
+ */
+long lzModel_deserialize(lzModel *m, const unsigned char *buffer,
+                         size_t length);
+
+/*
+ * lzModel_encode - codes the data of the last lzModel_fit
+ *
+ * Returns:     number of bytes written to output
+ */
+size_t lzModel_encode(const lzModel *m, unsigned char *output);
+
+/*
+ * lzModel_decode - decodes outputLength bytes coded with lzModel_encode
+ *
+ * Returns:     0 on success, -1 if the bits are not valid codes, run out,
+ *              reach back before the start of output or don't decode to
+ *              exactly outputLength bytes
+ */
+int lzModel_decode(const lzModel *m, const unsigned char *bits,
+                   size_t length, unsigned char *output,
+                   size_t outputLength);
+
+/*
+ * lzModel_free - deallocates the model
+ */
+void lzModel_free(lzModel *m);
+
+#endif
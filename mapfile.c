@@ -0,0 +1,85 @@
+/* Implementation of the datatype 'mapped_file', see mapfile.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mapfile.h"
+
+static int readWhole(int fd, mapped_file *m);
+
+mapped_file *mapfile_open(const char *path){
+	struct stat info;
+	mapped_file *m;
+	int fd = open(path, O_RDONLY);
+
+	if(fd < 0){
+		return NULL;
+	}
+	m = calloc(1, sizeof(mapped_file));
+
+	if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0){
+		void *view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE,
+		                  fd, 0);
+		if(view != MAP_FAILED){
+			posix_madvise(view, (size_t)info.st_size,
+			              POSIX_MADV_SEQUENTIAL);
+			m->data = view;
+			m->length = (size_t)info.st_size;
+			m->mapped = true;
+			close(fd);
+			return m;
+		}
+	}
+
+	// Not mappable, fall back to reading everything
+	if(readWhole(fd, m) != 0){
+		close(fd);
+		free(m);
+		return NULL;
+	}
+	close(fd);
+	return m;
+}
+
+void mapfile_close(mapped_file *m){
+	if(m->mapped){
+		munmap((void *)m->data, m->length);
+	} else {
+		free((void *)m->data);
+	}
+	free(m);
+}
+
+/*
+ * readWhole - reads from fd until end of file into a growing buffer
+ *
+ * Returns:     0 on success, -1 on read errors
+ */
+static int readWhole(int fd, mapped_file *m){
+	size_t capacity = 1 << 16;
+	size_t length = 0;
+	unsigned char *buffer = malloc(capacity);
+	ssize_t readBytes;
+
+	while((readBytes = read(fd, buffer + length, capacity - length)) > 0){
+		length += (size_t)readBytes;
+		if(length == capacity){
+			capacity *= 2;
+			buffer = realloc(buffer, capacity);
+		}
+	}
+	if(readBytes < 0){
+		free(buffer);
+		return -1;
+	}
+	m->data = buffer;
+	m->length = length;
+	m->mapped = false;
+	return 0;
+}
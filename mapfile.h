@@ -0,0 +1,37 @@
+/* Datatype 'mapped_file' - read only view of a whole input file.
+ *
+ * Regular files are memory mapped so that several passes over the input
+ * (e.g. histogram then encode) cost a single read from disk. Inputs that
+ * cannot be mapped (pipes, special files) are read into memory instead.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __MAPFILE_H
+#define __MAPFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    const unsigned char *data;
+    size_t length;
+    bool mapped;
+} mapped_file;
+
+/*
+ * mapfile_open - makes the contents of a file available in memory
+ *
+ * Parameter:   path    - name of the file
+ *
+ * Returns:     the mapped file or NULL if the file couldn't be read.
+ *              Deallocate with mapfile_close.
+ */
+mapped_file *mapfile_open(const char *path);
+
+/*
+ * mapfile_close - unmaps the file and deallocates the datatype
+ */
+void mapfile_close(mapped_file *m);
+
+#endif
@@ -0,0 +1,210 @@
+/* Implementation of the datatype 'order1Model', see order1.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "order1.h"
+#include "bitio.h"
+#include "huffmantree.h"
+
+#define BITMAPSIZE (ORDER1_CONTEXTS / 8)
+
+static void setTable(codeTable *t, const uint64_t *frequency);
+static void clearOwnTables(order1Model *m);
+
+order1Model *order1Model_create(void){
+	order1Model *m = calloc(1, sizeof(order1Model));
+	m->shared = codeTable_create(256);
+	return m;
+}
+
+/*
+ * order1Model_fit - builds the tables for a block of data.
+ *
+ * Every context starts out with the table of all counts of the block. A
+ * context whose own table codes its bytes in fewer bits than that table,
+ * even after paying for storing the own table, keeps its own table. The
+ * shared table is then rebuilt from the contexts that are left.
+ */
+uint64_t order1Model_fit(order1Model *m,
+                         const uint64_t (*frequency)[ORDER1_CONTEXTS]){
+	uint64_t combined[256] = { 0 };
+	uint64_t bits = 8 * BITMAPSIZE;
+	codeTable *candidate = codeTable_create(256);
+
+	clearOwnTables(m);
+	for(int c = 0; c < ORDER1_CONTEXTS; c++){
+		for(int i = 0; i < 256; i++){
+			combined[i] += frequency[c][i];
+		}
+	}
+	setTable(m->shared, combined);
+
+	for(int c = 0; c < ORDER1_CONTEXTS; c++){
+		uint64_t sharedCost = codeTable_cost(m->shared, frequency[c]);
+		uint64_t ownCost;
+
+		if(sharedCost == 0){
+			continue;
+		}
+		setTable(candidate, frequency[c]);
+		ownCost = codeTable_cost(candidate, frequency[c]) +
+		          8 * codeTable_serializedSize(candidate);
+		if(ownCost < sharedCost){
+			m->own[c] = candidate;
+			candidate = codeTable_create(256);
+			for(int i = 0; i < 256; i++){
+				combined[i] -= frequency[c][i];
+			}
+		}
+	}
+	codeTable_free(candidate);
+
+	// The contexts left over only need to share the symbols they use
+	setTable(m->shared, combined);
+	bits += 8 * codeTable_serializedSize(m->shared);
+	for(int c = 0; c < ORDER1_CONTEXTS; c++){
+		const codeTable *t = m->own[c] != NULL ? m->own[c] : m->shared;
+		if(m->own[c] != NULL){
+			bits += 8 * codeTable_serializedSize(t);
+		}
+		bits += codeTable_cost(t, frequency[c]);
+	}
+	return bits;
+}
+
+size_t order1Model_serialize(const order1Model *m, unsigned char *buffer){
+	size_t position = BITMAPSIZE;
+
+	memset(buffer, 0, BITMAPSIZE);
+	for(int c = 0; c < ORDER1_CONTEXTS; c++){
+		if(m->own[c] != NULL){
+			buffer[c / 8] |= 1 << (c % 8);
+		}
+	}
+	position += codeTable_serialize(m->shared, buffer + position);
+	for(int c = 0; c < ORDER1_CONTEXTS; c++){
+		if(m->own[c] != NULL){
+			position += codeTable_serialize(m->own[c], buffer + position);
+		}
+	}
+	return position;
+}
+
+long order1Model_deserialize(order1Model *m, const unsigned char *buffer,
+                             size_t length){
+	size_t position = BITMAPSIZE;
+	long tableSize;
+
+	if(length < BITMAPSIZE){
+		return -1;
+	}
+	clearOwnTables(m);
+	tableSize = codeTable_deserialize(m->shared, buffer + position,
+	                                  length - position);
+	if(tableSize < 0){
+		return -1;
+	}
+	position += (size_t)tableSize;
+	for(int c = 0; c < ORDER1_CONTEXTS; c++){
+		if(buffer[c / 8] & (1 << (c % 8))){
+			m->own[c] = codeTable_create(256);
+			tableSize = codeTable_deserialize(m->own[c], buffer + position,
+			                                  length - position);
+			if(tableSize < 0){
+				return -1;
+			}
+			position += (size_t)tableSize;
+		}
+	}
+	return (long)position;
+}
+
+size_t order1Model_encode(const order1Model *m, const unsigned char *input,
+                          size_t length, int previous, unsigned char *output){
+	const codeTable *table[ORDER1_CONTEXTS];
+	bitWriter writer;
+
+	for(int c = 0; c < ORDER1_CONTEXTS; c++){
+		table[c] = m->own[c] != NULL ? m->own[c] : m->shared;
+	}
+	bitWriter_init(&writer, output);
+	for(size_t i = 0; i < length; i++){
+		const codeTable *t = table[previous];
+		bitWriter_put(&writer, t->code[input[i]], t->length[input[i]]);
+		previous = input[i];
+	}
+	return bitWriter_finish(&writer);
+}
+
+int order1Model_decode(const order1Model *m, const unsigned char *bits,
+                       size_t length, int previous, unsigned char *output,
+                       size_t outputLength){
+	decodeTable *lookup[ORDER1_CONTEXTS] = { NULL };
+	const decodeTable *table[ORDER1_CONTEXTS];
+	decodeTable *shared = decodeTable_create(m->shared);
+	bitReader reader;
+	int result = 0;
+
+	for(int c = 0; c < ORDER1_CONTEXTS; c++){
+		if(m->own[c] != NULL){
+			lookup[c] = decodeTable_create(m->own[c]);
+			table[c] = lookup[c];
+		} else {
+			table[c] = shared;
+		}
+	}
+
+	bitReader_init(&reader, bits, length);
+	for(size_t i = 0; i < outputLength; i++){
+		int32_t symbol;
+		if(reader.bits < CODETABLE_MAXLENGTH){
+			bitReader_refill(&reader);
+		}
+		symbol = decodeTable_decode(table[previous], &reader);
+		if(symbol < 0){
+			result = -1;
+			break;
+		}
+		output[i] = (unsigned char)symbol;
+		previous = symbol;
+	}
+	if(bitReader_overrun(&reader)){
+		result = -1;
+	}
+
+	for(int c = 0; c < ORDER1_CONTEXTS; c++){
+		if(lookup[c] != NULL){
+			decodeTable_free(lookup[c]);
+		}
+	}
+	decodeTable_free(shared);
+	return result;
+}
+
+void order1Model_free(order1Model *m){
+	clearOwnTables(m);
+	codeTable_free(m->shared);
+	free(m);
+}
+
+/*
+ * setTable - gives t the Huffman code of the counts in frequency
+ */
+static void setTable(codeTable *t, const uint64_t *frequency){
+	unsigned char lengths[256];
+
+	getCodeLengths(frequency, lengths, CODETABLE_MAXLENGTH);
+	codeTable_setLengths(t, lengths);
+}
+
+static void clearOwnTables(order1Model *m){
+	for(int c = 0; c < ORDER1_CONTEXTS; c++){
+		if(m->own[c] != NULL){
+			codeTable_free(m->own[c]);
+			m->own[c] = NULL;
+		}
+	}
+}
@@ -0,0 +1,96 @@
+/* Datatype 'order1Model' - Huffman codes conditioned on the previous byte.
+ *
+ * Text has strong dependencies between neighbouring bytes (e.g. the second
+ * byte of a UTF-8 'ä' almost always follows 0xc3). An order-1 model codes
+ * each byte with a table chosen by the byte before it. To keep memory and
+ * stored size bounded the model is sparse: a context only gets a table of
+ * its own if that saves more bits than the table costs to store, all other
+ * contexts share one table built from their combined counts.
+ *
+ * Serialized form: a 32 byte bitmap of the contexts with an own table, the
+ * shared table, then the own tables in context order (see codetable.h).
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __ORDER1_H
+#define __ORDER1_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "codetable.h"
+
+#define ORDER1_CONTEXTS 256
+
+// Largest serialized model: bitmap and 257 full tables
+#define ORDER1_MAXSERIALIZED (32 + 257 * (32 + 128))
+
+typedef struct {
+    codeTable *shared;
+    codeTable *own[ORDER1_CONTEXTS];
+} order1Model;
+
+/*
+ * order1Model_create - creates a model without tables
+ */
+order1Model *order1Model_create(void);
+
+/*
+ * order1Model_fit - builds the tables for a block of data
+ *
+ * Parameter:   m           - the model
+ *              frequency   - counts of every byte (second index) after every
+ *                            context byte (first index)
+ *
+ * Returns:     exact size in bits of the serialized model plus the data
+ *              coded with it
+ */
+uint64_t order1Model_fit(order1Model *m,
+                         const uint64_t (*frequency)[ORDER1_CONTEXTS]);
+
+/*
+ * order1Model_serialize - stores the model
+ *
+ * Returns:     number of bytes written to buffer (at most
+ *              ORDER1_MAXSERIALIZED)
+ */
+size_t order1Model_serialize(const order1Model *m, unsigned char *buffer);
+
+/*
+ * order1Model_deserialize - restores a model stored with
+ *                           order1Model_serialize
+ *
+ * Returns:     number of bytes consumed, -1 if the data is not a valid model
+ */
+long order1Model_deserialize(order1Model *m, const unsigned char *buffer,
+                             size_t length);
+
+/*
+ * order1Model_encode - codes data with the model
+ *
+ * Parameter:   m           - the model
+ *              input       - data to code
+ *              length      - number of bytes in input
+ *              previous    - the byte before input, 0 at the start of data
+ *              output      - buffer for the coded bits
+ *
+ * Returns:     number of bytes written to output
+ */
+size_t order1Model_encode(const order1Model *m, const unsigned char *input,
+                          size_t length, int previous, unsigned char *output);
+
+/*
+ * order1Model_decode - decodes data coded with order1Model_encode
+ *
+ * Returns:     0 on success, -1 if the bits are not valid codes or run out
+ */
+int order1Model_decode(const order1Model *m, const unsigned char *bits,
+                       size_t length, int previous, unsigned char *output,
+                       size_t outputLength);
+
+/*
+ * order1Model_free - deallocates the model and its tables
+ */
+void order1Model_free(order1Model *m);
+
+#endif
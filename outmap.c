@@ -0,0 +1,90 @@
+/* Implementation of the datatype 'output_map', see outmap.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "outmap.h"
+
+// Largest single write of a buffered output
+#define OUTMAP_WRITESIZE (1 << 22)
+
+output_map *outmap_create(const char *path, uint64_t size){
+	struct stat info;
+	output_map *m;
+	bool regular;
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+
+	if(fd < 0){
+		return NULL;
+	}
+	if(size > SIZE_MAX || fstat(fd, &info) != 0){
+		close(fd);
+		return NULL;
+	}
+	regular = S_ISREG(info.st_mode);
+	m = calloc(1, sizeof(output_map));
+	m->fd = fd;
+	m->size = (size_t)size;
+
+	/*
+	 * Reserve the blocks first so that a full disk is noticed here rather
+	 * than as a fault when writing to the map
+	 */
+	if(size > 0 && regular && posix_fallocate(fd, 0, (off_t)size) == 0){
+		void *view = mmap(NULL, m->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		                  fd, 0);
+		if(view != MAP_FAILED){
+			m->data = view;
+			m->mapped = true;
+			return m;
+		}
+	}
+
+	// Not mappable, collect the output in memory
+	if(regular && ftruncate(fd, 0) != 0){
+		close(fd);
+		free(m);
+		return NULL;
+	}
+	m->data = malloc(m->size > 0 ? m->size : 1);
+	if(m->data == NULL){
+		close(fd);
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+int outmap_close(output_map *m, uint64_t length){
+	int result = 0;
+
+	if(m->mapped){
+		if(munmap(m->data, m->size) != 0 ||
+		   ftruncate(m->fd, (off_t)length) != 0){
+			result = -1;
+		}
+	} else {
+		// Sequential writes also work for pipes
+		for(uint64_t done = 0; done < length && result == 0;){
+			size_t part = length - done < OUTMAP_WRITESIZE ?
+			              (size_t)(length - done) : OUTMAP_WRITESIZE;
+			ssize_t written = write(m->fd, m->data + done, part);
+			if(written <= 0){
+				result = -1;
+			}
+			done += written > 0 ? (uint64_t)written : 0;
+		}
+		free(m->data);
+	}
+	if(close(m->fd) != 0){
+		result = -1;
+	}
+	free(m);
+	return result;
+}
@@ -0,0 +1,51 @@
+/* Datatype 'output_map' - output file written in place through memory.
+ *
+ * When the size of an output is known (decoding a frame) or bounded
+ * (encoding one), the file is created at that size up front and mapped
+ * into memory, so coders write their results straight into the page cache
+ * without stdio, and parallel workers can write their parts of the file
+ * at their final offsets without any ordering step. The file is cut to
+ * the size actually written when it is closed.
+ *
+ * Outputs that can't be mapped (pipes, special files, full disks) get a
+ * buffer in memory instead that is written in large pieces when closing.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __OUTMAP_H
+#define __OUTMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    int fd;
+    bool mapped;
+} output_map;
+
+/*
+ * outmap_create - creates a file of size bytes and maps it for writing
+ *
+ * Parameter:   path    - name of the file
+ *              size    - most bytes that will be written
+ *
+ * Returns:     the map, NULL if the file couldn't be created or no memory
+ *              was available. Write to data and finish with outmap_close.
+ */
+output_map *outmap_create(const char *path, uint64_t size);
+
+/*
+ * outmap_close - finishes the file and deallocates the datatype
+ *
+ * Parameter:   m       - the map
+ *              length  - number of bytes of data written (<= size)
+ *
+ * Returns:     0 on success, -1 if the file couldn't be written
+ */
+int outmap_close(output_map *m, uint64_t length);
+
+#endif
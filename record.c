@@ -0,0 +1,134 @@
+/* Coding of small records, see record.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "record.h"
+#include "bitio.h"
+#include "kernels.h"
+
+static const unsigned char recordMagic[4] = { 0x89, 'H', 'U', 'R' };
+
+// Longest code of a byte: escape code plus literal
+#define MAXBYTEBITS (CODETABLE_MAXLENGTH + CODETABLE_LITERALBITS)
+
+recordModel *recordModel_create(const codeTable *table,
+                                const decodeTable *lookup){
+	recordModel *m = malloc(sizeof(recordModel));
+
+	m->table = table;
+	m->ownLookup = NULL;
+	if(lookup == NULL){
+		m->ownLookup = decodeTable_create(table);
+		lookup = m->ownLookup;
+	}
+	m->lookup = lookup;
+	kernels_packTable(table, m->packed);
+
+	// Pick the kernels now rather than while coding the first record
+	kernels_get();
+	return m;
+}
+
+void recordModel_free(recordModel *m){
+	if(m->ownLookup != NULL){
+		decodeTable_free(m->ownLookup);
+	}
+	free(m);
+}
+
+size_t record_maxEncodedSize(size_t length){
+	return 10 + (length * MAXBYTEBITS + 7) / 8 + KERNELS_SLACK;
+}
+
+size_t record_encode(const recordModel *m, const unsigned char *record,
+                     size_t length, unsigned char *output){
+	size_t prefix = storeVarint(output, length);
+	return prefix + kernels_get()->encode(m->packed, record, length,
+	                                      output + prefix);
+}
+
+long record_decode(const recordModel *m, const unsigned char *input,
+                   size_t length, unsigned char *output, size_t capacity,
+                   size_t *recordLength){
+	bitReader reader;
+	uint64_t symbols;
+	size_t count;
+	size_t bits;
+	long prefix = loadVarint(input, length, &symbols);
+
+	if(prefix < 0){
+		return -1;
+	}
+	if(symbols > capacity){
+		return 0;
+	}
+	count = (size_t)symbols;
+	bitReader_init(&reader, input + prefix, length - (size_t)prefix);
+	if(kernels_get()->decode(m->lookup, &reader, 1, &output, &count) != 0){
+		return -1;
+	}
+
+	// The record ends at the byte holding its last code bit
+	bits = reader.position * 8 - (size_t)reader.bits;
+	if(bits > (length - (size_t)prefix) * 8){
+		return -1;
+	}
+	*recordLength = count;
+	return prefix + (long)((bits + 7) / 8);
+}
+
+size_t record_encodeBatch(const recordModel *m,
+                          const unsigned char *const *records,
+                          const size_t *lengths, size_t count,
+                          unsigned char *output){
+	size_t (*encode)(const uint32_t *, const unsigned char *, size_t,
+	                 unsigned char *) = kernels_get()->encode;
+	size_t written = 0;
+
+	for(size_t i = 0; i < count; i++){
+		written += storeVarint(output + written, lengths[i]);
+		written += encode(m->packed, records[i], lengths[i], output + written);
+	}
+	return written;
+}
+
+long record_decodeBatch(const recordModel *m, const unsigned char *input,
+                        size_t length, unsigned char *output,
+                        size_t capacity, size_t *lengths, size_t count,
+                        size_t *used){
+	size_t position = 0;
+	size_t filled = 0;
+	size_t decoded = 0;
+
+	while(decoded < count && position < length){
+		long size = record_decode(m, input + position, length - position,
+		                          output + filled, capacity - filled,
+		                          &lengths[decoded]);
+		if(size < 0){
+			return -1;
+		}
+		if(size == 0){
+			break;
+		}
+		position += (size_t)size;
+		filled += lengths[decoded];
+		decoded++;
+	}
+	*used = position;
+	return (long)decoded;
+}
+
+bool record_isRecordFile(const unsigned char *data, size_t length){
+	return length >= RECORD_HEADERSIZE &&
+	       !memcmp(data, recordMagic, sizeof(recordMagic)) &&
+	       data[4] == RECORD_VERSION;
+}
+
+void record_writeHeader(unsigned char *header, int model){
+	memcpy(header, recordMagic, sizeof(recordMagic));
+	header[4] = RECORD_VERSION;
+	header[5] = (unsigned char)model;
+}
@@ -0,0 +1,153 @@
+/* Small records - coding many short messages with one shared model.
+ *
+ * Frames and streams pay for a header, tables and padding once per file,
+ * which is nothing for a large file but more than the data for a log line
+ * of a hundred bytes. Records are instead coded with a model that encoder
+ * and decoder load once up front (the global escape table of a frequency
+ * file, or the built in model) and carry no header at all. A coded record
+ * is the number of bytes of the record as varint (see bitio.h) followed by
+ * the codes of its bytes, padded to a whole byte:
+ *
+ *      varint  record length
+ *      ...     code bits, first bit in the least significant bit
+ *
+ * Records are coded with the kernels of kernels.h and no memory is
+ * allocated per record, so coding a record costs little more than its
+ * table lookups. The batch functions code arrays of records back to back.
+ *
+ * Record file: magic 0x89 'H' 'U' 'R', version byte, model byte
+ * (RECORD_MODEL_*), then the coded records.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __RECORD_H
+#define __RECORD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "codetable.h"
+
+#define RECORD_VERSION 1
+#define RECORD_HEADERSIZE 6
+
+// Model a record file was coded with
+#define RECORD_MODEL_FILE 0
+#define RECORD_MODEL_BUILTIN 1
+
+/*
+ * Struct 'recordModel'
+ * A shared model prepared for coding records
+ *
+ *      table       - escape table (see codetable.h)
+ *      lookup      - decode table of table
+ *      ownLookup   - lookup if it was built by recordModel_create
+ *      packed      - table in the form the kernels use
+ */
+typedef struct {
+    const codeTable *table;
+    const decodeTable *lookup;
+    decodeTable *ownLookup;
+    uint32_t packed[256];
+} recordModel;
+
+/*
+ * recordModel_create - prepares a table for coding records
+ *
+ * Parameter:   table   - table with 256 symbols or escape table, it must
+ *                        outlive the model
+ *              lookup  - decode table of table, NULL to build it
+ */
+recordModel *recordModel_create(const codeTable *table,
+                                const decodeTable *lookup);
+
+/*
+ * recordModel_free - deallocates the model, but not the tables given to
+ *                    recordModel_create
+ */
+void recordModel_free(recordModel *m);
+
+/*
+ * record_maxEncodedSize - room record_encode needs for a record of length
+ *                         bytes
+ */
+size_t record_maxEncodedSize(size_t length);
+
+/*
+ * record_encode - codes one record
+ *
+ * Parameter:   m       - the model
+ *              record  - the record
+ *              length  - number of bytes in record
+ *              output  - buffer of at least record_maxEncodedSize(length)
+ *                        bytes
+ *
+ * Returns:     number of bytes of the coded record
+ */
+size_t record_encode(const recordModel *m, const unsigned char *record,
+                     size_t length, unsigned char *output);
+
+/*
+ * record_decode - decodes one record
+ *
+ * Parameter:   m               - the model
+ *              input           - coded records
+ *              length          - number of bytes in input
+ *              output          - buffer that receives the record
+ *              capacity        - size of output
+ *              recordLength    - receives the length of the record
+ *
+ * Returns:     number of bytes of input used, 0 if the record doesn't fit
+ *              in output, -1 if input doesn't start with a valid record
+ */
+long record_decode(const recordModel *m, const unsigned char *input,
+                   size_t length, unsigned char *output, size_t capacity,
+                   size_t *recordLength);
+
+/*
+ * record_encodeBatch - codes count records back to back
+ *
+ * Parameter:   records - the records
+ *              lengths - number of bytes of every record
+ *              output  - buffer of at least the sum of
+ *                        record_maxEncodedSize over all records
+ *
+ * Returns:     number of bytes written to output
+ */
+size_t record_encodeBatch(const recordModel *m,
+                          const unsigned char *const *records,
+                          const size_t *lengths, size_t count,
+                          unsigned char *output);
+
+/*
+ * record_decodeBatch - decodes up to count records to output, back to back
+ *
+ * Parameter:   input       - coded records
+ *              length      - number of bytes in input
+ *              output      - buffer that receives the records
+ *              capacity    - size of output
+ *              lengths     - receives the length of every decoded record
+ *              count       - most records to decode
+ *              used        - receives the number of bytes of input used
+ *
+ * Returns:     number of records decoded, which is less than count when
+ *              input ends or output is full, -1 if a record is corrupt
+ */
+long record_decodeBatch(const recordModel *m, const unsigned char *input,
+                        size_t length, unsigned char *output,
+                        size_t capacity, size_t *lengths, size_t count,
+                        size_t *used);
+
+/*
+ * record_isRecordFile - checks if a buffer starts with a record file header
+ */
+bool record_isRecordFile(const unsigned char *data, size_t length);
+
+/*
+ * record_writeHeader - fills in the RECORD_HEADERSIZE bytes of a record
+ *                      file header
+ */
+void record_writeHeader(unsigned char *header, int model);
+
+#endif
@@ -0,0 +1,206 @@
+/* Implementation of the datatype 'modelRegistry', see registry.h.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "registry.h"
+#include "histogram.h"
+#include "huffmantree.h"
+
+/*
+ * Struct 'sharedRegistry'
+ *
+ *      current     - the version readers acquire
+ *      epoch       - its low bit selects the entering counter of new readers
+ *      entering    - readers between loading current and taking their
+ *                    reference, counted by the epoch they started in
+ *      publishing  - serializes the publishers
+ */
+struct sharedRegistry {
+    modelRegistry *current;
+    unsigned long epoch;
+    long entering[2];
+    pthread_mutex_t publishing;
+};
+
+static void waitForReaders(sharedRegistry *s);
+
+modelRegistry *registry_create(void){
+	modelRegistry *r = calloc(1, sizeof(modelRegistry));
+	r->references = 1;
+	return r;
+}
+
+int registry_add(modelRegistry *r, const codeTable *table,
+                 const decodeTable *lookup){
+	int id = r->count;
+
+	if(id >= REGISTRY_MAXMODELS){
+		return -1;
+	}
+	r->table[id] = table;
+	r->fingerprint[id] = codeTable_fingerprint(table);
+	r->ownTable[id] = false;
+	r->ownLookup[id] = lookup == NULL;
+	r->lookup[id] = lookup != NULL ? lookup : decodeTable_create(table);
+	r->count++;
+	return id;
+}
+
+codeTable *registry_loadTable(const char *path){
+	unsigned char lengths[CODETABLE_ESCAPE + 1];
+	histogram *trained = histogram_empty();
+	codeTable *table;
+	FILE *file = fopen(path, "rb");
+
+	if(file == NULL){
+		histogram_free(trained);
+		return NULL;
+	}
+	if(histogram_load(trained, file) != 0){
+		fprintf(stderr, "Corrupt histogram file %s\n", path);
+		fclose(file);
+		histogram_free(trained);
+		return NULL;
+	}
+	fclose(file);
+
+	getEscapeCodeLengths(trained->count, lengths, CODETABLE_MAXLENGTH);
+	table = codeTable_create(CODETABLE_ESCAPE + 1);
+	codeTable_setLengths(table, lengths);
+	histogram_free(trained);
+	return table;
+}
+
+int registry_load(modelRegistry *r, const char *path){
+	codeTable *table;
+	int id;
+
+	if(r->count >= REGISTRY_MAXMODELS){
+		return -1;
+	}
+	table = registry_loadTable(path);
+	if(table == NULL){
+		return -1;
+	}
+	id = registry_add(r, table, NULL);
+	if(id < 0){
+		codeTable_free(table);
+		return -1;
+	}
+	r->ownTable[id] = true;
+	return id;
+}
+
+int registry_loadList(modelRegistry *r, const char *paths){
+	size_t length = strlen(paths);
+	char *path = malloc(length + 1);
+	int added = 0;
+
+	for(const char *start = paths; start <= paths + length;){
+		const char *end = strchr(start, REGISTRY_SEPARATOR);
+		if(end == NULL){
+			end = paths + length;
+		}
+		memcpy(path, start, (size_t)(end - start));
+		path[end - start] = '\0';
+		if(registry_load(r, path) < 0){
+			free(path);
+			return -1;
+		}
+		added++;
+		start = end + 1;
+	}
+	free(path);
+	return added;
+}
+
+void registry_free(modelRegistry *r){
+	if(r == NULL){
+		return;
+	}
+	for(int i = 0; i < r->count; i++){
+		if(r->ownLookup[i]){
+			decodeTable_free((decodeTable *)r->lookup[i]);
+		}
+		if(r->ownTable[i]){
+			codeTable_free((codeTable *)r->table[i]);
+		}
+	}
+	free(r);
+}
+
+sharedRegistry *registry_share(modelRegistry *first){
+	sharedRegistry *s = malloc(sizeof(sharedRegistry));
+
+	s->current = first;
+	s->epoch = 0;
+	s->entering[0] = 0;
+	s->entering[1] = 0;
+	pthread_mutex_init(&s->publishing, NULL);
+	return s;
+}
+
+const modelRegistry *registry_acquire(sharedRegistry *s){
+	unsigned long epoch = __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST) & 1;
+	modelRegistry *r;
+
+	/*
+	 * Announce the reader before loading the pointer: a publisher that
+	 * swaps it out afterwards sees the announcement and waits until the
+	 * reference is taken before it drops its own
+	 */
+	__atomic_fetch_add(&s->entering[epoch], 1, __ATOMIC_SEQ_CST);
+	r = __atomic_load_n(&s->current, __ATOMIC_SEQ_CST);
+	__atomic_fetch_add(&r->references, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(&s->entering[epoch], 1, __ATOMIC_RELEASE);
+	return r;
+}
+
+void registry_release(const modelRegistry *r){
+	modelRegistry *version = (modelRegistry *)r;
+
+	if(__atomic_fetch_sub(&version->references, 1, __ATOMIC_ACQ_REL) == 1){
+		registry_free(version);
+	}
+}
+
+void registry_publish(sharedRegistry *s, modelRegistry *next){
+	modelRegistry *old;
+
+	pthread_mutex_lock(&s->publishing);
+	old = __atomic_exchange_n(&s->current, next, __ATOMIC_SEQ_CST);
+	waitForReaders(s);
+	pthread_mutex_unlock(&s->publishing);
+	registry_release(old);
+}
+
+void registry_unshare(sharedRegistry *s){
+	registry_release(s->current);
+	pthread_mutex_destroy(&s->publishing);
+	free(s);
+}
+
+/*
+ * waitForReaders - waits until no reader can still be taking a reference
+ *                  to a version that was current before the call
+ *
+ * Such a reader announced itself before the swap, in the counter of the
+ * epoch it started in. A reader that is delayed before its announcement
+ * may have seen an epoch one flip old, so the epoch is flipped twice,
+ * draining the old counter each time while new readers go to the other.
+ */
+static void waitForReaders(sharedRegistry *s){
+	for(int phase = 0; phase < 2; phase++){
+		unsigned long epoch = __atomic_fetch_add(&s->epoch, 1,
+		                                         __ATOMIC_SEQ_CST) & 1;
+		while(__atomic_load_n(&s->entering[epoch], __ATOMIC_ACQUIRE) != 0){
+			sched_yield();
+		}
+	}
+}
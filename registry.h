@@ -0,0 +1,166 @@
+/* Datatype 'modelRegistry' - the pretrained models a frame may use.
+ *
+ * Data of different families (logs, prose, JSON, ...) compresses best with
+ * a model trained on its own family. A registry holds up to
+ * REGISTRY_MAXMODELS global escape tables (see codetable.h) together with
+ * their decode tables, numbered in the order they were added. The frame
+ * encoder scores every block against all of them in one pass over the
+ * block's histogram and codes it with the cheapest, storing the number of
+ * the model and the fingerprint of its table in the block (see frame.h).
+ * The decoder keeps the same models resident in the same order, so blocks
+ * of a mixed feed each get the model of their own family without a
+ * separate classification step; a model in another place fails the
+ * fingerprint check instead of decoding wrong bytes.
+ *
+ * A registry is immutable once it is in use. Long running processes that
+ * retrain their models share it through a sharedRegistry instead: coders
+ * acquire the current registry without locks and release it when done,
+ * retraining builds a new registry and publishes it with an atomic
+ * pointer swap, and every registry is freed by whoever releases it last.
+ * Readers never wait for a publisher; a publisher only waits for readers
+ * in the middle of the few instructions that take a reference.
+ *
+ * Written by Simon Andersson <dv15san@cs.umu.se>
+ * and Lorenz Gerber <dv15lgr@cs.umu.se>
+ */
+#ifndef __REGISTRY_H
+#define __REGISTRY_H
+
+#include <stdbool.h>
+#include "codetable.h"
+
+// Most models of a registry, a model number fits in a byte
+#define REGISTRY_MAXMODELS 256
+
+// Separates the files of a list given to registry_loadList
+#define REGISTRY_SEPARATOR ','
+
+/*
+ * Struct 'modelRegistry'
+ *
+ *      count       - number of models
+ *      table       - escape table of every model
+ *      lookup      - decode table of every model
+ *      fingerprint - codeTable_fingerprint of every table
+ *      ownTable    - the registry frees the table
+ *      ownLookup   - the registry frees the decode table
+ *      references  - number of holders, see registry_release
+ */
+typedef struct {
+    long references;
+    int count;
+    const codeTable *table[REGISTRY_MAXMODELS];
+    const decodeTable *lookup[REGISTRY_MAXMODELS];
+    uint32_t fingerprint[REGISTRY_MAXMODELS];
+    bool ownTable[REGISTRY_MAXMODELS];
+    bool ownLookup[REGISTRY_MAXMODELS];
+} modelRegistry;
+
+/*
+ * registry_create - creates a registry without models
+ */
+modelRegistry *registry_create(void);
+
+/*
+ * registry_add - adds a model the caller keeps ownership of
+ *
+ * Parameter:   r       - the registry
+ *              table   - escape table of the model
+ *              lookup  - its decode table, NULL to have one built
+ *
+ * Returns:     the number of the model, -1 if the registry is full
+ */
+int registry_add(modelRegistry *r, const codeTable *table,
+                 const decodeTable *lookup);
+
+/*
+ * registry_loadTable - builds the global escape table of a frequency file
+ *
+ * Parameter:   path    - text or histogram file
+ *
+ * Returns:     the table, NULL if the file couldn't be opened or read
+ *
+ * Comments:    Unlike the legacy format this uses the real counts of the
+ *              file. Bytes that never (or hardly ever) occur in it get no
+ *              code of their own and are coded with the escape symbol, see
+ *              getEscapeCodeLengths.
+ */
+codeTable *registry_loadTable(const char *path);
+
+/*
+ * registry_load - adds the model of a frequency file
+ *
+ * Returns:     the number of the model, -1 if the file couldn't be read or
+ *              the registry is full
+ */
+int registry_load(modelRegistry *r, const char *path);
+
+/*
+ * registry_loadList - adds the models of frequency files
+ *
+ * Parameter:   r       - the registry
+ *              paths   - one file name, or several separated by
+ *                        REGISTRY_SEPARATOR
+ *
+ * Returns:     the number of models added, -1 if a file couldn't be read
+ *              or the registry is full
+ */
+int registry_loadList(modelRegistry *r, const char *paths);
+
+/*
+ * registry_free - deallocates the registry and the tables it owns
+ */
+void registry_free(modelRegistry *r);
+
+typedef struct sharedRegistry sharedRegistry;
+
+/*
+ * registry_share - makes a registry the first version of a shared one
+ *
+ * Parameter:   first   - the registry, owned by the shared registry from
+ *                        now on and not changed any more
+ *
+ * Returns:     the shared registry
+ */
+sharedRegistry *registry_share(modelRegistry *first);
+
+/*
+ * registry_acquire - takes a reference to the current version
+ *
+ * Returns:     the registry, valid until it is given to registry_release
+ *
+ * Comments:    Lock free, may be called by any number of threads while
+ *              other threads publish new versions.
+ */
+const modelRegistry *registry_acquire(sharedRegistry *s);
+
+/*
+ * registry_release - drops a reference taken with registry_acquire
+ *
+ * Comments:    The last release of a version that is no longer current
+ *              frees it.
+ */
+void registry_release(const modelRegistry *r);
+
+/*
+ * registry_publish - makes a registry the current version
+ *
+ * Parameter:   s       - the shared registry
+ *              next    - the new version, owned by s from now on
+ *
+ * Comments:    Coders holding the old version go on using it, it is freed
+ *              when the last of them releases it. Publishers are
+ *              serialized among themselves only.
+ */
+void registry_publish(sharedRegistry *s, modelRegistry *next);
+
+/*
+ * registry_unshare - drops the current version and deallocates the shared
+ *                    registry
+ *
+ * Comments:    No thread may acquire from s any more; versions still held
+ *              are freed by their last release.
+ */
+void registry_unshare(sharedRegistry *s);
+
+#endif